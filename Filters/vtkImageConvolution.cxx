@@ -29,112 +29,1708 @@
 #include "vtkObjectFactory.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 #include "vtkDataArray.h"
+#include "vtkImageFFT.h"
+#include "vtkImageRFFT.h"
+#include "vtkMultiThreader.h"
+
+#include <vector>
+#include <math.h>
 	
 vtkStandardNewMacro(vtkImageConvolution);
 
+//----------------------------------------------------------------------------
+// One separable term of a kernel component: K(i,j,k) = f0(i) f1(j) f2(k)
+struct vtkImageConvolutionSeparableTerm
+{
+  std::vector<double> Factor[3];
+};
+
+//----------------------------------------------------------------------------
+// Memory (bytes) of a tile of gathered neighbourhoods in the blocked product,
+// sized to stay in the L2 cache.
+#define VTK_CONVOLUTION_TILE_MEMORY 262144
+
+//----------------------------------------------------------------------------
+// Largest number of direct components accumulated in fixed point when the
+// blocked product is on: the fixed point loop runs over the neighbourhood
+// once per component, and the blocked product is faster beyond this number.
+#define VTK_CONVOLUTION_FIXED_POINT_COMPONENTS 4
+
+//----------------------------------------------------------------------------
+// Execution path of a kernel component
+enum
+{
+  VTK_CONVOLUTION_DIRECT_PATH = 0, //!< neighbourhood loop
+  VTK_CONVOLUTION_SEPARABLE_PATH, //!< successive 1D passes
+  VTK_CONVOLUTION_FFT_PATH //!< product in the frequency domain
+};
+
+//----------------------------------------------------------------------------
+// What the prepared kernel depends on: the kernel image, the input properties
+// and the settings of the filter that drive the preparation.
+struct vtkImageConvolutionKernelKey
+{
+  unsigned long KernelTime; //!< MTime of the kernel image
+  int InNumComps; //!< number of components of the input
+  int InScalarType; //!< scalar type of the input
+  int HasMask; //!< 1 if a mask is connected
+  int SeparableKernel;
+  int MaximumSeparableRank;
+  double SeparabilityTolerance;
+  int FFTKernelSizeThreshold;
+  int BoundaryCondition;
+  int FixedPoint;
+  int FixedPointInputBits;
+};
+
+//----------------------------------------------------------------------------
+static bool vtkImageConvolutionSameKey( const vtkImageConvolutionKernelKey& a,
+                                        const vtkImageConvolutionKernelKey& b )
+{
+  return( a.KernelTime == b.KernelTime && a.InNumComps == b.InNumComps
+          && a.InScalarType == b.InScalarType && a.HasMask == b.HasMask
+          && a.SeparableKernel == b.SeparableKernel
+          && a.MaximumSeparableRank == b.MaximumSeparableRank
+          && a.SeparabilityTolerance == b.SeparabilityTolerance
+          && a.FFTKernelSizeThreshold == b.FFTKernelSizeThreshold
+          && a.BoundaryCondition == b.BoundaryCondition
+          && a.FixedPoint == b.FixedPoint
+          && a.FixedPointInputBits == b.FixedPointInputBits );
+}
+
+//----------------------------------------------------------------------------
+// Kernel data prepared in RequestData and shared by the threads. It is kept
+// between executions and prepared again only when its key changes.
+class vtkImageConvolutionInternals
+{
+public:
+  //! 1 if the members below hold a prepared kernel
+  int Prepared;
+  //! Key of the prepared kernel
+  vtkImageConvolutionKernelKey Key;
+  //! Separable terms of each kernel component. An empty list means that the
+  //! component is not separable.
+  std::vector< std::vector<vtkImageConvolutionSeparableTerm> > Terms;
+  //! Execution path of each kernel component
+  std::vector<int> Path;
+  //! Kernel components computed by the direct path
+  std::vector<int> DirectComponents;
+  //! Taps of the direct components, interleaved: DirectTaps[tap * n + d] is
+  //! the weight of the tap for the d-th direct component.
+  std::vector<double> DirectTaps;
+  //! Same taps packed for the blocked product: panels of 4 components (zero
+  //! padded), each panel storing the 4 weights of a tap side by side.
+  std::vector<double> PackedTaps;
+  //! 1 if the interior voxels of the direct components are accumulated in
+  //! fixed point
+  int HasFixedPoint;
+  //! Taps of the direct components quantized to 16 bits integers, component
+  //! after component. The kernel rows are zero padded to FixedRowLength taps,
+  //! a multiple of 8, so that the products are computed by whole SIMD
+  //! registers: the tap (x, row) of the d-th component is
+  //! FixedTaps[( d * numRows + row ) * FixedRowLength + x].
+  std::vector<vtkTypeInt16> FixedTaps;
+  //! Length of the padded kernel rows of FixedTaps
+  vtkIdType FixedRowLength;
+  //! Scale of the quantized taps of each direct component (a power of 2):
+  //! DirectTaps ~= FixedTaps * FixedScales
+  std::vector<double> FixedScales;
+  //! Bound of the input values the taps are quantized for (2^k - 1), 0 if
+  //! they are not quantized
+  double FixedInputBound;
+  //! Offset subtracted from the input values so that they fit in 16 bits
+  //! signed integers (32768 for inputs above 32767, else 0)
+  int FixedInputOffset;
+  //! FixedInputOffset * sum of the quantized taps of each direct component,
+  //! added back to the integer sums
+  std::vector<vtkTypeInt64> FixedOffsetSums;
+  //! Number of padded taps (whole kernel rows) whose products are summed in
+  //! 32 bits before being added to the 64 bits sums
+  vtkIdType FixedBlockLength;
+  //! 1 if at least one component is separable
+  int HasSeparable;
+  //! 1 if at least one component is computed in the frequency domain
+  int HasFFT;
+  //! 1 if a mask restricts the computed voxels
+  int HasMask;
+  //! Extent on which the spans of the mask are computed
+  int SpanExtent[6];
+  //! Spans [x0,x1] of the mask voxels, row after row
+  std::vector<int> Spans;
+  //! Index of the first span of each row of SpanExtent (one more entry for
+  //! the end of the last row)
+  std::vector<vtkIdType> SpanRows;
+  //! Number of mask voxels of each slice (along the split axis)
+  std::vector<vtkIdType> SpanSliceCounts;
+  //! Axis along which SpanSliceCounts is computed
+  int SpanAxis;
+  //! Padded size for which the spectra of the FFT components are computed
+  int SpectrumSize[3];
+  //! Spectrum of each kernel component (empty if not computed in the
+  //! frequency domain), as the interleaved output of vtkImageFFT
+  std::vector< std::vector<double> > Spectra;
+};
+
 //----------------------------------------------------------------------------
 // Construct an instance of vtkImageConvolution filter.
 vtkImageConvolution::vtkImageConvolution()
 {
   this->OutputDataName = 0;
+  this->SeparableKernel = 1;
+  this->MaximumSeparableRank = 3;
+  this->SeparabilityTolerance = 1e-6;
+  this->FFTKernelSizeThreshold = 729;
+  this->BoundaryCondition = VTK_CONVOLUTION_BOUNDARY_ZERO;
+  this->MemoryLimit = 0;
+  this->OutputScalarType = VTK_DOUBLE;
+  this->OutputScale = 1.0;
+  this->BlockedKernelProduct = 1;
+  this->FixedPoint = 0;
+  this->FixedPointInputBits = 0;
+  this->CurrentSlab = 0;
+  this->NumberOfSlabs = 1;
+  this->SlabAxis = 2;
+  this->Internals = new vtkImageConvolutionInternals;
+  this->Internals->HasSeparable = 0;
+  this->Internals->HasFFT = 0;
+  this->Internals->HasMask = 0;
+  this->Internals->HasFixedPoint = 0;
+  this->Internals->FixedInputBound = 0;
+  this->Internals->FixedInputOffset = 0;
+  this->Internals->FixedRowLength = 0;
+  this->Internals->FixedBlockLength = 0;
+  this->Internals->Prepared = 0;
+  this->Internals->SpectrumSize[0] = 0;
 
-  this->SetNumberOfInputPorts( 2 );
+  this->SetNumberOfInputPorts( 3 );
 }
 
 //----------------------------------------------------------------------------
 // Destructor
 vtkImageConvolution::~vtkImageConvolution()
 {
+  delete this->Internals;
+}
+
+//----------------------------------------------------------------------------
+void vtkImageConvolution::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "SeparableKernel: " << this->SeparableKernel << "\n";
+  os << indent << "MaximumSeparableRank: " << this->MaximumSeparableRank << "\n";
+  os << indent << "SeparabilityTolerance: " << this->SeparabilityTolerance << "\n";
+  os << indent << "FFTKernelSizeThreshold: " << this->FFTKernelSizeThreshold << "\n";
+  os << indent << "BoundaryCondition: " << this->GetBoundaryConditionAsString( ) << "\n";
+  os << indent << "MemoryLimit: " << this->MemoryLimit << " KiB\n";
+  os << indent << "OutputScalarType: " 
+     << vtkImageScalarTypeNameMacro( this->OutputScalarType ) << "\n";
+  os << indent << "OutputScale: " << this->OutputScale << "\n";
+  os << indent << "BlockedKernelProduct: " << this->BlockedKernelProduct << "\n";
+  os << indent << "FixedPoint: " << this->FixedPoint << "\n";
+  os << indent << "FixedPointInputBits: " << this->FixedPointInputBits << "\n";
+}
+
+//----------------------------------------------------------------------------
+const char* vtkImageConvolution::GetBoundaryConditionAsString( )
+{
+  switch( this->BoundaryCondition )
+    {
+    case VTK_CONVOLUTION_BOUNDARY_CLAMP:
+      return( "Clamp" );
+    case VTK_CONVOLUTION_BOUNDARY_MIRROR:
+      return( "Mirror" );
+    default:
+      return( "Zero" );
+    }
+}
+
+//----------------------------------------------------------------------------
+// Map the index idx on the axis [min,max] of the whole input extent according
+// to the boundary condition. Returns 0 if the sample is outside the image and
+// counts as zero.
+static inline int vtkImageConvolutionBoundaryIndex( int idx, int min, int max,
+                                                    int boundary, int& inIdx )
+{
+  if( idx >= min && idx <= max )
+    {
+    inIdx = idx;
+    return( 1 );
+    }
+  switch( boundary )
+    {
+    case VTK_CONVOLUTION_BOUNDARY_CLAMP:
+      inIdx = idx < min ? min : max;
+      return( 1 );
+    case VTK_CONVOLUTION_BOUNDARY_MIRROR:
+      {
+      // Same convention as vtkImageMirrorPad: the edge voxel is repeated and
+      // the padded image is periodic with a period of twice the size.
+      int size = max - min + 1;
+      int r = ( idx - min ) % ( 2 * size );
+      if( r < 0 )
+        {
+        r += 2 * size;
+        }
+      inIdx = r < size ? min + r : min + 2 * size - 1 - r;
+      return( 1 );
+      }
+    default:
+      return( 0 );
+    }
+}
+
+//----------------------------------------------------------------------------
+// Specify a source object at a specified table location.
+void vtkImageConvolution::SetKernelConnection(int id, vtkAlgorithmOutput* algOutput)
+{
+  if (id < 0)
+    {
+    vtkErrorMacro("Bad index " << id << " for source.");
+    return;
+    }
+
+  int numConnections = this->GetNumberOfInputConnections(1);
+  if (id < numConnections)
+    {
+    this->SetNthInputConnection(1, id, algOutput);
+    }
+  else if (id == numConnections && algOutput)
+    {
+    this->AddInputConnection(1, algOutput);
+    }
+  else if (algOutput)
+    {
+    vtkWarningMacro("The source id provided is larger than the maximum "
+                    "source id, using " << numConnections << " instead.");
+    this->AddInputConnection(1, algOutput);
+    }
+}
+
+
+//----------------------------------------------------------------------------
+void vtkImageConvolution::SetMaskConnection(vtkAlgorithmOutput* algOutput)
+{
+  this->SetInputConnection(2, algOutput);
+}
+
+//----------------------------------------------------------------------------
+void vtkImageConvolution::SetMaskData(vtkImageData* mask)
+{
+  this->SetInputData(2, mask);
+}
+
+//----------------------------------------------------------------------------
+int vtkImageConvolution::FillInputPortInformation(int port, vtkInformation *info)
+{
+  info->Set(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkImageData");
+  if( port == 2 ) // optional mask
+    {
+    info->Set(vtkAlgorithm::INPUT_IS_OPTIONAL(), 1);
+    }
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+// Range of input indices read on one axis by the output indices [outMin,
+// outMax], after the boundary condition is applied. Returns 0 if no input
+// index is read.
+static int vtkImageConvolutionInputRange( int outMin, int outMax, 
+                                          int kernelSize, int min, int max,
+                                          int boundary, int range[2] )
+{
+  int kernelMiddle = kernelSize / 2;
+  int first = outMin - kernelMiddle;
+  int last = outMax + kernelSize - 1 - kernelMiddle;
+  if( boundary == VTK_CONVOLUTION_BOUNDARY_ZERO || ( first >= min && last <= max ) )
+    {
+    range[0] = first < min ? min : first;
+    range[1] = last > max ? max : last;
+    return( range[0] <= range[1] );
+    }
+
+  range[0] = max;
+  range[1] = min;
+  for( int idx = first; idx <= last; idx++ )
+    {
+    int inIdx;
+    vtkImageConvolutionBoundaryIndex( idx, min, max, boundary, inIdx );
+    range[0] = inIdx < range[0] ? inIdx : range[0];
+    range[1] = inIdx > range[1] ? inIdx : range[1];
+    }
+  return( 1 );
+}
+
+//----------------------------------------------------------------------------
+// The whole kernel is needed. The input update extent is the output update
+// extent (or the current slab of it) grown by the kernel half-width.
+int vtkImageConvolution::RequestUpdateExtent(vtkInformation*,
+                                         vtkInformationVector** inputVector,
+                                         vtkInformationVector* outputVector)
+{
+  // Get input and output pipeline information.
+  vtkInformation* outInfo = outputVector->GetInformationObject(0);
+  vtkInformation* inInfo = inputVector[0]->GetInformationObject(0);
+  vtkInformation* kernelInfo = inputVector[1]->GetInformationObject(0);
+
+  // Get the kernel whole extent.
+  int wExtent[6];
+  kernelInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), wExtent);
+  kernelInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), wExtent, 6);
+  int kernelSize[3];
+  for( int axis = 0; axis < 3; axis++ )
+    {
+    kernelSize[axis] = wExtent[2*axis+1] - wExtent[2*axis] + 1;
+    }
+
+  int inWholeExt[6], updateExt[6];
+  inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), inWholeExt);
+  outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), updateExt);
+
+  // The slabs are cut along the last axis of the update extent that is not
+  // flat, so that each slab reads its input with the halo of this axis only.
+  if( this->CurrentSlab == 0 )
+    {
+    this->NumberOfSlabs = 1;
+    this->SlabAxis = 2;
+    while( this->SlabAxis > 0 
+           && updateExt[2*this->SlabAxis] == updateExt[2*this->SlabAxis+1] )
+      {
+      this->SlabAxis--;
+      }
+    int numSlices = updateExt[2*this->SlabAxis+1] - updateExt[2*this->SlabAxis] + 1;
+
+    if( this->MemoryLimit > 0 && numSlices > 1 )
+      {
+      // Memory of one input slice (with the halo) of the slab axis
+      double sliceSize = vtkDataArray::GetDataTypeSize( 
+                                   vtkImageData::GetScalarType( inInfo ) )
+                         * vtkImageData::GetNumberOfScalarComponents( inInfo );
+      for( int axis = 0; axis < 3; axis++ )
+        {
+        if( axis != this->SlabAxis )
+          {
+          sliceSize *= updateExt[2*axis+1] - updateExt[2*axis] + kernelSize[axis];
+          }
+        }
+      double slices = this->MemoryLimit * 1024.0 / sliceSize 
+                      - ( kernelSize[this->SlabAxis] - 1 );
+      int slabSlices = slices < 1 ? 1 : ( slices > numSlices ? numSlices 
+                                                : static_cast<int>( slices ) );
+      this->NumberOfSlabs = ( numSlices + slabSlices - 1 ) / slabSlices;
+      }
+    }
+
+  // Output extent of the current slab
+  for( int idx = 0; idx < 6; idx++ )
+    {
+    this->SlabExtent[idx] = updateExt[idx];
+    }
+  int min = updateExt[2*this->SlabAxis];
+  int numSlices = updateExt[2*this->SlabAxis+1] - min + 1;
+  this->SlabExtent[2*this->SlabAxis] = min 
+                     + this->CurrentSlab * numSlices / this->NumberOfSlabs;
+  this->SlabExtent[2*this->SlabAxis+1] = min - 1
+                     + ( this->CurrentSlab + 1 ) * numSlices / this->NumberOfSlabs;
+
+  // Input extent read by the slab
+  int inExt[6];
+  for( int axis = 0; axis < 3; axis++ )
+    {
+    if( !vtkImageConvolutionInputRange( this->SlabExtent[2*axis], 
+                     this->SlabExtent[2*axis+1], kernelSize[axis], 
+                     inWholeExt[2*axis], inWholeExt[2*axis+1],
+                     this->BoundaryCondition, inExt + 2*axis ) )
+      {
+      // Nothing to read: keep a valid extent inside the whole extent
+      inExt[2*axis] = inExt[2*axis+1] = inWholeExt[2*axis];
+      }
+    }
+  inInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), inExt, 6);
+
+  // The mask is needed on the output voxels only. Its update extent stays
+  // inside its whole extent; RequestData rejects a mask that does not
+  // cover the slab.
+  vtkInformation* maskInfo = inputVector[2]->GetInformationObject(0);
+  if( maskInfo )
+    {
+    int maskWholeExt[6], maskExt[6];
+    maskInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), maskWholeExt);
+    for( int axis = 0; axis < 3; axis++ )
+      {
+      maskExt[2*axis] = this->SlabExtent[2*axis] > maskWholeExt[2*axis] 
+                        ? this->SlabExtent[2*axis] : maskWholeExt[2*axis];
+      maskExt[2*axis+1] = this->SlabExtent[2*axis+1] < maskWholeExt[2*axis+1] 
+                          ? this->SlabExtent[2*axis+1] : maskWholeExt[2*axis+1];
+      if( maskExt[2*axis] > maskExt[2*axis+1] )
+        {
+        maskExt[2*axis] = maskExt[2*axis+1] = maskWholeExt[2*axis];
+        }
+      }
+    maskInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), maskExt, 6);
+    }
+  
+  return( 1 );
+}
+
+//----------------------------------------------------------------------------
+int vtkImageConvolution::RequestInformation(vtkInformation*,
+                                         vtkInformationVector** inputVector,
+                                         vtkInformationVector* outputVector)
+{
+  // Get input and output pipeline information.
+  vtkInformation* outInfo = outputVector->GetInformationObject(0);
+  vtkInformation* inInfo = inputVector[0]->GetInformationObject(0);
+  vtkInformation* kernelInfo = inputVector[1]->GetInformationObject(0);
+
+  vtkImageData *inImage = vtkImageData::SafeDownCast( inInfo->Get(vtkDataObject::DATA_OBJECT()));
+  int inNumComps = inImage->GetNumberOfScalarComponents(inInfo);
+
+  vtkImageData *kernelImage = vtkImageData::SafeDownCast( kernelInfo->Get(vtkDataObject::DATA_OBJECT()));
+  int krnlNumComps = kernelImage->GetNumberOfScalarComponents(kernelInfo);
+
+  if( this->OutputScalarType != VTK_DOUBLE && this->OutputScalarType != VTK_FLOAT
+      && this->OutputScalarType != VTK_SHORT )
+    {
+    vtkErrorMacro(<< "Unsupported output scalar type: "
+                  << vtkImageScalarTypeNameMacro( this->OutputScalarType ));
+    return( 0 );
+    }
+
+  // Set the number of point data components to the number of
+  // components in the convolution kernel times the number of 
+  // input components.
+  vtkDataObject::SetPointDataActiveScalarInfo(outInfo, 
+                                              this->OutputScalarType,
+                                              krnlNumComps * inNumComps);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+// Rank-1 approximation of the tensor t (size n[0]*n[1]*n[2], i fastest) by
+// alternating least squares. If initialize is set, the starting factors are
+// the three lines of t going through its largest element, which is exact for
+// a rank-1 tensor. Otherwise the current factors of term are refined.
+static void vtkImageConvolutionRankOne( const std::vector<double>& t,
+                                        const int n[3],
+                                        vtkImageConvolutionSeparableTerm& term,
+                                        int initialize )
+{
+  int i, j, k;
+  vtkIdType idx;
+  std::vector<double>& a = term.Factor[0];
+  std::vector<double>& b = term.Factor[1];
+  std::vector<double>& c = term.Factor[2];
+
+  if( initialize )
+    {
+    vtkIdType maxIdx = 0;
+    for( idx = 0; idx < static_cast<vtkIdType>(t.size( )); idx++ )
+      {
+      if( fabs( t[idx] ) > fabs( t[maxIdx] ) )
+        {
+        maxIdx = idx;
+        }
+      }
+    int maxIjk[3];
+    maxIjk[0] = static_cast<int>( maxIdx % n[0] );
+    maxIjk[1] = static_cast<int>( ( maxIdx / n[0] ) % n[1] );
+    maxIjk[2] = static_cast<int>( maxIdx / ( n[0] * n[1] ) );
+
+    a.resize( n[0] );
+    b.resize( n[1] );
+    c.resize( n[2] );
+    for( i = 0; i < n[0]; i++ )
+      a[i] = t[ ( maxIjk[2] * n[1] + maxIjk[1] ) * n[0] + i ];
+    for( j = 0; j < n[1]; j++ )
+      b[j] = t[ ( maxIjk[2] * n[1] + j ) * n[0] + maxIjk[0] ];
+    for( k = 0; k < n[2]; k++ )
+      c[k] = t[ ( k * n[1] + maxIjk[1] ) * n[0] + maxIjk[0] ];
+    }
+
+  for( int iter = 0; iter < 10; iter++ )
+    {
+    double nb = 0, nc = 0, na = 0;
+    for( j = 0; j < n[1]; j++ ) nb += b[j] * b[j];
+    for( k = 0; k < n[2]; k++ ) nc += c[k] * c[k];
+    if( nb == 0 || nc == 0 )
+      break;
+    for( i = 0; i < n[0]; i++ ) a[i] = 0;
+    for( idx = 0, k = 0; k < n[2]; k++ )
+      for( j = 0; j < n[1]; j++ )
+        for( i = 0; i < n[0]; i++, idx++ )
+          a[i] += t[idx] * b[j] * c[k];
+    for( i = 0; i < n[0]; i++ ) { a[i] /= nb * nc; na += a[i] * a[i]; }
+    if( na == 0 )
+      break;
+
+    for( j = 0; j < n[1]; j++ ) b[j] = 0;
+    for( idx = 0, k = 0; k < n[2]; k++ )
+      for( j = 0; j < n[1]; j++ )
+        for( i = 0; i < n[0]; i++, idx++ )
+          b[j] += t[idx] * a[i] * c[k];
+    for( nb = 0, j = 0; j < n[1]; j++ ) { b[j] /= na * nc; nb += b[j] * b[j]; }
+    if( nb == 0 )
+      break;
+
+    for( k = 0; k < n[2]; k++ ) c[k] = 0;
+    for( idx = 0, k = 0; k < n[2]; k++ )
+      for( j = 0; j < n[1]; j++ )
+        for( i = 0; i < n[0]; i++, idx++ )
+          c[k] += t[idx] * a[i] * b[j];
+    for( k = 0; k < n[2]; k++ ) c[k] /= na * nb;
+    }
+}
+
+//----------------------------------------------------------------------------
+// Add (sign = 1) or remove (sign = -1) a separable term to the tensor t.
+static void vtkImageConvolutionAddTerm( std::vector<double>& t, const int n[3],
+                                  const vtkImageConvolutionSeparableTerm& term,
+                                  double sign )
+{
+  vtkIdType idx = 0;
+  for( int k = 0; k < n[2]; k++ )
+    for( int j = 0; j < n[1]; j++ )
+      {
+      double bc = sign * term.Factor[1][j] * term.Factor[2][k];
+      for( int i = 0; i < n[0]; i++, idx++ )
+        t[idx] += term.Factor[0][i] * bc;
+      }
+}
+
+//----------------------------------------------------------------------------
+// Decompose each kernel component in a sum of separable terms when possible,
+// then choose the execution path of each component.
+void vtkImageConvolution::PrepareKernel( vtkImageData* kernel, int inNumComps )
+{
+  int krnlNumComps = kernel->GetNumberOfScalarComponents( );
+  int n[3];
+  kernel->GetDimensions( n );
+  vtkIdType numTaps = static_cast<vtkIdType>(n[0]) * n[1] * n[2];
+  double *kernelPtr = static_cast<double*>( kernel->GetScalarPointer( ) );
+
+  vtkImageConvolutionInternals* internals = this->Internals;
+  internals->Terms.assign( krnlNumComps, 
+                           std::vector<vtkImageConvolutionSeparableTerm>( ) );
+  internals->Path.assign( krnlNumComps, VTK_CONVOLUTION_DIRECT_PATH );
+  internals->HasSeparable = 0;
+  internals->HasFFT = 0;
+
+  // The fast paths are implemented for single component input images only.
+  // They compute whole extents, so the masked voxels go through the direct
+  // path only.
+  if( inNumComps != 1 || !kernelPtr || kernel->GetScalarType( ) != VTK_DOUBLE 
+      || internals->HasMask )
+    {
+    return;
+    }
+
+  std::vector<double> residual( numTaps );
+  for( int comp = 0; this->SeparableKernel && comp < krnlNumComps; comp++ )
+    {
+    double norm = 0;
+    for( vtkIdType idx = 0; idx < numTaps; idx++ )
+      {
+      residual[idx] = kernelPtr[idx * krnlNumComps + comp];
+      norm += residual[idx] * residual[idx];
+      }
+    double tolerance = this->SeparabilityTolerance * this->SeparabilityTolerance * norm;
+
+    // Greedy decomposition: a new term is fitted on the residual, then all
+    // the terms are refined in turn against the residual of the others.
+    std::vector<vtkImageConvolutionSeparableTerm>& terms = internals->Terms[comp];
+    double error = norm;
+    while( error > tolerance 
+           && static_cast<int>(terms.size( )) < this->MaximumSeparableRank
+           && ( static_cast<vtkIdType>(terms.size( )) + 1 ) * ( n[0] + n[1] + n[2] ) 
+                                                                    < numTaps )
+      {
+      vtkImageConvolutionSeparableTerm term;
+      vtkImageConvolutionRankOne( residual, n, term, 1 );
+      vtkImageConvolutionAddTerm( residual, n, term, -1 );
+      terms.push_back( term );
+
+      for( int sweep = 0; terms.size( ) > 1 && sweep < 50; sweep++ )
+        {
+        for( size_t t = 0; t < terms.size( ); t++ )
+          {
+          vtkImageConvolutionAddTerm( residual, n, terms[t], 1 );
+          vtkImageConvolutionRankOne( residual, n, terms[t], 0 );
+          vtkImageConvolutionAddTerm( residual, n, terms[t], -1 );
+          }
+        }
+
+      error = 0;
+      for( vtkIdType idx = 0; idx < numTaps; idx++ )
+        {
+        error += residual[idx] * residual[idx];
+        }
+      }
+
+    if( error <= tolerance )
+      {
+      internals->Path[comp] = VTK_CONVOLUTION_SEPARABLE_PATH;
+      internals->HasSeparable = 1;
+      vtkDebugMacro( << "Kernel component " << comp << " is separable in "
+                     << terms.size( ) << " term(s)." );
+      }
+    else
+      {
+      terms.clear( );
+      }
+    }
+
+  // Large non separable kernels are cheaper in the frequency domain. The
+  // circular convolution only reproduces the zero boundary condition.
+  if( this->FFTKernelSizeThreshold > 0 && numTaps >= this->FFTKernelSizeThreshold
+      && this->BoundaryCondition == VTK_CONVOLUTION_BOUNDARY_ZERO )
+    {
+    for( int comp = 0; comp < krnlNumComps; comp++ )
+      {
+      if( internals->Path[comp] == VTK_CONVOLUTION_DIRECT_PATH )
+        {
+        internals->Path[comp] = VTK_CONVOLUTION_FFT_PATH;
+        internals->HasFFT = 1;
+        }
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+// Gather the taps of the direct kernel components, so that the direct loop
+// reads each neighbour once and updates all these components together.
+// The fixed point taps are quantized afterwards, from the input range.
+static void vtkImageConvolutionGatherDirectTaps( vtkImageData* kernel,
+                                         vtkImageConvolutionInternals* internals )
+{
+  int krnlNumComps = kernel->GetNumberOfScalarComponents( );
+  vtkIdType numTaps = kernel->GetNumberOfPoints( );
+  vtkDataArray* kernelScalars = kernel->GetPointData( )->GetScalars( );
+
+  internals->DirectComponents.clear( );
+  for( int comp = 0; comp < krnlNumComps; comp++ )
+    {
+    if( internals->Path[comp] == VTK_CONVOLUTION_DIRECT_PATH )
+      {
+      internals->DirectComponents.push_back( comp );
+      }
+    }
+
+  int numDirect = static_cast<int>( internals->DirectComponents.size( ) );
+  internals->DirectTaps.resize( numTaps * numDirect );
+  for( vtkIdType idx = 0; idx < numTaps; idx++ )
+    {
+    for( int d = 0; d < numDirect; d++ )
+      {
+      internals->DirectTaps[idx * numDirect + d] = 
+        kernelScalars->GetComponent( idx, internals->DirectComponents[d] );
+      }
+    }
+
+  int numPanels = ( numDirect + 3 ) / 4;
+  internals->PackedTaps.assign( numPanels * numTaps * 4, 0.0 );
+  for( int d = 0; d < numDirect; d++ )
+    {
+    double *panel = &internals->PackedTaps[ ( d / 4 ) * numTaps * 4 + d % 4 ];
+    for( vtkIdType idx = 0; idx < numTaps; idx++ )
+      {
+      panel[idx * 4] = internals->DirectTaps[idx * numDirect + d];
+      }
+    }
+
+  internals->HasFixedPoint = 0;
+  internals->FixedInputBound = 0;
+}
+
+//----------------------------------------------------------------------------
+// Bound of the input values for the fixed point accumulation: 2^bits - 1
+// for inputBits significant bits, or the maximum of the scalar type (bits
+// 0), and 0 if the scalar type is neither unsigned char nor unsigned short.
+// It only depends on the settings, so that the slabs and the streamed pieces
+// of an image get the same taps.
+static double vtkImageConvolutionInputBound( int scalarType, int inputBits )
+{
+  double typeMax;
+  if( scalarType == VTK_UNSIGNED_CHAR )
+    {
+    typeMax = VTK_UNSIGNED_CHAR_MAX;
+    }
+  else if( scalarType == VTK_UNSIGNED_SHORT )
+    {
+    typeMax = VTK_UNSIGNED_SHORT_MAX;
+    }
+  else
+    {
+    return( 0 );
+    }
+  double bound = inputBits > 0 ? ldexp( 1.0, inputBits ) - 1 : typeMax;
+  return( bound < typeMax ? bound : typeMax );
+}
+
+//----------------------------------------------------------------------------
+// Quantize the gathered direct taps for the integer accumulation of inputs
+// bounded by inputBound (see vtkImageConvolutionInputBound). A null bound
+// disables the fixed point accumulation.
+static void vtkImageConvolutionQuantizeDirectTaps( vtkImageData* kernel,
+                                         vtkImageConvolutionInternals* internals,
+                                         double inputBound )
+{
+  vtkIdType numTaps = kernel->GetNumberOfPoints( );
+  int numDirect = static_cast<int>( internals->DirectComponents.size( ) );
+  internals->FixedInputBound = inputBound;
+
+  // Fixed point taps: the inputs, minus FixedInputOffset, are 16 bits signed
+  // integers bounded by maxInput in absolute value: the inputs themselves up
+  // to 15 bits (4095 for 12 bits data), else the inputs minus 32768. The
+  // scale 2^-shift of each component is the finest for which the taps fit in
+  // 16 bits and the sum of the products along a kernel row fits in 32 bits.
+  // The products are accumulated in 32 bits over blocks of as many kernel
+  // rows as this bound allows, and the block sums in 64 bits. Rounding adds
+  // at most 1/2 to each quantized |tap|, hence the bound rowRange on the sum
+  // of the unrounded |taps| of a row.
+  double maxInput = inputBound <= VTK_SHORT_MAX ? inputBound : 32768;
+  int rowLength = kernel->GetDimensions( )[0];
+  double rowRange = inputBound > 0 ? VTK_INT_MAX / maxInput - 0.5 * rowLength : 0;
+  internals->HasFixedPoint = numDirect > 0 && rowRange > 0;
+  if( !internals->HasFixedPoint )
+    {
+    return;
+    }
+  internals->FixedInputOffset = inputBound <= VTK_SHORT_MAX ? 0 : 32768;
+  vtkIdType numRows = numTaps / rowLength;
+  vtkIdType paddedLength = ( rowLength + 7 ) / 8 * 8;
+  vtkIdType numPadded = numRows * paddedLength;
+  internals->FixedRowLength = paddedLength;
+  internals->FixedTaps.assign( numPadded * numDirect, 0 );
+  internals->FixedScales.resize( numDirect );
+  internals->FixedOffsetSums.resize( numDirect );
+  for( int d = 0; d < numDirect; d++ )
+    {
+    double maxTap = 0, maxRowSum = 0;
+    for( vtkIdType row = 0; row < numRows; row++ )
+      {
+      double rowSum = 0;
+      for( vtkIdType idx = row * rowLength; idx < ( row + 1 ) * rowLength; idx++ )
+        {
+        double tap = fabs( internals->DirectTaps[idx * numDirect + d] );
+        maxTap = tap > maxTap ? tap : maxTap;
+        rowSum += tap;
+        }
+      maxRowSum = rowSum > maxRowSum ? rowSum : maxRowSum;
+      }
+    int shift = 0;
+    if( maxTap > 0 )
+      {
+      double range = VTK_SHORT_MAX / maxTap;
+      double sumRange = rowRange / maxRowSum;
+      shift = static_cast<int>( floor( log( range < sumRange ? range : sumRange ) 
+                                       / log( 2.0 ) ) );
+      }
+    internals->FixedScales[d] = ldexp( 1.0, -shift );
+    vtkTypeInt16 *taps = &internals->FixedTaps[d * numPadded];
+    vtkTypeInt64 tapSum = 0;
+    for( vtkIdType idx = 0; idx < numTaps; idx++ )
+      {
+      vtkTypeInt16 tap = static_cast<vtkTypeInt16>( 
+        floor( ldexp( internals->DirectTaps[idx * numDirect + d], shift ) + 0.5 ) );
+      taps[( idx / rowLength ) * paddedLength + idx % rowLength] = tap;
+      tapSum += tap;
+      }
+    internals->FixedOffsetSums[d] = tapSum * internals->FixedInputOffset;
+    }
+
+  // Largest number of rows per block such that maxInput * sum|tap| over each
+  // block fits in 32 bits, for all the components (1 row at least, by the
+  // choice of the scales)
+  vtkIdType blockRows = numRows;
+  for( ; blockRows > 1; blockRows-- )
+    {
+    vtkIdType blockLength = blockRows * paddedLength;
+    vtkTypeInt64 maxBlockSum = 0;
+    for( int d = 0; d < numDirect; d++ )
+      {
+      const vtkTypeInt16 *taps = &internals->FixedTaps[d * numPadded];
+      for( vtkIdType first = 0; first < numPadded; first += blockLength )
+        {
+        vtkIdType last = first + blockLength < numPadded ? first + blockLength 
+                                                         : numPadded;
+        vtkTypeInt64 blockSum = 0;
+        for( vtkIdType idx = first; idx < last; idx++ )
+          {
+          blockSum += taps[idx] < 0 ? -taps[idx] : taps[idx];
+          }
+        maxBlockSum = blockSum > maxBlockSum ? blockSum : maxBlockSum;
+        }
+      }
+    if( maxBlockSum * static_cast<vtkTypeInt64>( maxInput ) <= VTK_INT_MAX )
+      {
+      break;
+      }
+    }
+  internals->FixedBlockLength = blockRows * paddedLength;
+}
+
+//----------------------------------------------------------------------------
+// Run-length encoding of the non zero voxels (first component) of the mask
+// on the extent ext.
+template <class T>
+void vtkImageConvolutionMaskSpans( vtkImageData *mask, T *, int ext[6],
+                                   vtkImageConvolutionInternals *internals )
+{
+  vtkIdType inc0, inc1, inc2;
+  mask->GetIncrements( inc0, inc1, inc2 );
+  int *maskExt = mask->GetExtent( );
+  T *maskPtr = static_cast<T*>( mask->GetScalarPointer( ) );
+
+  for( int idx = 0; idx < 6; idx++ )
+    {
+    internals->SpanExtent[idx] = ext[idx];
+    }
+  internals->SpanAxis = ext[4] < ext[5] ? 2 : 1;
+  internals->Spans.clear( );
+  internals->SpanRows.clear( );
+  internals->SpanSliceCounts.assign( ext[2*internals->SpanAxis+1] 
+                                     - ext[2*internals->SpanAxis] + 1, 0 );
+
+  for( int z = ext[4]; z <= ext[5]; z++ )
+    {
+    for( int y = ext[2]; y <= ext[3]; y++ )
+      {
+      internals->SpanRows.push_back( 
+                        static_cast<vtkIdType>( internals->Spans.size( ) / 2 ) );
+      int slice = internals->SpanAxis == 2 ? z - ext[4] : y - ext[2];
+      T *rowPtr = maskPtr + ( y - maskExt[2] ) * inc1 + ( z - maskExt[4] ) * inc2;
+      int x = ext[0];
+      while( x <= ext[1] )
+        {
+        if( !rowPtr[ ( x - maskExt[0] ) * inc0 ] )
+          {
+          x++;
+          continue;
+          }
+        int first = x;
+        while( x <= ext[1] && rowPtr[ ( x - maskExt[0] ) * inc0 ] )
+          {
+          x++;
+          }
+        internals->Spans.push_back( first );
+        internals->Spans.push_back( x - 1 );
+        internals->SpanSliceCounts[slice] += x - first;
+        }
+      }
+    }
+  internals->SpanRows.push_back( static_cast<vtkIdType>( internals->Spans.size( ) / 2 ) );
+}
+
+//----------------------------------------------------------------------------
+// With a mask, the extent is split along the slices of the spans so that
+// each piece holds the same number of mask voxels.
+int vtkImageConvolution::SplitExtent(int splitExt[6], int startExt[6], 
+                                     int num, int total)
+{
+  vtkImageConvolutionInternals *internals = this->Internals;
+  int axis = internals->SpanAxis;
+  int *spanExt = internals->SpanExtent;
+  if( !internals->HasMask || startExt[2*axis] < spanExt[2*axis] 
+      || startExt[2*axis+1] > spanExt[2*axis+1] )
+    {
+    return( this->Superclass::SplitExtent( splitExt, startExt, num, total ) );
+    }
+
+  vtkIdType numActive = 0;
+  for( int slice = startExt[2*axis]; slice <= startExt[2*axis+1]; slice++ )
+    {
+    numActive += internals->SpanSliceCounts[slice - spanExt[2*axis]];
+    }
+  int numSlices = startExt[2*axis+1] - startExt[2*axis] + 1;
+  total = total < numSlices ? total : numSlices;
+  if( numActive == 0 || total <= 1 )
+    {
+    return( this->Superclass::SplitExtent( splitExt, startExt, num, total ) );
+    }
+
+  // The piece i gets the slices whose first voxel has a rank in
+  // [i * numActive / total, (i+1) * numActive / total[. Each piece has at
+  // least one slice.
+  for( int idx = 0; idx < 6; idx++ )
+    {
+    splitExt[idx] = startExt[idx];
+    }
+  int first = startExt[2*axis], slice = startExt[2*axis];
+  vtkIdType rank = 0;
+  for( int piece = 0; piece <= num; piece++ )
+    {
+    first = slice;
+    vtkIdType end = ( piece + 1 ) * numActive / total;
+    // keep one slice for each of the next pieces
+    int lastAllowed = startExt[2*axis+1] - ( total - 1 - piece );
+    do
+      {
+      rank += internals->SpanSliceCounts[slice - spanExt[2*axis]];
+      slice++;
+      }
+    while( slice <= lastAllowed && ( rank < end || piece == total - 1 ) );
+    }
+  splitExt[2*axis] = first;
+  splitExt[2*axis+1] = slice - 1;
+
+  return( total );
+}
+
+//----------------------------------------------------------------------------
+// Copy the passed point data arrays of in to out on the extent of a slab.
+static void vtkImageConvolutionCopySlabAttributes( vtkImageData *in, vtkImageData *out,
+                                                   int slabExt[6] )
+{
+  vtkPointData *inPD = in->GetPointData( );
+  vtkPointData *outPD = out->GetPointData( );
+  int ijk[3];
+  for( ijk[2] = slabExt[4]; ijk[2] <= slabExt[5]; ijk[2]++ )
+    {
+    for( ijk[1] = slabExt[2]; ijk[1] <= slabExt[3]; ijk[1]++ )
+      {
+      ijk[0] = slabExt[0];
+      vtkIdType inId = in->ComputePointId( ijk );
+      vtkIdType outId = out->ComputePointId( ijk );
+      for( ; ijk[0] <= slabExt[1]; ijk[0]++, inId++, outId++ )
+        {
+        outPD->CopyData( inPD, inId, outId );
+        }
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+// When the update extent does not fit in MemoryLimit, RequestData is called
+// once per slab (CONTINUE_EXECUTING), as in vtkImageDataStreamer: the output
+// is allocated with the first slab and each slab fills its part of it.
+int vtkImageConvolution::RequestData(vtkInformation* request,
+                                     vtkInformationVector** inputVector,
+                                     vtkInformationVector* outputVector)
+{
+  vtkInformation* inInfo = inputVector[0]->GetInformationObject(0);
+  vtkInformation* kernelInfo = inputVector[1]->GetInformationObject(0);
+  vtkInformation* outInfo = outputVector->GetInformationObject(0);
+  vtkImageData *inImage = vtkImageData::SafeDownCast( inInfo->Get(vtkDataObject::DATA_OBJECT()));
+  vtkImageData *kernelImage = vtkImageData::SafeDownCast( kernelInfo->Get(vtkDataObject::DATA_OBJECT()));
+  vtkImageData *outImage = vtkImageData::SafeDownCast( outInfo->Get(vtkDataObject::DATA_OBJECT()));
+
+  vtkInformation* maskInfo = inputVector[2]->GetInformationObject(0);
+  vtkImageData *maskImage = maskInfo ? vtkImageData::SafeDownCast( 
+                         maskInfo->Get(vtkDataObject::DATA_OBJECT())) : 0;
+  this->Internals->HasMask = maskImage != 0;
+  if( maskImage )
+    {
+    int *maskExt = maskImage->GetExtent( );
+    for( int axis = 0; axis < 3; axis++ )
+      {
+      if( maskExt[2*axis] > this->SlabExtent[2*axis] 
+          || maskExt[2*axis+1] < this->SlabExtent[2*axis+1] )
+        {
+        vtkErrorMacro(<< "The mask extent does not cover the output extent.");
+        request->Remove(vtkStreamingDemandDrivenPipeline::CONTINUE_EXECUTING());
+        this->CurrentSlab = 0;
+        return( 0 );
+        }
+      }
+    switch (maskImage->GetScalarType())
+      {
+      vtkTemplateMacro(
+        vtkImageConvolutionMaskSpans( maskImage, static_cast<VTK_TT *>(0),
+                                      this->SlabExtent, this->Internals ));
+      default:
+        vtkErrorMacro(<< "Execute: Unknown mask ScalarType");
+        return( 0 );
+      }
+    }
+
+  // The kernel is prepared again only if it or the settings changed: the
+  // same kernel applied to new images skips the decomposition, the packing
+  // and the kernel spectra.
+  if( this->CurrentSlab == 0 )
+    {
+    vtkImageConvolutionKernelKey key;
+    key.KernelTime = kernelImage->GetMTime( );
+    key.InNumComps = inImage->GetNumberOfScalarComponents( );
+    key.InScalarType = inImage->GetScalarType( );
+    key.HasMask = this->Internals->HasMask;
+    key.SeparableKernel = this->SeparableKernel;
+    key.MaximumSeparableRank = this->MaximumSeparableRank;
+    key.SeparabilityTolerance = this->SeparabilityTolerance;
+    key.FFTKernelSizeThreshold = this->FFTKernelSizeThreshold;
+    key.BoundaryCondition = this->BoundaryCondition;
+    key.FixedPoint = this->FixedPoint;
+    key.FixedPointInputBits = this->FixedPointInputBits;
+    if( !this->Internals->Prepared 
+        || !vtkImageConvolutionSameKey( key, this->Internals->Key ) )
+      {
+      this->PrepareKernel( kernelImage, key.InNumComps );
+      vtkImageConvolutionGatherDirectTaps( kernelImage, this->Internals );
+      if( this->FixedPoint )
+        {
+        vtkImageConvolutionQuantizeDirectTaps( kernelImage, this->Internals,
+          vtkImageConvolutionInputBound( key.InScalarType, key.FixedPointInputBits ) );
+        }
+      this->Internals->Spectra.clear( );
+      this->Internals->SpectrumSize[0] = 0;
+      this->Internals->Key = key;
+      this->Internals->Prepared = 1;
+      }
+    else
+      {
+      vtkDebugMacro( << "Reusing the prepared kernel." );
+      }
+    }
+
+  // Inputs above the bound set by FixedPointInputBits would overflow the 32
+  // bits sums
+  if( this->Internals->HasFixedPoint && this->FixedPointInputBits > 0 )
+    {
+    vtkDataArray* inScalars = inImage->GetPointData( )->GetScalars( );
+    for( int c = 0; c < inScalars->GetNumberOfComponents( ); c++ )
+      {
+      double range[2];
+      inScalars->GetRange( range, c );
+      if( range[1] > this->Internals->FixedInputBound )
+        {
+        vtkErrorMacro( << "Input value " << range[1] << " above the " 
+                       << this->Internals->FixedInputBound 
+                       << " allowed by FixedPointInputBits." );
+        request->Remove(vtkStreamingDemandDrivenPipeline::CONTINUE_EXECUTING());
+        this->CurrentSlab = 0;
+        return( 0 );
+        }
+      }
+    }
+
+  // Direct and separable components are computed by the threads, then the
+  // FFT components are written in the allocated output.
+  if( this->NumberOfSlabs <= 1 )
+    {
+    if( !this->Superclass::RequestData( request, inputVector, outputVector ) )
+      {
+      return( 0 );
+      }
+    }
+  else
+    {
+    if( this->CurrentSlab == 0 )
+      {
+      int updateExt[6];
+      outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), updateExt);
+      outImage->SetExtent( updateExt );
+      outImage->AllocateScalars( outInfo );
+
+      // The other arrays of the input point data are passed as by the
+      // superclass. The input only covers the current slab, so the arrays
+      // are allocated here and each slab copies its part of them.
+      vtkPointData *outPD = outImage->GetPointData( );
+      outPD->CopyAllOn( );
+      outPD->SetCopyScalars( 0 );
+      outPD->CopyAllocate( inImage->GetPointData( ), outImage->GetNumberOfPoints( ) );
+      }
+    if( inImage->GetPointData( )->GetNumberOfArrays( ) > 1 )
+      {
+      vtkImageConvolutionCopySlabAttributes( inImage, outImage, this->SlabExtent );
+      }
+    vtkDebugMacro( << "Slab " << this->CurrentSlab + 1 << " of " 
+                   << this->NumberOfSlabs );
+
+    vtkImageData **inputs[2];
+    vtkImageData *inputImages[2];
+    inputImages[0] = inImage;
+    inputImages[1] = kernelImage;
+    inputs[0] = inputImages;
+    inputs[1] = inputImages + 1;
+
+    this->ThreadedRequestExtent( request, inputVector, outputVector, inputs,
+                                 &outImage, this->SlabExtent );
+    }
+
+  if( this->Internals->HasFFT )
+    {
+    int wholeExt[6];
+    inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), wholeExt);
+    this->ExecuteFFT( inImage, kernelImage, outImage, this->SlabExtent, wholeExt );
+    }
+
+  this->CurrentSlab++;
+  if( this->CurrentSlab < this->NumberOfSlabs && !this->AbortExecute )
+    {
+    request->Set(vtkStreamingDemandDrivenPipeline::CONTINUE_EXECUTING(), 1);
+    }
+  else
+    {
+    request->Remove(vtkStreamingDemandDrivenPipeline::CONTINUE_EXECUTING());
+    this->CurrentSlab = 0;
+    }
+
+  return( 1 );
+}
+
+//----------------------------------------------------------------------------
+// Store an accumulated (double) result in the output scalar type, after
+// multiplication by the output scale. Integer outputs are rounded and
+// clamped to their range.
+static inline void vtkImageConvolutionStore( double value, double scale,
+                                             double *outPtr )
+{
+  *outPtr = value * scale;
+}
+
+static inline void vtkImageConvolutionStore( double value, double scale,
+                                             float *outPtr )
+{
+  *outPtr = static_cast<float>( value * scale );
+}
+
+static inline void vtkImageConvolutionStore( double value, double scale,
+                                             short *outPtr )
+{
+  value = floor( value * scale + 0.5 );
+  value = value < VTK_SHORT_MIN ? VTK_SHORT_MIN : value;
+  value = value > VTK_SHORT_MAX ? VTK_SHORT_MAX : value;
+  *outPtr = static_cast<short>( value );
+}
+
+//----------------------------------------------------------------------------
+// Smallest integer larger or equal to n that factorizes in 2, 3 and 5, for
+// which the mixed radix FFT of vtkImageFourierFilter is efficient.
+static int vtkImageConvolutionFFTSize( int n )
+{
+  for( ;; n++ )
+    {
+    int m = n;
+    while( m % 2 == 0 ) m /= 2;
+    while( m % 3 == 0 ) m /= 3;
+    while( m % 5 == 0 ) m /= 5;
+    if( m == 1 )
+      {
+      return( n );
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+// Copy the domain ext of the input in the zero padded FFT buffer.
+template <class T>
+void vtkImageConvolutionFFTCopyInput( vtkImageData *inData, T *, int ext[6],
+                                      double *padded, int padSize[3] )
+{
+  vtkIdType inInc0, inInc1, inInc2;
+  inData->GetIncrements( inInc0, inInc1, inInc2 );
+  T *inPtr2 = static_cast<T*>( inData->GetScalarPointer( ext[0], ext[2], ext[4] ) );
+  for( int z = ext[4]; z <= ext[5]; z++, inPtr2 += inInc2 )
+    {
+    T *inPtr1 = inPtr2;
+    for( int y = ext[2]; y <= ext[3]; y++, inPtr1 += inInc1 )
+      {
+      T *inPtr0 = inPtr1;
+      double *padPtr = padded + ( static_cast<vtkIdType>( z - ext[4] ) * padSize[1] 
+                                  + ( y - ext[2] ) ) * padSize[0];
+      for( int x = ext[0]; x <= ext[1]; x++, inPtr0 += inInc0 )
+        {
+        *padPtr++ = static_cast<double>( *inPtr0 );
+        }
+      }
+    }
 }
 
 //----------------------------------------------------------------------------
-void vtkImageConvolution::PrintSelf(ostream& os, vtkIndent indent)
+// Write the real part of the circular correlation in the component comp of
+// the output. The output voxel x reads the correlation at x - origin modulo
+// the padded size.
+template <class OT>
+void vtkImageConvolutionFFTStore( const double *correlation, int padSize[3],
+                                  int origin[3], double scale,
+                                  vtkImageData *outData, OT *outPtr,
+                                  int outExt[6], int comp )
 {
-  this->Superclass::PrintSelf(os, indent);
+  vtkIdType outInc0, outInc1, outInc2;
+  outData->GetIncrements( outInc0, outInc1, outInc2 );
+  for( int z = outExt[4]; z <= outExt[5]; z++ )
+    {
+    int pz = ( z - origin[2] + padSize[2] ) % padSize[2];
+    for( int y = outExt[2]; y <= outExt[3]; y++ )
+      {
+      int py = ( y - origin[1] + padSize[1] ) % padSize[1];
+      OT *outRow = outPtr + comp + ( z - outExt[4] ) * outInc2 
+                                 + ( y - outExt[2] ) * outInc1;
+      const double *corrRow = correlation 
+                + 2 * ( static_cast<vtkIdType>( pz ) * padSize[1] + py ) * padSize[0];
+      for( int x = outExt[0]; x <= outExt[1]; x++ )
+        {
+        int px = ( x - origin[0] + padSize[0] ) % padSize[0];
+        vtkImageConvolutionStore( corrRow[2 * px], scale, 
+                                  outRow + ( x - outExt[0] ) * outInc0 );
+        }
+      }
+    }
 }
 
 //----------------------------------------------------------------------------
-// Specify a source object at a specified table location.
-void vtkImageConvolution::SetKernelConnection(int id, vtkAlgorithmOutput* algOutput)
+// Correlate the input with the FFT kernel components in the frequency domain:
+//   out = RFFT( FFT( image ) * conj( FFT( kernel ) ) )
+// Both the available input domain and the kernel are zero padded to a size
+// larger than their sum, so that the circular correlation does not wrap.
+// The image spectrum is computed once and shared by all the components.
+void vtkImageConvolution::ExecuteFFT( vtkImageData *inData, 
+                                      vtkImageData *kernelData,
+                                      vtkImageData *outData, 
+                                      int outExt[6], int wholeExt[6] )
 {
-  if (id < 0)
+  // Domain of the input that is both available and inside the whole extent.
+  // Outside the whole extent the image is zero, as in the direct loop.
+  int domain[6], *inExt = inData->GetExtent( );
+  int *kernelSize = kernelData->GetDimensions( );
+  int kernelMiddle[3], padSize[3];
+  for( int axis = 0; axis < 3; axis++ )
     {
-    vtkErrorMacro("Bad index " << id << " for source.");
-    return;
+    domain[2*axis] = inExt[2*axis] > wholeExt[2*axis] ? inExt[2*axis] : wholeExt[2*axis];
+    domain[2*axis+1] = inExt[2*axis+1] < wholeExt[2*axis+1] ? inExt[2*axis+1] : wholeExt[2*axis+1];
+    kernelMiddle[axis] = kernelSize[axis] / 2;
+    padSize[axis] = vtkImageConvolutionFFTSize( domain[2*axis+1] - domain[2*axis] 
+                                                + kernelSize[axis] );
     }
+  int dimensionality = padSize[2] > 1 ? 3 : 2;
+  vtkIdType padNumPoints = static_cast<vtkIdType>( padSize[0] ) * padSize[1] * padSize[2];
 
-  int numConnections = this->GetNumberOfInputConnections(1);
-  if (id < numConnections)
+  vtkImageData *padded = vtkImageData::New( );
+  padded->SetExtent( 0, padSize[0] - 1, 0, padSize[1] - 1, 0, padSize[2] - 1 );
+  padded->AllocateScalars( VTK_DOUBLE, 1 );
+  double *padPtr = static_cast<double*>( padded->GetScalarPointer( ) );
+  for( vtkIdType idx = 0; idx < padNumPoints; idx++ )
     {
-    this->SetNthInputConnection(1, id, algOutput);
+    padPtr[idx] = 0;
     }
-  else if (id == numConnections && algOutput)
+
+  switch (inData->GetScalarType())
     {
-    this->AddInputConnection(1, algOutput);
+    vtkTemplateMacro(
+      vtkImageConvolutionFFTCopyInput( inData, static_cast<VTK_TT *>(0), domain,
+                                       padPtr, padSize ));
+    default:
+      vtkErrorMacro(<< "Execute: Unknown ScalarType");
+      padded->Delete( );
+      return;
     }
-  else if (algOutput)
+
+  // Image spectrum
+  vtkImageFFT *fft = vtkImageFFT::New( );
+  fft->SetDimensionality( dimensionality );
+  fft->SetInputData( padded );
+  fft->Update( );
+  vtkImageData *imageSpectrum = vtkImageData::New( );
+  imageSpectrum->ShallowCopy( fft->GetOutput( ) );
+  double *imagePtr = static_cast<double*>( imageSpectrum->GetScalarPointer( ) );
+
+  vtkImageData *product = vtkImageData::New( );
+  product->SetExtent( 0, padSize[0] - 1, 0, padSize[1] - 1, 0, padSize[2] - 1 );
+  product->AllocateScalars( VTK_DOUBLE, 2 );
+  double *productPtr = static_cast<double*>( product->GetScalarPointer( ) );
+
+  vtkImageRFFT *rfft = vtkImageRFFT::New( );
+  rfft->SetDimensionality( dimensionality );
+  rfft->SetInputData( product );
+
+  int krnlNumComps = kernelData->GetNumberOfScalarComponents( );
+  double *kernelPtr = static_cast<double*>( kernelData->GetScalarPointer( ) );
+  void *outPtr = outData->GetScalarPointerForExtent( outExt );
+  int origin[3];
+  for( int axis = 0; axis < 3; axis++ )
     {
-    vtkWarningMacro("The source id provided is larger than the maximum "
-                    "source id, using " << numConnections << " instead.");
-    this->AddInputConnection(1, algOutput);
+    origin[axis] = domain[2*axis] + kernelMiddle[axis];
+    }
+
+  // The kernel spectra are kept for the next executions with the same padded
+  // size.
+  vtkImageConvolutionInternals *internals = this->Internals;
+  if( internals->SpectrumSize[0] != padSize[0] 
+      || internals->SpectrumSize[1] != padSize[1]
+      || internals->SpectrumSize[2] != padSize[2] )
+    {
+    internals->Spectra.assign( krnlNumComps, std::vector<double>( ) );
+    for( int axis = 0; axis < 3; axis++ )
+      {
+      internals->SpectrumSize[axis] = padSize[axis];
+      }
+    }
+
+  for( int comp = 0; comp < krnlNumComps && !this->AbortExecute; comp++ )
+    {
+    if( internals->Path[comp] != VTK_CONVOLUTION_FFT_PATH )
+      continue;
+
+    // Kernel spectrum
+    std::vector<double>& spectrum = internals->Spectra[comp];
+    if( spectrum.empty( ) )
+      {
+      for( vtkIdType idx = 0; idx < padNumPoints; idx++ )
+        {
+        padPtr[idx] = 0;
+        }
+      vtkIdType kernelIdx = comp;
+      for( int k = 0; k < kernelSize[2]; k++ )
+        for( int j = 0; j < kernelSize[1]; j++ )
+          for( int i = 0; i < kernelSize[0]; i++, kernelIdx += krnlNumComps )
+            padPtr[ ( static_cast<vtkIdType>( k ) * padSize[1] + j ) * padSize[0] + i ] 
+                                                            = kernelPtr[kernelIdx];
+      padded->Modified( );
+      fft->Update( );
+      double *fftPtr = static_cast<double*>( fft->GetOutput( )->GetScalarPointer( ) );
+      spectrum.assign( fftPtr, fftPtr + 2 * padNumPoints );
+      }
+    const double *kernelSpectrum = &spectrum[0];
+
+    // image * conj( kernel )
+    for( vtkIdType idx = 0; idx < 2 * padNumPoints; idx += 2 )
+      {
+      double re1 = imagePtr[idx], im1 = imagePtr[idx+1];
+      double re2 = kernelSpectrum[idx], im2 = kernelSpectrum[idx+1];
+      productPtr[idx] = re1 * re2 + im1 * im2;
+      productPtr[idx+1] = im1 * re2 - re1 * im2;
+      }
+    product->Modified( );
+    rfft->Update( );
+    double *correlation = static_cast<double*>( rfft->GetOutput( )->GetScalarPointer( ) );
+
+    // The output voxel x reads the correlation at x - domain - kernelMiddle
+    // modulo the padded size (real part only).
+    switch( outData->GetScalarType( ) )
+      {
+      case VTK_DOUBLE:
+        vtkImageConvolutionFFTStore( correlation, padSize, origin, this->OutputScale,
+                    outData, static_cast<double*>( outPtr ), outExt, comp );
+        break;
+      case VTK_FLOAT:
+        vtkImageConvolutionFFTStore( correlation, padSize, origin, this->OutputScale,
+                    outData, static_cast<float*>( outPtr ), outExt, comp );
+        break;
+      case VTK_SHORT:
+        vtkImageConvolutionFFTStore( correlation, padSize, origin, this->OutputScale,
+                    outData, static_cast<short*>( outPtr ), outExt, comp );
+        break;
+      default:
+        vtkErrorMacro(<< "ExecuteFFT: Unsupported output ScalarType");
+        break;
+      }
+    this->UpdateProgress( static_cast<double>( comp + 1 ) / krnlNumComps );
     }
-}
 
+  rfft->Delete( );
+  product->Delete( );
+  imageSpectrum->Delete( );
+  fft->Delete( );
+  padded->Delete( );
+}
 
 //----------------------------------------------------------------------------
-int vtkImageConvolution::RequestUpdateExtent(vtkInformation*,
-                                         vtkInformationVector** inputVector,
-                                         vtkInformationVector* outputVector)
+// Convolve the separable kernel components with successive 1D passes along
+// i, j then k. For each slice k of the input needed by the output extent, the
+// i and j passes are computed once and stored in a ring buffer of K2 slices,
+// from which the k pass builds the output slices.
+// Rows and slices are indexed as if the image was padded according to the
+// boundary condition: a padded row or slice holds the passes of the input
+// row or slice it maps to. With the zero boundary, the padded rows and slices
+// are simply skipped.
+template <class T, class OT>
+void vtkImageConvolutionSeparableExecute(vtkImageConvolution *self,
+                             vtkImageConvolutionInternals *internals,
+                             vtkImageData *inData, T *,
+                             vtkImageData *kernelData,
+                             vtkImageData *outData, OT *outPtr,
+                             int outExt[6], int id,
+                             vtkInformation *inInfo)
 {
-  // Get input and output pipeline information.
-  vtkInformation* outInfo = outputVector->GetInformationObject(0);
-  vtkInformation* inInfo = inputVector[0]->GetInformationObject(0);
-  vtkInformation* kernelInfo = inputVector[1]->GetInformationObject(0);
+  int inImageExt[6], *inDataExt = inData->GetExtent( );
+  inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), inImageExt);
+  int boundary = self->GetBoundaryCondition( );
 
-  // Get the input whole extent.
-  int wExtent[6];
-  kernelInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), wExtent);
-  kernelInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), wExtent, 6);
-  
-  return( 1 );
+  vtkIdType inInc0, inInc1, inInc2;
+  vtkIdType outInc0, outInc1, outInc2;
+  inData->GetIncrements(inInc0, inInc1, inInc2);
+  outData->GetIncrements(outInc0, outInc1, outInc2);
+  T *inBase = static_cast<T *>( 
+    inData->GetScalarPointer( inDataExt[0], inDataExt[2], inDataExt[4] ) );
+
+  int *kernelSize = kernelData->GetDimensions( );
+  int kernelMiddle[3];
+  for( int axis = 0; axis < 3; axis++ )
+    kernelMiddle[axis] = kernelSize[axis] / 2;
+
+  // Output rows and slices, and the input rows and slices they depend on
+  int size0 = outExt[1] - outExt[0] + 1;
+  int size1 = outExt[3] - outExt[2] + 1;
+  int rowMin = outExt[2] - kernelMiddle[1];
+  int rowMax = outExt[3] + kernelSize[1] - 1 - kernelMiddle[1];
+  int sliceMin = outExt[4] - kernelMiddle[2];
+  int sliceMax = outExt[5] + kernelSize[2] - 1 - kernelMiddle[2];
+  if( boundary == VTK_CONVOLUTION_BOUNDARY_ZERO )
+    {
+    rowMin = rowMin < inImageExt[2] ? inImageExt[2] : rowMin;
+    rowMax = rowMax > inImageExt[3] ? inImageExt[3] : rowMax;
+    sliceMin = sliceMin < inImageExt[4] ? inImageExt[4] : sliceMin;
+    sliceMax = sliceMax > inImageExt[5] ? inImageExt[5] : sliceMax;
+    }
+  int numRows = rowMax - rowMin + 1;
+  vtkIdType sliceSize = static_cast<vtkIdType>(size0) * size1;
+
+  int numComps = outData->GetNumberOfScalarComponents();
+  double scale = self->GetOutputScale( );
+  std::vector<double> passI( static_cast<vtkIdType>(size0) * ( numRows > 0 ? numRows : 0 ) );
+  std::vector<double> accumulator( sliceSize );
+  std::vector<double> ring;
+
+  unsigned long count = 0;
+  unsigned long target = static_cast<unsigned long>(
+                     numComps * ( outExt[5] - outExt[4] + 1 ) / 50.0 ) + 1;
+
+  for( int comp = 0; comp < numComps; comp++ )
+    {
+    if( internals->Path[comp] != VTK_CONVOLUTION_SEPARABLE_PATH )
+      continue;
+
+    std::vector<vtkImageConvolutionSeparableTerm>& terms = internals->Terms[comp];
+    int numTerms = static_cast<int>( terms.size( ) );
+    vtkIdType ringSize = sliceSize * kernelSize[2];
+    ring.resize( ringSize * numTerms );
+
+    // next input slice whose i and j passes have to be computed
+    int nextSlice = sliceMin;
+
+    for( int z = outExt[4]; z <= outExt[5] && !self->AbortExecute; z++ )
+      {
+      if (!id)
+        {
+        if (!(count%target))
+          {
+          self->UpdateProgress(count/(50.0*target));
+          }
+        count++;
+        }
+
+      // Input slices contributing to the output slice z
+      int kMin = sliceMin - z + kernelMiddle[2];
+      int kMax = sliceMax - z + kernelMiddle[2];
+      kMin = kMin < 0 ? 0 : kMin;
+      kMax = kMax > kernelSize[2] - 1 ? kernelSize[2] - 1 : kMax;
+
+      // Fill the ring buffer with the i and j passes of the new slices.
+      for( ; nextSlice <= z + kMax - kernelMiddle[2]; nextSlice++ )
+        {
+        vtkIdType slot = ( ( nextSlice - sliceMin ) % kernelSize[2] ) * sliceSize;
+        for( int t = 0; t < numTerms; t++ )
+          {
+          const double *f0 = &terms[t].Factor[0][0];
+          const double *f1 = &terms[t].Factor[1][0];
+          double *ijPass = &ring[ t * ringSize + slot ];
+
+          // pass along i
+          int inSlice;
+          vtkImageConvolutionBoundaryIndex( nextSlice, inImageExt[4], inImageExt[5],
+                                            boundary, inSlice );
+          for( int row = rowMin; row <= rowMax; row++ )
+            {
+            int inRowIdx;
+            vtkImageConvolutionBoundaryIndex( row, inImageExt[2], inImageExt[3],
+                                              boundary, inRowIdx );
+            T *inRow = inBase + ( inRowIdx - inDataExt[2] ) * inInc1 
+                              + ( inSlice - inDataExt[4] ) * inInc2;
+            double *passRow = &passI[ ( row - rowMin ) * size0 ];
+            for( int x = outExt[0]; x <= outExt[1]; x++ )
+              {
+              int iMin = inImageExt[0] - x + kernelMiddle[0];
+              int iMax = inImageExt[1] - x + kernelMiddle[0];
+              double sum = 0;
+              if( iMin <= 0 && iMax >= kernelSize[0] - 1 )
+                {
+                T *inPtr0 = inRow + ( x - kernelMiddle[0] - inDataExt[0] ) * inInc0;
+                for( int i = 0; i < kernelSize[0]; i++ )
+                  sum += f0[i] * inPtr0[i * inInc0];
+                }
+              else
+                {
+                for( int i = 0; i < kernelSize[0]; i++ )
+                  {
+                  int inIdx0;
+                  if( vtkImageConvolutionBoundaryIndex( x + i - kernelMiddle[0],
+                                 inImageExt[0], inImageExt[1], boundary, inIdx0 ) )
+                    sum += f0[i] * inRow[ ( inIdx0 - inDataExt[0] ) * inInc0 ];
+                  }
+                }
+              passRow[x - outExt[0]] = sum;
+              }
+            }
+
+          // pass along j
+          for( int y = outExt[2]; y <= outExt[3]; y++ )
+            {
+            int jMin = rowMin - y + kernelMiddle[1];
+            int jMax = rowMax - y + kernelMiddle[1];
+            jMin = jMin < 0 ? 0 : jMin;
+            jMax = jMax > kernelSize[1] - 1 ? kernelSize[1] - 1 : jMax;
+            double *ijRow = ijPass + ( y - outExt[2] ) * size0;
+            for( int x = 0; x < size0; x++ )
+              ijRow[x] = 0;
+            for( int j = jMin; j <= jMax; j++ )
+              {
+              const double *passRow = 
+                      &passI[ ( y + j - kernelMiddle[1] - rowMin ) * size0 ];
+              double weight = f1[j];
+              for( int x = 0; x < size0; x++ )
+                ijRow[x] += weight * passRow[x];
+              }
+            }
+          }
+        }
+
+      // pass along k
+      for( vtkIdType idx = 0; idx < sliceSize; idx++ )
+        accumulator[idx] = 0;
+      for( int t = 0; t < numTerms; t++ )
+        {
+        const double *f2 = &terms[t].Factor[2][0];
+        for( int k = kMin; k <= kMax; k++ )
+          {
+          int slice = z + k - kernelMiddle[2];
+          const double *ijPass = &ring[ t * ringSize 
+                        + ( ( slice - sliceMin ) % kernelSize[2] ) * sliceSize ];
+          double weight = f2[k];
+          for( vtkIdType idx = 0; idx < sliceSize; idx++ )
+            accumulator[idx] += weight * ijPass[idx];
+          }
+        }
+
+      OT *outSlice = outPtr + comp + ( z - outExt[4] ) * outInc2;
+      for( int y = 0; y < size1; y++ )
+        {
+        OT *outRow = outSlice + y * outInc1;
+        const double *accRow = &accumulator[ y * size0 ];
+        for( int x = 0; x < size0; x++ )
+          vtkImageConvolutionStore( accRow[x], scale, outRow + x * outInc0 );
+        }
+      }
+    }
 }
 
 //----------------------------------------------------------------------------
-int vtkImageConvolution::RequestInformation(vtkInformation*,
-                                         vtkInformationVector** inputVector,
-                                         vtkInformationVector* outputVector)
+// Blocked product on a run of interior voxels of an output row: the
+// neighbourhoods of a tile of voxels are gathered (im2col) in panels of 4
+// voxels, then each panel is multiplied by each 4 component panel of the
+// packed kernel with a 4x4 register block. hoodPtr points to the first
+// neighbour of the first voxel, offsets gives the position of each tap
+// relative to it.
+template <class T, class OT>
+void vtkImageConvolutionBlockedRow( vtkImageConvolutionInternals *internals,
+                                    const T *hoodPtr, vtkIdType inInc0,
+                                    const vtkIdType *offsets, vtkIdType numTaps,
+                                    int numVoxels, std::vector<double>& tile,
+                                    OT *outPtr, vtkIdType outInc0, double scale )
 {
-  // Get input and output pipeline information.
-  vtkInformation* outInfo = outputVector->GetInformationObject(0);
-  vtkInformation* inInfo = inputVector[0]->GetInformationObject(0);
-  vtkInformation* kernelInfo = inputVector[1]->GetInformationObject(0);
+  int numDirect = static_cast<int>( internals->DirectComponents.size( ) );
+  int numPanels = ( numDirect + 3 ) / 4;
+  const int *directComps = &internals->DirectComponents[0];
 
-  vtkImageData *inImage = vtkImageData::SafeDownCast( inInfo->Get(vtkDataObject::DATA_OBJECT()));
-  int inNumComps = inImage->GetNumberOfScalarComponents(inInfo);
+  // Number of voxels of a tile, multiple of 4
+  int tileSize = static_cast<int>( VTK_CONVOLUTION_TILE_MEMORY 
+                                   / ( numTaps * 4 * sizeof( double ) ) ) * 4;
+  tileSize = tileSize < 4 ? 4 : tileSize;
+  tile.resize( tileSize * numTaps );
 
-  vtkImageData *kernelImage = vtkImageData::SafeDownCast( kernelInfo->Get(vtkDataObject::DATA_OBJECT()));
-  int krnlNumComps = kernelImage->GetNumberOfScalarComponents(kernelInfo);
+  for( int first = 0; first < numVoxels; first += tileSize )
+    {
+    int count = numVoxels - first < tileSize ? numVoxels - first : tileSize;
 
-  // Set the number of point data components to the number of
-  // components in the convolution kernel times the number of 
-  // input components.
-  vtkDataObject::SetPointDataActiveScalarInfo(outInfo, 
-                                              VTK_DOUBLE,
-                                              krnlNumComps * inNumComps);
+    // Gather the neighbourhoods, a missing voxel of the last panel is zero
+    for( int v = 0; v < ( count + 3 ) / 4 * 4; v++ )
+      {
+      double *column = &tile[ ( v / 4 ) * numTaps * 4 + v % 4 ];
+      if( v < count )
+        {
+        const T *voxelHood = hoodPtr + ( first + v ) * inInc0;
+        for( vtkIdType t = 0; t < numTaps; t++ )
+          {
+          column[t * 4] = static_cast<double>( voxelHood[offsets[t]] );
+          }
+        }
+      else
+        {
+        for( vtkIdType t = 0; t < numTaps; t++ )
+          {
+          column[t * 4] = 0;
+          }
+        }
+      }
 
-  return 1;
+    for( int v = 0; v < count; v += 4 )
+      {
+      const double *a = &tile[ ( v / 4 ) * numTaps * 4 ];
+      for( int panel = 0; panel < numPanels; panel++ )
+        {
+        const double *b = &internals->PackedTaps[ panel * numTaps * 4 ];
+        double c00 = 0, c01 = 0, c02 = 0, c03 = 0;
+        double c10 = 0, c11 = 0, c12 = 0, c13 = 0;
+        double c20 = 0, c21 = 0, c22 = 0, c23 = 0;
+        double c30 = 0, c31 = 0, c32 = 0, c33 = 0;
+        for( vtkIdType t = 0; t < numTaps; t++, a += 4, b += 4 )
+          {
+          double a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+          double b0 = b[0], b1 = b[1], b2 = b[2], b3 = b[3];
+          c00 += a0 * b0; c01 += a0 * b1; c02 += a0 * b2; c03 += a0 * b3;
+          c10 += a1 * b0; c11 += a1 * b1; c12 += a1 * b2; c13 += a1 * b3;
+          c20 += a2 * b0; c21 += a2 * b1; c22 += a2 * b2; c23 += a2 * b3;
+          c30 += a3 * b0; c31 += a3 * b1; c32 += a3 * b2; c33 += a3 * b3;
+          }
+        a -= numTaps * 4;
+
+        double c[4][4] = { { c00, c01, c02, c03 }, { c10, c11, c12, c13 },
+                           { c20, c21, c22, c23 }, { c30, c31, c32, c33 } };
+        for( int i = 0; i < 4 && v + i < count; i++ )
+          {
+          OT *voxelOut = outPtr + ( first + v + i ) * outInc0;
+          for( int j = 0; j < 4 && panel * 4 + j < numDirect; j++ )
+            {
+            vtkImageConvolutionStore( c[i][j], scale, 
+                                      voxelOut + directComps[panel * 4 + j] );
+            }
+          }
+        }
+      }
+    }
 }
 
 //----------------------------------------------------------------------------
-// This templated function executes the filter on any region,
-// whether it needs boundary checking or not.
-// If the filter needs to be faster, the function could be duplicated
-// for strictly center (no boundary) processing.
-template <class T>
+// Dot product of n 16 bits integers, summed in 32 bits: the multiply-add
+// pattern of the 16 bits SIMD instructions (pmaddwd), which the compiler uses
+// to vectorize this loop. The fixed point scale keeps the sum in 32 bits.
+static inline vtkTypeInt32 vtkImageConvolutionFixedDot( const vtkTypeInt16 *values,
+                                                        const vtkTypeInt16 *taps,
+                                                        vtkIdType n )
+{
+  vtkTypeInt32 sum = 0;
+  for( vtkIdType i = 0; i < n; i++ )
+    {
+    sum += static_cast<vtkTypeInt32>( values[i] ) * taps[i];
+    }
+  return( sum );
+}
+
+//----------------------------------------------------------------------------
+// This templated function executes the filter on any region. The output
+// extent is split in an interior region, where the whole neighbourhood lies
+// inside the whole extent and the kernel loop has no test, and the border,
+// where each neighbour index goes through the boundary condition.
+// Each neighbour is read once and multiplied by the taps of all the direct
+// kernel components, accumulated side by side in sums.
+// The output component c is the convolution of the input component
+// c / krnlNumComps with the kernel component c % krnlNumComps.
+template <class T, class OT>
 void vtkImageConvolutionExecute(vtkImageConvolution *self,
-                             vtkImageData *inData, T *inPtr, 
-                             vtkImageData *kernelData, double *kernelPtr, 
-                             vtkImageData *outData, double *outPtr,
+                             vtkImageConvolutionInternals *internals,
+                             vtkImageData *inData, T *, 
+                             vtkImageData *kernelData,
+                             vtkImageData *outData, OT *outPtr,
                              int outExt[6], int id,
                              vtkInformation *inInfo)
 {
@@ -146,21 +1742,64 @@ void vtkImageConvolutionExecute(vtkImageConvolution *self,
   int outIdx0, outIdx1, outIdx2;
   vtkIdType inInc0, inInc1, inInc2;
   vtkIdType outInc0, outInc1, outInc2;
-  T *inPtr0, *inPtr1, *inPtr2;
-  double *outPtr0, *outPtr1, *outPtr2;
-  int numComps, outIdxC;
+  OT *outPtr0, *outPtr1, *outPtr2;
+  int krnlNumComps, inNumComps, inIdxC;
 
   // For looping through hood pixels
-  int hoodMin0, hoodMax0, hoodMin1, hoodMax1, hoodMin2, hoodMax2;
   int hoodIdx0, hoodIdx1, hoodIdx2;
+  int inIdx0, inIdx1, inIdx2;
   T *hoodPtr0, *hoodPtr1, *hoodPtr2;
 
   // For looping through the kernel, and compute the kernel result
-  int kernelIdx;
-  double sum;
+  const double *kernel;
+  int d, numDirect = static_cast<int>( internals->DirectComponents.size( ) );
+  if( numDirect == 0 )
+    {
+    return;
+    }
+  const int *directComps = &internals->DirectComponents[0];
+  const double *taps = &internals->DirectTaps[0];
+  std::vector<double> sumBuffer( numDirect );
+  double *sums = &sumBuffer[0];
+
+  // Spans of the mask, if any: the spans of the row r (relative to spanExt)
+  // are spans[2*spanRows[r]] to spans[2*spanRows[r+1]]
+  int wholeRow[2] = { outExt[0], outExt[1] };
+  const vtkIdType *spanRows = 0;
+  const int *spans = 0;
+  const int *spanExt = internals->SpanExtent;
+  if (internals->HasMask)
+    {
+    spanRows = &internals->SpanRows[0];
+    spans = internals->Spans.empty( ) ? 0 : &internals->Spans[0];
+    }
+
+  // Blocked product of the interior runs
+  int blocked = self->GetBlockedKernelProduct( ) && numDirect > 1;
+  std::vector<vtkIdType> offsets;
+  std::vector<double> tile;
 
-  // The extent of the whole input image
-  int inImageExt[6];
+  // Integer accumulation of the interior voxels, unless the blocked product
+  // is faster: the neighbourhood is converted once to 16 bits in fixedHood
+  int fixedPoint = internals->HasFixedPoint
+    && ( !blocked || numDirect <= VTK_CONVOLUTION_FIXED_POINT_COMPONENTS );
+  blocked = blocked && !fixedPoint;
+  int fixedOffset = internals->FixedInputOffset;
+  vtkIdType fixedBlock = internals->FixedBlockLength;
+  vtkIdType fixedRowLength = internals->FixedRowLength;
+  vtkIdType numFixed = 0;
+  const vtkTypeInt16 *fixedTaps = fixedPoint ? &internals->FixedTaps[0] : 0;
+  const vtkTypeInt16 *fixedKernel;
+  std::vector<vtkTypeInt64> fixedSumBuffer( numDirect );
+  vtkTypeInt64 *fixedSums = &fixedSumBuffer[0];
+  std::vector<vtkTypeInt16> fixedHoodBuffer;
+  vtkTypeInt16 *fixedHood = 0, *fixedValue;
+
+  // The extent of the whole input image, of the input data and of the
+  // interior region
+  int inImageExt[6], *inDataExt, interiorExt[6];
+  int boundary = self->GetBoundaryCondition( );
+  double scale = self->GetOutputScale( );
 
   // to compute the range
   unsigned long count = 0;
@@ -169,48 +1808,61 @@ void vtkImageConvolutionExecute(vtkImageConvolution *self,
   // Get information to march through data
   inData->GetIncrements(inInc0, inInc1, inInc2);
   inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), inImageExt);
+  inDataExt = inData->GetExtent( );
   outData->GetIncrements(outInc0, outInc1, outInc2); 
   outMin0 = outExt[0];   outMax0 = outExt[1];
   outMin1 = outExt[2];   outMax1 = outExt[3];
   outMin2 = outExt[4];   outMax2 = outExt[5];
-  numComps = outData->GetNumberOfScalarComponents();
+  krnlNumComps = kernelData->GetNumberOfScalarComponents();
+  inNumComps = inData->GetNumberOfScalarComponents();
    
   // Get ivars of this object (easier than making friends)
   kernelSize = kernelData->GetDimensions( );
+  vtkIdType rowStep = static_cast<vtkIdType>(kernelSize[0]) * numDirect;
+  vtkIdType numTaps = static_cast<vtkIdType>(kernelSize[0]) * kernelSize[1] * kernelSize[2];
+  if( fixedPoint )
+    {
+    // The padding of the rows stays zero
+    numFixed = fixedRowLength * kernelSize[1] * kernelSize[2];
+    fixedHoodBuffer.assign( numFixed, 0 );
+    fixedHood = &fixedHoodBuffer[0];
+    }
+  if( blocked )
+    {
+    offsets.resize( numTaps );
+    for( vtkIdType t = 0; t < numTaps; t++ )
+      {
+      offsets[t] = ( t % kernelSize[0] ) * inInc0
+                 + ( ( t / kernelSize[0] ) % kernelSize[1] ) * inInc1
+                 + ( t / ( kernelSize[0] * kernelSize[1] ) ) * inInc2;
+      }
+    }
 
-  kernelMiddle[0] = kernelSize[0] / 2;
-  kernelMiddle[1] = kernelSize[1] / 2;
-  kernelMiddle[2] = kernelSize[2] / 2;
-
-  hoodMin0 = -kernelMiddle[0];
-  hoodMin1 = -kernelMiddle[1];
-  hoodMin2 = -kernelMiddle[2];
-
-  hoodMax0 = hoodMin0 + kernelSize[0] - 1;
-  hoodMax1 = hoodMin1 + kernelSize[1] - 1;
-  hoodMax2 = hoodMin2 + kernelSize[2] - 1;
-
-  // Get the kernel. 
-  double *kernel = kernelPtr;
+  for( int axis = 0; axis < 3; axis++ )
+    {
+    kernelMiddle[axis] = kernelSize[axis] / 2;
+    interiorExt[2*axis] = inImageExt[2*axis] + kernelMiddle[axis];
+    interiorExt[2*axis+1] = inImageExt[2*axis+1] - kernelSize[axis] + 1 + kernelMiddle[axis];
+    }
 
-  // in and out should be marching through corresponding pixels.
-  inPtr = static_cast<T *>(
-    inData->GetScalarPointer(outMin0, outMin1, outMin2));
+  // Pointer to the first input voxel of the input data
+  T *inBase = static_cast<T *>(
+    inData->GetScalarPointer(inDataExt[0], inDataExt[2], inDataExt[4]));
 
-  target = static_cast<unsigned long>(numComps*(outMax2 - outMin2 + 1)*
+  target = static_cast<unsigned long>(inNumComps*(outMax2 - outMin2 + 1)*
                                       (outMax1 - outMin1 + 1)/50.0);
   target++;
   
-  // loop through components
-  for (outIdxC = 0; outIdxC < numComps; ++outIdxC)
+  // loop through input components
+  for (inIdxC = 0; inIdxC < inNumComps; ++inIdxC)
     {
+    OT *outPtrC = outPtr + inIdxC * krnlNumComps;
+
     // loop through pixels of output
-    outPtr2 = outPtr;
-    inPtr2 = inPtr;
+    outPtr2 = outPtrC;
     for (outIdx2 = outMin2; outIdx2 <= outMax2; ++outIdx2)
       {
       outPtr1 = outPtr2;
-      inPtr1 = inPtr2;
       for (outIdx1 = outMin1; 
            outIdx1 <= outMax1 && !self->AbortExecute; 
            ++outIdx1)
@@ -224,81 +1876,231 @@ void vtkImageConvolutionExecute(vtkImageConvolution *self,
           count++;
           }
 
-        outPtr0 = outPtr1;
-        inPtr0 = inPtr1;
+        int interiorRow = outIdx1 >= interiorExt[2] && outIdx1 <= interiorExt[3]
+                       && outIdx2 >= interiorExt[4] && outIdx2 <= interiorExt[5];
 
-        for (outIdx0 = outMin0; outIdx0 <= outMax0; ++outIdx0)
+        // Voxels of the row to compute: the whole row, or the spans of the
+        // mask (the other voxels are set to zero)
+        const int *span = wholeRow;
+        const int *spanEnd = wholeRow + 2;
+        if (spanRows)
           {
-          // Inner loop : effective convolution
-
-          // Set the sum to zero
-          sum = 0;
-
-          // loop through neighborhood pixels
-          // as sort of a hack to handle boundaries, 
-          // input pointer will be marching through data that does not exist.
-          hoodPtr2 = inPtr0 - kernelMiddle[0] * inInc0 
-                            - kernelMiddle[1] * inInc1 
-                            - kernelMiddle[2] * inInc2;
-
-          // Set the kernel index to the starting position
-          kernelIdx = outIdxC;
+          vtkIdType row = (outIdx1 - spanExt[2]) + 
+            static_cast<vtkIdType>(outIdx2 - spanExt[4]) * (spanExt[3] - spanExt[2] + 1);
+          span = spans + 2 * spanRows[row];
+          spanEnd = spans + 2 * spanRows[row + 1];
+          outPtr0 = outPtr1;
+          for (outIdx0 = outMin0; outIdx0 <= outMax0; ++outIdx0)
+            {
+            for (d = 0; d < krnlNumComps; ++d)
+              {
+              outPtr0[d] = 0;
+              }
+            outPtr0 += outInc0;
+            }
+          }
 
-          for (hoodIdx2 = hoodMin2; hoodIdx2 <= hoodMax2; ++hoodIdx2)
+        for (; span < spanEnd; span += 2)
+          {
+          int spanMin = span[0] > outMin0 ? span[0] : outMin0;
+          int spanMax = span[1] < outMax0 ? span[1] : outMax0;
+          outPtr0 = outPtr1 + (spanMin - outMin0) * outInc0;
+          for (outIdx0 = spanMin; outIdx0 <= spanMax; ++outIdx0)
             {
-            hoodPtr1 = hoodPtr2;
+            if (blocked && interiorRow && outIdx0 >= interiorExt[0] && outIdx0 <= interiorExt[1])
+              {
+              // The whole interior run of the span goes through the blocked product
+              int runEnd = spanMax < interiorExt[1] ? spanMax : interiorExt[1];
+              hoodPtr0 = inBase + inIdxC
+                       + (outIdx0 - kernelMiddle[0] - inDataExt[0]) * inInc0 
+                       + (outIdx1 - kernelMiddle[1] - inDataExt[2]) * inInc1 
+                       + (outIdx2 - kernelMiddle[2] - inDataExt[4]) * inInc2;
+              vtkImageConvolutionBlockedRow( internals, hoodPtr0, inInc0, &offsets[0],
+                                             numTaps, runEnd - outIdx0 + 1, tile,
+                                             outPtr0, outInc0, scale );
+              outPtr0 += (runEnd - outIdx0 + 1) * outInc0;
+              outIdx0 = runEnd;
+              continue;
+              }
 
-            for (hoodIdx1 = hoodMin1; hoodIdx1 <= hoodMax1; ++hoodIdx1)
+            // Inner loop : effective convolution
+            for (d = 0; d < numDirect; ++d)
               {
-              hoodPtr0 = hoodPtr1;
+              sums[d] = 0;
+              }
+            kernel = taps;
 
-              for (hoodIdx0 = hoodMin0; hoodIdx0 <= hoodMax0; ++hoodIdx0)
+            if (fixedPoint && interiorRow && outIdx0 >= interiorExt[0] && outIdx0 <= interiorExt[1])
+              {
+              // Interior in fixed point: 16 bits products, summed in 32 bits
+              // over blocks of kernel rows and in 64 bits over the blocks
+              hoodPtr2 = inBase + inIdxC
+                       + (outIdx0 - kernelMiddle[0] - inDataExt[0]) * inInc0 
+                       + (outIdx1 - kernelMiddle[1] - inDataExt[2]) * inInc1 
+                       + (outIdx2 - kernelMiddle[2] - inDataExt[4]) * inInc2;
+              fixedValue = fixedHood;
+              for (hoodIdx2 = 0; hoodIdx2 < kernelSize[2]; ++hoodIdx2)
                 {
-                // A quick but rather expensive way to handle boundaries
-                // This assumes the boundary values are zero
-                if (outIdx0 + hoodIdx0 >= inImageExt[0] &&
-                    outIdx0 + hoodIdx0 <= inImageExt[1] &&
-                    outIdx1 + hoodIdx1 >= inImageExt[2] &&
-                    outIdx1 + hoodIdx1 <= inImageExt[3] &&
-                    outIdx2 + hoodIdx2 >= inImageExt[4] &&
-                    outIdx2 + hoodIdx2 <= inImageExt[5])
+                hoodPtr1 = hoodPtr2;
+                for (hoodIdx1 = 0; hoodIdx1 < kernelSize[1]; ++hoodIdx1)
                   {
-                  sum += *hoodPtr0 * kernel[kernelIdx];
-
+                  hoodPtr0 = hoodPtr1;
+                  for (hoodIdx0 = 0; hoodIdx0 < kernelSize[0]; ++hoodIdx0)
+                    {
+                    fixedValue[hoodIdx0] = static_cast<vtkTypeInt16>(
+                      static_cast<int>(*hoodPtr0) - fixedOffset);
+                    hoodPtr0 += inInc0;
+                    }
+                  fixedValue += fixedRowLength;
+                  hoodPtr1 += inInc1;
                   }
-                // Take the next position in the kernel
-                kernelIdx += numComps;
+                hoodPtr2 += inInc2;
+                }
 
-                hoodPtr0 += inInc0;
+              for (d = 0; d < numDirect; ++d)
+                {
+                fixedKernel = fixedTaps + d * numFixed;
+                fixedSums[d] = internals->FixedOffsetSums[d];
+                for (vtkIdType first = 0; first < numFixed; first += fixedBlock)
+                  {
+                  vtkIdType length = numFixed - first < fixedBlock ? numFixed - first 
+                                                                   : fixedBlock;
+                  fixedSums[d] += vtkImageConvolutionFixedDot( fixedHood + first, 
+                                                fixedKernel + first, length );
+                  }
+                sums[d] = static_cast<double>(fixedSums[d]) * internals->FixedScales[d];
                 }
+              }
+            else if (interiorRow && outIdx0 >= interiorExt[0] && outIdx0 <= interiorExt[1])
+              {
+              // Interior: the whole neighbourhood is inside the image
+              hoodPtr2 = inBase + inIdxC
+                       + (outIdx0 - kernelMiddle[0] - inDataExt[0]) * inInc0 
+                       + (outIdx1 - kernelMiddle[1] - inDataExt[2]) * inInc1 
+                       + (outIdx2 - kernelMiddle[2] - inDataExt[4]) * inInc2;
 
-              hoodPtr1 += inInc1;
+              for (hoodIdx2 = 0; hoodIdx2 < kernelSize[2]; ++hoodIdx2)
+                {
+                hoodPtr1 = hoodPtr2;
+                for (hoodIdx1 = 0; hoodIdx1 < kernelSize[1]; ++hoodIdx1)
+                  {
+                  hoodPtr0 = hoodPtr1;
+                  for (hoodIdx0 = 0; hoodIdx0 < kernelSize[0]; ++hoodIdx0)
+                    {
+                    double value = *hoodPtr0;
+                    for (d = 0; d < numDirect; ++d)
+                      {
+                      sums[d] += value * kernel[d];
+                      }
+                    kernel += numDirect;
+                    hoodPtr0 += inInc0;
+                    }
+                  hoodPtr1 += inInc1;
+                  }
+                hoodPtr2 += inInc2;
+                }
+              }
+            else
+              {
+              // Border: the neighbour indices go through the boundary condition
+              for (hoodIdx2 = 0; hoodIdx2 < kernelSize[2]; ++hoodIdx2)
+                {
+                if (!vtkImageConvolutionBoundaryIndex(outIdx2 + hoodIdx2 - kernelMiddle[2],
+                                     inImageExt[4], inImageExt[5], boundary, inIdx2))
+                  {
+                  kernel += rowStep * kernelSize[1];
+                  continue;
+                  }
+                hoodPtr2 = inBase + inIdxC + (inIdx2 - inDataExt[4]) * inInc2;
+                for (hoodIdx1 = 0; hoodIdx1 < kernelSize[1]; ++hoodIdx1)
+                  {
+                  if (!vtkImageConvolutionBoundaryIndex(outIdx1 + hoodIdx1 - kernelMiddle[1],
+                                     inImageExt[2], inImageExt[3], boundary, inIdx1))
+                    {
+                    kernel += rowStep;
+                    continue;
+                    }
+                  hoodPtr1 = hoodPtr2 + (inIdx1 - inDataExt[2]) * inInc1;
+                  for (hoodIdx0 = 0; hoodIdx0 < kernelSize[0]; ++hoodIdx0)
+                    {
+                    if (vtkImageConvolutionBoundaryIndex(outIdx0 + hoodIdx0 - kernelMiddle[0],
+                                     inImageExt[0], inImageExt[1], boundary, inIdx0))
+                      {
+                      hoodPtr0 = hoodPtr1 + (inIdx0 - inDataExt[0]) * inInc0;
+                      double value = *hoodPtr0;
+                      for (d = 0; d < numDirect; ++d)
+                        {
+                        sums[d] += value * kernel[d];
+                        }
+                      }
+                    kernel += numDirect;
+                    }
+                  }
+                }
               }
 
-            hoodPtr2 += inInc2;
+            // Set the output pixel components to the correct values
+            for (d = 0; d < numDirect; ++d)
+              {
+              vtkImageConvolutionStore( sums[d], scale, outPtr0 + directComps[d] );
+              }
+            outPtr0 += outInc0;
             }
-
-          // Set the output pixel to the correct value
-          *outPtr0 = sum;
-
-          inPtr0 += inInc0;
-          outPtr0 += outInc0;
           }
 
-        inPtr1 += inInc1;
         outPtr1 += outInc1;
         }
 
-      inPtr2 += inInc2;
       outPtr2 += outInc2;
       }
-    ++outPtr;
+    }
+}
+
+//----------------------------------------------------------------------------
+// Second switch statement: calls the separable and direct paths for the
+// input scalar type, once the output scalar type OT is known.
+template <class OT>
+void vtkImageConvolutionDispatch(vtkImageConvolution *self,
+                                 vtkImageConvolutionInternals *internals,
+                                 vtkImageData *inData, void *inPtr,
+                                 vtkImageData *kernelData,
+                                 vtkImageData *outData, OT *outPtr,
+                                 int outExt[6], int id,
+                                 vtkInformation *inInfo)
+{
+  if (internals->HasSeparable)
+    {
+    switch (inData->GetScalarType())
+      {
+      vtkTemplateMacro(
+        vtkImageConvolutionSeparableExecute(self, internals,
+                              inData, static_cast<VTK_TT *>(inPtr), 
+                              kernelData, outData, outPtr,
+                              outExt, id, inInfo));
+
+      default:
+        vtkErrorWithObjectMacro(self, << "Execute: Unknown ScalarType");
+        return;
+      }
+    }
+ 
+  switch (inData->GetScalarType())
+    {
+    vtkTemplateMacro(
+      vtkImageConvolutionExecute(self, internals,
+	                          inData, static_cast<VTK_TT *>(inPtr), 
+	                          kernelData, outData, outPtr,
+                              outExt, id, inInfo));
+
+    default:
+      vtkErrorWithObjectMacro(self, << "Execute: Unknown ScalarType");
+      return;
     }
 }
 
 //----------------------------------------------------------------------------
 // This method contains the first switch statement that calls the correct
-// templated function for the input and output Data types.
+// templated function for the output data type.
 // It hanldes image boundaries, so the image does not shrink.
 void vtkImageConvolution::ThreadedRequestData(
   vtkInformation *vtkNotUsed(request),
@@ -309,23 +2111,29 @@ void vtkImageConvolution::ThreadedRequestData(
   int outExt[6], int id)
 {
   void *inPtr = inData[0][0]->GetScalarPointerForExtent(outExt);
-  void *kernelPtr = inData[1][0]->GetScalarPointer();  
   void *outPtr = outData[0]->GetScalarPointerForExtent(outExt);
 
   vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
 
- 
-  switch (inData[0][0]->GetScalarType())
+  switch (outData[0]->GetScalarType())
     {
-    vtkTemplateMacro(
-      vtkImageConvolutionExecute(this, 
-	                          inData[0][0], static_cast<VTK_TT *>(inPtr), 
-	                          inData[1][0], static_cast<double *>(kernelPtr), 
-                              outData[0], static_cast<double *>(outPtr),
-                              outExt, id, inInfo));
-
+    case VTK_DOUBLE:
+      vtkImageConvolutionDispatch(this, this->Internals, inData[0][0], inPtr,
+                                  inData[1][0], outData[0],
+                                  static_cast<double *>(outPtr), outExt, id, inInfo);
+      break;
+    case VTK_FLOAT:
+      vtkImageConvolutionDispatch(this, this->Internals, inData[0][0], inPtr,
+                                  inData[1][0], outData[0],
+                                  static_cast<float *>(outPtr), outExt, id, inInfo);
+      break;
+    case VTK_SHORT:
+      vtkImageConvolutionDispatch(this, this->Internals, inData[0][0], inPtr,
+                                  inData[1][0], outData[0],
+                                  static_cast<short *>(outPtr), outExt, id, inInfo);
+      break;
     default:
-      vtkErrorMacro(<< "Execute: Unknown ScalarType");
+      vtkErrorMacro(<< "Execute: Unsupported output ScalarType");
       return;
     }
   outData[0]->GetPointData( )->GetScalars( )->SetName( this->OutputDataName );
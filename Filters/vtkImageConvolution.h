@@ -28,7 +28,61 @@
 //! The kernel input is a vtkImageData of dimension i,j,k and possibly multi-
 //! components.
 //!
-//! \todo Add the possibilty to not checking the boundary conditions (faster).
+//! When SeparableKernel is on (default), each kernel component is tested for
+//! separability: if it can be written as a sum of at most
+//! MaximumSeparableRank products a(i)b(j)c(k) (up to SeparabilityTolerance),
+//! this component is computed as successive 1D passes along i, j and k. The
+//! per voxel cost drops from K0*K1*K2 to rank*(K0+K1+K2) multiply-adds.
+//! Non separable components go through the direct neighbourhood loop, which
+//! reads each neighbour once and accumulates all these components together.
+//! With BlockedKernelProduct (default), the interior voxels of several direct
+//! components are computed as a matrix product between tiles of gathered
+//! neighbourhoods and the kernel matrix, blocked for the registers and cache.
+//! Non separable components of kernels larger than FFTKernelSizeThreshold
+//! voxels are computed in the frequency domain (vtkImageFFT): the spectrum of
+//! the input is computed once and multiplied by the spectrum of each of these
+//! kernel components. This path is not threaded by extent and needs about 8
+//! padded volumes of doubles of memory.
+//! \note The separable and FFT paths are used for single component input
+//! images only.
+//!
+//! The prepared kernel (separable terms, packed taps, kernel spectra) is
+//! kept between executions and prepared again only when the kernel image
+//! (MTime), the number of components or scalar type of the input, or one of
+//! the settings above change. The kernel spectra are also computed again
+//! when the padded size of the input changes.
+//!
+//! Outside the whole extent of the input, the image is extended according to
+//! BoundaryCondition: zero (default), clamped to the edge voxel, or mirrored
+//! (edge voxel repeated, as vtkImageMirrorPad). The neighbourhood of the
+//! voxels far enough from the edges is not checked at all. The FFT path is
+//! only used with the zero boundary condition.
+//!
+//! The input update extent is the output update extent grown by the kernel
+//! half-width, so the filter can be streamed (vtkImageDataStreamer) with the
+//! same result as a whole volume execution. With a MemoryLimit, the update
+//! extent is also processed by slabs whose input fits in this limit.
+//!
+//! An optional mask (third input, e.g. the output of vtkPolyDataToBinaryImage)
+//! restricts the computation to its non zero voxels; the output is zero
+//! elsewhere. The mask is run-length encoded and the threads get pieces of
+//! the extent holding the same number of mask voxels. With a mask, all the
+//! kernel components use the direct path.
+//!
+//! With FixedPoint on and an unsigned char or unsigned short input, the
+//! interior voxels of the direct components are accumulated in integers,
+//! with the taps quantized to 16 bits for the range of the scalar type or
+//! for FixedPointInputBits. The absolute error on a voxel is about
+//! N * max(input) * max|w| * 2^-16 for a kernel of N taps w, a relative
+//! error of the order of 1e-5 to 1e-4, and slabs and streamed pieces give
+//! the same output as a whole volume execution. With BlockedKernelProduct
+//! on, fixed point is used for up to 4 direct components and the blocked
+//! product beyond.
+//!
+//! The accumulation is otherwise done in double precision. The output can be
+//! stored as double (default), float or short (OutputScalarType); the result
+//! is multiplied by OutputScale before storage, and rounded and clamped for
+//! short.
 //!
 //! \author Jerome Velut
 //! \date jan 2010
@@ -36,15 +90,21 @@
 #ifndef __VTKEXTENDEDIMAGECONVOLUTION_H__
 #define __VTKEXTENDEDIMAGECONVOLUTION_H__
 
-#include "vtkThreadedImageAlgorithm.h"
+#include "vtkThreadedImageExtentAlgorithm.h"
+
+#define VTK_CONVOLUTION_BOUNDARY_ZERO 0
+#define VTK_CONVOLUTION_BOUNDARY_CLAMP 1
+#define VTK_CONVOLUTION_BOUNDARY_MIRROR 2
+
+class vtkImageConvolutionInternals;
 
-class VTK_EXPORT vtkImageConvolution : public vtkThreadedImageAlgorithm
+class VTK_EXPORT vtkImageConvolution : public vtkThreadedImageExtentAlgorithm
 {
 public:
   // Description:
   // Construct an instance of vtkImageConvolution filter.
   static vtkImageConvolution *New();
-  vtkTypeMacro(vtkImageConvolution,vtkThreadedImageAlgorithm);
+  vtkTypeMacro(vtkImageConvolution,vtkThreadedImageExtentAlgorithm);
   void PrintSelf(ostream& os, vtkIndent indent);
 
   vtkSetStringMacro( OutputDataName );
@@ -57,6 +117,87 @@ public:
     {
       this->SetKernelConnection(0, algOutput);
     }
+
+  //! Specify the optional mask input: only its non zero voxels (first
+  //! component) are computed. Its whole extent must be the one of the input.
+  void SetMaskConnection(vtkAlgorithmOutput* algOutput);
+  void SetMaskData(vtkImageData* mask);
+
+  //! Split the extent by number of mask voxels when a mask is set.
+  virtual int SplitExtent(int splitExt[6], int startExt[6], int num, int total);
+
+  //! Detect (1) or not (0) separable kernel components and convolve them
+  //! with successive 1D passes.
+  vtkSetMacro( SeparableKernel, int );
+  vtkGetMacro( SeparableKernel, int );
+  vtkBooleanMacro( SeparableKernel, int );
+
+  //! Maximum number of separable terms a kernel component may be decomposed
+  //! into before it is considered as non separable.
+  vtkSetClampMacro( MaximumSeparableRank, int, 1, VTK_LARGE_INTEGER );
+  vtkGetMacro( MaximumSeparableRank, int );
+
+  //! Relative residual (Frobenius norm) accepted for the separable
+  //! decomposition of a kernel component.
+  vtkSetMacro( SeparabilityTolerance, double );
+  vtkGetMacro( SeparabilityTolerance, double );
+
+  //! Number of kernel voxels from which the non separable components are
+  //! convolved in the frequency domain. 0 disables the FFT path.
+  vtkSetClampMacro( FFTKernelSizeThreshold, int, 0, VTK_LARGE_INTEGER );
+  vtkGetMacro( FFTKernelSizeThreshold, int );
+
+  //! Extension of the input image outside of its whole extent.
+  vtkSetClampMacro( BoundaryCondition, int, VTK_CONVOLUTION_BOUNDARY_ZERO,
+                    VTK_CONVOLUTION_BOUNDARY_MIRROR );
+  vtkGetMacro( BoundaryCondition, int );
+  void SetBoundaryConditionToZero( )
+    {this->SetBoundaryCondition( VTK_CONVOLUTION_BOUNDARY_ZERO );}
+  void SetBoundaryConditionToClamp( )
+    {this->SetBoundaryCondition( VTK_CONVOLUTION_BOUNDARY_CLAMP );}
+  void SetBoundaryConditionToMirror( )
+    {this->SetBoundaryCondition( VTK_CONVOLUTION_BOUNDARY_MIRROR );}
+  const char* GetBoundaryConditionAsString( );
+
+  //! Memory (in kibibytes) that the input of a slab may use. If the input of
+  //! the update extent is larger, the filter executes slab by slab along the
+  //! last axis, each slab requesting its own input. The output update extent
+  //! is still allocated at once. 0 (default) disables the slabs.
+  vtkSetMacro( MemoryLimit, unsigned long );
+  vtkGetMacro( MemoryLimit, unsigned long );
+
+  //! Scalar type of the output: VTK_DOUBLE (default), VTK_FLOAT or VTK_SHORT.
+  vtkSetMacro( OutputScalarType, int );
+  vtkGetMacro( OutputScalarType, int );
+  void SetOutputScalarTypeToDouble( ) {this->SetOutputScalarType( VTK_DOUBLE );}
+  void SetOutputScalarTypeToFloat( ) {this->SetOutputScalarType( VTK_FLOAT );}
+  void SetOutputScalarTypeToShort( ) {this->SetOutputScalarType( VTK_SHORT );}
+
+  //! Factor applied to the convolution result before it is stored. Useful to
+  //! fit the values in the range of a short output.
+  vtkSetMacro( OutputScale, double );
+  vtkGetMacro( OutputScale, double );
+
+  //! Compute the interior voxels of the direct components (when there are
+  //! at least two of them) as a blocked matrix product (1, default) or with
+  //! the neighbourhood loop (0).
+  vtkSetMacro( BlockedKernelProduct, int );
+  vtkGetMacro( BlockedKernelProduct, int );
+  vtkBooleanMacro( BlockedKernelProduct, int );
+
+  //! Accumulate the direct components in fixed point (1) for unsigned char
+  //! and unsigned short inputs, with 16 bits taps (relative error of the
+  //! order of 1e-5 to 1e-4), or in double precision (0, default).
+  vtkSetMacro( FixedPoint, int );
+  vtkGetMacro( FixedPoint, int );
+  vtkBooleanMacro( FixedPoint, int );
+
+  //! Number of significant bits of the input values for FixedPoint (e.g. 12
+  //! for 12 bits data stored as unsigned short), or 0 (default) for the
+  //! whole range of the scalar type. Fewer bits allow finer taps and longer
+  //! 32 bits sums; an input value above 2^bits - 1 is an error.
+  vtkSetClampMacro( FixedPointInputBits, int, 0, 16 );
+  vtkGetMacro( FixedPointInputBits, int );
   
 protected:
   vtkImageConvolution();
@@ -71,11 +212,43 @@ protected:
                          vtkInformationVector** inputVector,
                          vtkInformationVector* outputVector);
                          
+  virtual int FillInputPortInformation(int port, vtkInformation *info);
+
   virtual int RequestInformation(vtkInformation*,
                          vtkInformationVector** inputVector,
                          vtkInformationVector* outputVector);
 
+  virtual int RequestData(vtkInformation* request,
+                         vtkInformationVector** inputVector,
+                         vtkInformationVector* outputVector);
+
+  //! Decompose the kernel components before the threaded execution.
+  //! RequestData only calls it when the prepared kernel is out of date.
+  virtual void PrepareKernel( vtkImageData* kernel, int inNumComps );
+
+  //! Compute the FFT kernel components on the extent outExt of the output
+  void ExecuteFFT( vtkImageData* inData, vtkImageData* kernelData,
+                   vtkImageData* outData, int outExt[6], int wholeExt[6] );
+
   char* OutputDataName;
+  int SeparableKernel; //!< if 1, separable kernel components use 1D passes
+  int MaximumSeparableRank; //!< max number of separable terms per component
+  double SeparabilityTolerance; //!< relative residual of the decomposition
+  int FFTKernelSizeThreshold; //!< kernel size (voxels) from which FFT is used
+  int BoundaryCondition; //!< zero, clamp or mirror
+  unsigned long MemoryLimit; //!< input memory of a slab, in KiB
+  int OutputScalarType; //!< double, float or short
+  double OutputScale; //!< factor applied before storage
+  int BlockedKernelProduct; //!< if 1, direct components use the blocked product
+  int FixedPoint; //!< if 1, integer accumulation for 8 and 16 bits inputs
+  int FixedPointInputBits; //!< significant bits of the inputs, 0 for all
+
+  int CurrentSlab; //!< slab being executed
+  int NumberOfSlabs; //!< number of slabs of the update extent
+  int SlabAxis; //!< axis along which the update extent is cut
+  int SlabExtent[6]; //!< output extent of the current slab
+
+  vtkImageConvolutionInternals* Internals; //!< prepared kernel data
   
 private:
   vtkImageConvolution(const vtkImageConvolution&);  // Not implemented.
@@ -23,16 +23,66 @@
 
 #include "vtkImageEigenElements.h"
 #include "vtkImageData.h"
+#include "vtkPolyData.h"
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
 #include "vtkPointData.h"
-#include "vtkDoubleArray.h"
+#include "vtkDataArray.h"
+#include "vtkIdTypeArray.h"
+#include "vtkIntArray.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkObjectFactory.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
+#include "vtkExecutive.h"
+#include "vtkMultiThreader.h"
 #include "vtkMath.h"
 
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
 vtkStandardNewMacro(vtkImageEigenElements);
 
+//----------------------------------------------------------------------------
+// Output arrays, eigen elements then measures: the first requested one is
+// the scalars
+#define VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS 10
+#define VTK_EIGEN_ELEMENTS_FIRST_MEASURE 6
+static const char *vtkImageEigenElementsNames[VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS] =
+{
+    "MaxEigenVector", "MaxEigenValue",
+    "MedEigenVector", "MedEigenValue",
+    "MinEigenVector", "MinEigenValue",
+    "FractionalAnisotropy", "Linearity",
+    "Planarity", "Vesselness"
+};
+
+//----------------------------------------------------------------------------
+// Active voxels of the update extent, counted in each slice along the axis
+// that is split among the threads.
+class vtkImageEigenElementsInternals
+{
+public:
+    //! Update extent of the counts
+    int Extent[6];
+    //! Axis along which the update extent is split among the threads
+    int SplitAxis;
+    //! Number of active voxels in each slice along SplitAxis, empty if they
+    //! are not counted
+    std::vector<vtkIdType> Counts;
+    //! Number of active voxels before each slice, and in all of them at the
+    //! end: the first point id of each slice in the compact output
+    std::vector<vtkIdType> Offsets;
+    //! Compact output being filled, 0 if the image is
+    vtkPolyData *Compact;
+};
+
+//----------------------------------------------------------------------------
+// Cost of an active voxel relative to a skipped one, when the update extent
+// is split among the threads
+static const double vtkImageEigenElementsActiveCost = 16.0;
+
 //----------------------------------------------------------------------------
 // Construct an instance of vtkImageEigenElements filter.
 vtkImageEigenElements::vtkImageEigenElements()
@@ -45,53 +95,408 @@ vtkImageEigenElements::vtkImageEigenElements()
     this->inM22 = 0;
     this->inM23 = 0;
     this->inM33 = 0;
+    this->ComputeMaxEigenVector = 1;
+    this->ComputeMaxEigenValue = 1;
+    this->ComputeMedEigenVector = 1;
+    this->ComputeMedEigenValue = 1;
+    this->ComputeMinEigenVector = 1;
+    this->ComputeMinEigenValue = 1;
+    this->ComputeFractionalAnisotropy = 0;
+    this->ComputeLinearity = 0;
+    this->ComputePlanarity = 0;
+    this->ComputeVesselness = 0;
+    this->VesselnessAlpha = 0.5;
+    this->VesselnessBeta = 0.5;
+    this->VesselnessC = 0.0;
+    this->BrightVessels = 1;
+    this->OutputScalarType = VTK_DOUBLE;
+    this->CompactOutput = 0;
+    this->Internals = new vtkImageEigenElementsInternals;
+    this->Internals->SplitAxis = 2;
+    this->Internals->Compact = 0;
     this->SetNumberOfInputPorts( 1 );
-    this->SetNumberOfThreads( 1 );
+    this->SetNumberOfOutputPorts( 2 );
 }
 
 //----------------------------------------------------------------------------
 // Destructor
 vtkImageEigenElements::~vtkImageEigenElements()
 {
+    delete this->Internals;
 }
 
 //----------------------------------------------------------------------------
 void vtkImageEigenElements::PrintSelf(ostream& os, vtkIndent indent)
 {
     this->Superclass::PrintSelf(os, indent);
+
+    os << indent << "UseMask: " << this->UseMask << "\n";
+    os << indent << "InMask: " << this->InMask << "\n";
+    os << indent << "CompactOutput: " << this->CompactOutput << "\n";
+    for( int i = 0; i < VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS; i++ )
+    {
+        os << indent << "Compute" << vtkImageEigenElementsNames[i] << ": "
+           << ( this->GetOutputNumberOfComponents( i ) > 0 ) << "\n";
+    }
+    os << indent << "VesselnessAlpha: " << this->VesselnessAlpha << "\n";
+    os << indent << "VesselnessBeta: " << this->VesselnessBeta << "\n";
+    os << indent << "VesselnessC: " << this->VesselnessC << "\n";
+    os << indent << "BrightVessels: " << this->BrightVessels << "\n";
+    os << indent << "OutputScalarType: "
+       << vtkImageScalarTypeNameMacro( this->OutputScalarType ) << "\n";
+}
+
+//----------------------------------------------------------------------------
+int vtkImageEigenElements::GetOutputNumberOfComponents( int i )
+{
+    int compute[VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS] =
+        { this->ComputeMaxEigenVector, this->ComputeMaxEigenValue,
+          this->ComputeMedEigenVector, this->ComputeMedEigenValue,
+          this->ComputeMinEigenVector, this->ComputeMinEigenValue,
+          this->ComputeFractionalAnisotropy, this->ComputeLinearity,
+          this->ComputePlanarity, this->ComputeVesselness };
+    if( !compute[i] )
+    {
+        return( 0 );
+    }
+    return( i < VTK_EIGEN_ELEMENTS_FIRST_MEASURE && i % 2 == 0 ? 3 : 1 );
+}
+
+//----------------------------------------------------------------------------
+vtkPolyData* vtkImageEigenElements::GetPointListOutput( )
+{
+    return( vtkPolyData::SafeDownCast( this->GetOutputDataObject( 1 ) ) );
+}
+
+//----------------------------------------------------------------------------
+int vtkImageEigenElements::FillOutputPortInformation( int port, vtkInformation* info )
+{
+    if( port == 1 )
+    {
+        info->Set( vtkDataObject::DATA_TYPE_NAME( ), "vtkPolyData" );
+        return( 1 );
+    }
+    return( this->Superclass::FillOutputPortInformation( port, info ) );
+}
+
+//----------------------------------------------------------------------------
+// The slabs are cut along the split axis where the accumulated cost reaches
+// an equal share of the cost of the whole extent. Without counts, the
+// extent is split as by vtkThreadedImageAlgorithm.
+int vtkImageEigenElements::SplitExtent( int splitExt[6], int startExt[6], int num, int total )
+{
+    vtkImageEigenElementsInternals *internals = this->Internals;
+    if( internals->Counts.empty( ) || !std::equal( startExt, startExt + 6, internals->Extent ) )
+    {
+        return( this->Superclass::SplitExtent( splitExt, startExt, num, total ) );
+    }
+
+    int axis = internals->SplitAxis;
+    int numSlices = static_cast<int>( internals->Counts.size( ) );
+    double sliceSize = 1.0;
+    for( int i = 0; i < 3; i++ )
+    {
+        sliceSize *= i == axis ? 1 : startExt[2*i+1] - startExt[2*i] + 1;
+    }
+    double totalCost = vtkImageEigenElementsActiveCost * internals->Offsets[numSlices]
+                       + sliceSize * numSlices;
+
+    // First slice of each slab, then the end of the last one
+    std::vector<int> firsts( 1, 0 );
+    double cost = 0.0;
+    for( int i = 0; i < numSlices - 1; i++ )
+    {
+        cost += vtkImageEigenElementsActiveCost * internals->Counts[i] + sliceSize;
+        int numSlabs = static_cast<int>( firsts.size( ) );
+        if( numSlabs < total && cost * total >= totalCost * numSlabs )
+        {
+            firsts.push_back( i + 1 );
+        }
+    }
+    firsts.push_back( numSlices );
+
+    int numSlabs = static_cast<int>( firsts.size( ) ) - 1;
+    if( num < numSlabs )
+    {
+        std::copy( startExt, startExt + 6, splitExt );
+        splitExt[2*axis] = startExt[2*axis] + firsts[num];
+        splitExt[2*axis+1] = startExt[2*axis] + firsts[num+1] - 1;
+    }
+    return( numSlabs );
+}
+
+//----------------------------------------------------------------------------
+// Extent computed for a request: the image update extent, or the whole
+// extent when only the point list (port 1), which has no extent, is pulled.
+static void vtkImageEigenElementsRequestedExtent( vtkInformation* request,
+        vtkInformation* inInfo, vtkInformation* outInfo, int ext[6] )
+{
+    if( request->Has( vtkExecutive::FROM_OUTPUT_PORT( ) )
+        && request->Get( vtkExecutive::FROM_OUTPUT_PORT( ) ) == 1 )
+    {
+        inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), ext);
+    }
+    else
+    {
+        outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), ext);
+    }
 }
 
 //----------------------------------------------------------------------------
-int vtkImageEigenElements::RequestUpdateExtent(vtkInformation*,
+// The input update extent is the output update extent, or the whole extent
+// for the point list.
+int vtkImageEigenElements::RequestUpdateExtent(vtkInformation* request,
         vtkInformationVector** inputVector,
         vtkInformationVector* outputVector)
 {
-    // Get input and output pipeline information.
-    vtkInformation* outInfo = outputVector->GetInformationObject(0);
     vtkInformation* inInfo = inputVector[0]->GetInformationObject(0);
-
+    vtkInformation* outInfo = outputVector->GetInformationObject(0);
+    int inExt[6];
+    vtkImageEigenElementsRequestedExtent( request, inInfo, outInfo, inExt );
+    inInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), inExt, 6);
     return( 1 );
 }
 
 //----------------------------------------------------------------------------
+// The scalars are the first requested output array.
 int vtkImageEigenElements::RequestInformation(vtkInformation*,
-        vtkInformationVector** inputVector,
+        vtkInformationVector** vtkNotUsed(inputVector),
         vtkInformationVector* outputVector)
 {
-    // Get input and output pipeline information.
     vtkInformation* outInfo = outputVector->GetInformationObject(0);
-    vtkInformation* inInfo = inputVector[0]->GetInformationObject(0);
 
+    if( this->OutputScalarType != VTK_DOUBLE && this->OutputScalarType != VTK_FLOAT )
+    {
+        vtkErrorMacro(<< "Unsupported output scalar type: "
+                      << vtkImageScalarTypeNameMacro( this->OutputScalarType ));
+        return( 0 );
+    }
+    for( int i = 0; i < VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS; i++ )
+    {
+        if( this->GetOutputNumberOfComponents( i ) )
+        {
+            vtkDataObject::SetPointDataActiveScalarInfo(outInfo,
+                    this->OutputScalarType,
+                    this->GetOutputNumberOfComponents( i ));
+            return( 1 );
+        }
+    }
+    vtkErrorMacro(<< "No output array is requested.");
+    return( 0 );
+}
+
+//----------------------------------------------------------------------------
+// Count the voxels of nonzero mask in each slice of ext along axis
+template <class T>
+void vtkImageEigenElementsCount( vtkImageData *inData, T *inPtr, int ext[6],
+                                 int axis, int inMask, vtkIdType *counts )
+{
+    vtkIdType inInc0, inInc1, inInc2;
+    inData->GetIncrements( inInc0, inInc1, inInc2 );
+
+    int idx[3];
+    T *inPtr2 = inPtr + inMask;
+    for( idx[2] = ext[4]; idx[2] <= ext[5]; idx[2]++ )
+    {
+        T *inPtr1 = inPtr2;
+        for( idx[1] = ext[2]; idx[1] <= ext[3]; idx[1]++ )
+        {
+            T *inPtr0 = inPtr1;
+            for( idx[0] = ext[0]; idx[0] <= ext[1]; idx[0]++ )
+            {
+                counts[idx[axis] - ext[2*axis]] += *inPtr0 != 0;
+                inPtr0 += inInc0;
+            }
+            inPtr1 += inInc1;
+        }
+        inPtr2 += inInc2;
+    }
+}
+
+struct vtkImageEigenElementsCountStruct
+{
+    vtkImageData *Input;
+    int *Extent;
+    int Axis;
+    int InMask;
+    vtkIdType *Counts;
+};
+
+//----------------------------------------------------------------------------
+// Each thread counts the active voxels of its own slices.
+static VTK_THREAD_RETURN_TYPE vtkImageEigenElementsCountExecute( void *arg )
+{
+    vtkMultiThreader::ThreadInfo *info = static_cast<vtkMultiThreader::ThreadInfo*>( arg );
+    vtkImageEigenElementsCountStruct *str =
+        static_cast<vtkImageEigenElementsCountStruct*>( info->UserData );
+
+    int axis = str->Axis;
+    int numSlices = str->Extent[2*axis+1] - str->Extent[2*axis] + 1;
+    int first = numSlices * info->ThreadID / info->NumberOfThreads;
+    int end = numSlices * ( info->ThreadID + 1 ) / info->NumberOfThreads;
+    if( first >= end )
+    {
+        return( VTK_THREAD_RETURN_VALUE );
+    }
+
+    int ext[6];
+    std::copy( str->Extent, str->Extent + 6, ext );
+    ext[2*axis] = str->Extent[2*axis] + first;
+    ext[2*axis+1] = str->Extent[2*axis] + end - 1;
+    void *inPtr = str->Input->GetScalarPointerForExtent( ext );
+    switch( str->Input->GetScalarType( ) )
+    {
+        vtkTemplateMacro(
+            vtkImageEigenElementsCount( str->Input, static_cast<VTK_TT *>( inPtr ), ext,
+                                        axis, str->InMask, str->Counts + first ));
+    default:
+        break;
+    }
+    return( VTK_THREAD_RETURN_VALUE );
+}
+
+//----------------------------------------------------------------------------
+// The requested output arrays are allocated once, on the update extent or
+// on the active voxels of the compact output, before the threads fill their
+// own piece of them.
+int vtkImageEigenElements::RequestData(vtkInformation* request,
+        vtkInformationVector** inputVector,
+        vtkInformationVector* outputVector)
+{
+    vtkInformation* inInfo = inputVector[0]->GetInformationObject(0);
+    vtkInformation* outInfo = outputVector->GetInformationObject(0);
     vtkImageData *inImage = vtkImageData::SafeDownCast( inInfo->Get(vtkDataObject::DATA_OBJECT()));
-    int inNumComps = inImage->GetNumberOfScalarComponents( );
+    vtkImageData *outImage = vtkImageData::SafeDownCast( outInfo->Get(vtkDataObject::DATA_OBJECT()));
+    vtkPolyData *outPoints = vtkPolyData::SafeDownCast(
+        outputVector->GetInformationObject(1)->Get(vtkDataObject::DATA_OBJECT()));
+
+    int updateExt[6];
+    vtkImageEigenElementsRequestedExtent( request, inInfo, outInfo, updateExt );
+    outImage->SetExtent( updateExt );
+    outImage->GetPointData( )->Initialize( );
+    outPoints->Initialize( );
+
+    // Active voxels of each slice along the split axis: they balance the
+    // threads and give the first point id of each slice in the compact output.
+    vtkImageEigenElementsInternals *internals = this->Internals;
+    internals->Counts.clear( );
+    internals->Offsets.clear( );
+    internals->Compact = 0;
+    vtkIdType numVoxels = outImage->GetNumberOfPoints( );
+    if( ( this->UseMask || this->CompactOutput ) && numVoxels > 0 )
+    {
+        int axis = 2;
+        while( axis > 0 && updateExt[2*axis] == updateExt[2*axis+1] )
+        {
+            axis--;
+        }
+        int numSlices = updateExt[2*axis+1] - updateExt[2*axis] + 1;
+        internals->SplitAxis = axis;
+        std::copy( updateExt, updateExt + 6, internals->Extent );
+        internals->Counts.assign( numSlices, this->UseMask ? 0 : numVoxels / numSlices );
+        if( this->UseMask )
+        {
+            vtkImageEigenElementsCountStruct count;
+            count.Input = inImage;
+            count.Extent = updateExt;
+            count.Axis = axis;
+            count.InMask = this->InMask;
+            count.Counts = &internals->Counts[0];
+            this->Threader->SetNumberOfThreads( this->NumberOfThreads );
+            this->Threader->SetSingleMethod( vtkImageEigenElementsCountExecute, &count );
+            this->Threader->SingleMethodExecute( );
+        }
+        internals->Offsets.assign( numSlices + 1, 0 );
+        for( int i = 0; i < numSlices; i++ )
+        {
+            internals->Offsets[i+1] = internals->Offsets[i] + internals->Counts[i];
+        }
+    }
+
+    // The compact output has a vertex at each active voxel
+    vtkPointData *outPD = outImage->GetPointData( );
+    vtkIdType numTuples = numVoxels;
+    if( this->CompactOutput )
+    {
+        numTuples = internals->Offsets.empty( ) ? 0 : internals->Offsets.back( );
+
+        vtkPoints *points = vtkPoints::New( );
+        points->SetDataTypeToFloat( );
+        points->SetNumberOfPoints( numTuples );
+        outPoints->SetPoints( points );
+        points->Delete( );
+
+        vtkIdTypeArray *cells = vtkIdTypeArray::New( );
+        cells->SetNumberOfValues( 2 * numTuples );
+        vtkIdType *cellPtr = cells->GetPointer( 0 );
+        for( vtkIdType i = 0; i < numTuples; i++ )
+        {
+            cellPtr[2*i] = 1;
+            cellPtr[2*i+1] = i;
+        }
+        vtkCellArray *verts = vtkCellArray::New( );
+        verts->SetCells( numTuples, cells );
+        outPoints->SetVerts( verts );
+        verts->Delete( );
+        cells->Delete( );
+
+        vtkIntArray *voxelIndex = vtkIntArray::New( );
+        voxelIndex->SetName( "VoxelIndex" );
+        voxelIndex->SetNumberOfComponents( 3 );
+        voxelIndex->SetNumberOfTuples( numTuples );
+        outPoints->GetPointData( )->AddArray( voxelIndex );
+        voxelIndex->Delete( );
+
+        outPD = outPoints->GetPointData( );
+        internals->Compact = outPoints;
+    }
+
+    bool scalars = true;
+    for( int i = 0; i < VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS; i++ )
+    {
+        int numComps = this->GetOutputNumberOfComponents( i );
+        if( !numComps )
+        {
+            continue;
+        }
+        vtkDataArray* array = vtkDataArray::CreateDataArray( this->OutputScalarType );
+        array->SetName( vtkImageEigenElementsNames[i] );
+        array->SetNumberOfComponents( numComps );
+        array->SetNumberOfTuples( numTuples );
+        if( scalars )
+        {
+            outPD->SetScalars( array );
+            scalars = false;
+        }
+        else
+        {
+            outPD->AddArray( array );
+        }
+        array->Delete( );
+    }
+    if( scalars )
+    {
+        internals->Compact = 0;
+        vtkErrorMacro(<< "No output array is requested.");
+        return( 0 );
+    }
+    if( numTuples == 0 )
+    {
+        internals->Compact = 0;
+        return( 1 );
+    }
+
+    vtkImageData *inputImages[1] = { inImage };
+    vtkImageData **inputs[1] = { inputImages };
 
-    vtkDataObject::SetPointDataActiveScalarInfo(outInfo,
-            VTK_DOUBLE,
-            3);
+    this->ThreadedRequestExtent( request, inputVector, outputVector, inputs,
+                                 &outImage, updateExt );
+    internals->Compact = 0;
 
-    return 1;
+    return( 1 );
 }
 
+//----------------------------------------------------------------------------
 void vtkImageEigenElements::MapInputComponentsToTensor(int M11, int M12, int M13, int M22, int M23, int M33)
 {
     this->inM11 = M11;
@@ -113,30 +518,236 @@ void vtkImageEigenElements::GetInputComponentsToTensorMap(int& M11, int& M12, in
     M33 = this->inM33;
 }
 
+//----------------------------------------------------------------------------
+// Under this gap between two eigen values, relative to the largest tensor
+// component, the closed form solution is not accurate enough and the tensor
+// is solved with vtkMath::Jacobi.
+static const double vtkImageEigenElementsDegenerateGap = 1e-5;
+
+//----------------------------------------------------------------------------
+// Unit eigen vector of the eigen value l: the largest of the cross products
+// of two rows of A - l I.
+static inline void vtkImageEigenElementsVector( double a00, double a01, double a02,
+                                                double a11, double a12, double a22,
+                                                double l, double v[3] )
+{
+    double b00 = a00 - l, b11 = a11 - l, b22 = a22 - l;
+    double c01[3] = { a01*a12 - a02*b11, a02*a01 - b00*a12, b00*b11 - a01*a01 };
+    double c02[3] = { a01*b22 - a02*a12, a02*a02 - b00*b22, b00*a12 - a01*a02 };
+    double c12[3] = { b11*b22 - a12*a12, a12*a02 - a01*b22, a01*a12 - b11*a02 };
+    double n01 = c01[0]*c01[0] + c01[1]*c01[1] + c01[2]*c01[2];
+    double n02 = c02[0]*c02[0] + c02[1]*c02[1] + c02[2]*c02[2];
+    double n12 = c12[0]*c12[0] + c12[1]*c12[1] + c12[2]*c12[2];
+
+    bool use02 = n02 > n01;
+    double norm = use02 ? n02 : n01;
+    bool use12 = n12 > norm;
+    norm = use12 ? n12 : norm;
+    double inv = norm > 0.0 ? 1.0 / sqrt( norm ) : 0.0;
+    for( int c = 0; c < 3; c++ )
+    {
+        v[c] = ( use12 ? c12[c] : ( use02 ? c02[c] : c01[c] ) ) * inv;
+    }
+}
+
+//----------------------------------------------------------------------------
+// Same orientation as vtkMath::Jacobi: at least two positive components.
+static inline void vtkImageEigenElementsOrient( double v[3] )
+{
+    int numPos = ( v[0] >= 0.0 ) + ( v[1] >= 0.0 ) + ( v[2] >= 0.0 );
+    double sign = numPos < 2 ? -1.0 : 1.0;
+    v[0] *= sign;
+    v[1] *= sign;
+    v[2] *= sign;
+}
+
+//----------------------------------------------------------------------------
+static inline double vtkImageEigenElementsScale( double* const tensor[6], vtkIdType i )
+{
+    double scale = 0.0;
+    for( int c = 0; c < 6; c++ )
+    {
+        double value = fabs( tensor[c][i] );
+        scale = value > scale ? value : scale;
+    }
+    return( scale );
+}
+
+//----------------------------------------------------------------------------
+// The eigen values are the roots of the characteristic polynomial, computed
+// with the trigonometric solution on the tensor scaled by its largest
+// component. The first loop has no data dependent branch, so that it can be
+// vectorized; the second one solves again the few degenerate tensors.
+void vtkImageEigenElements::ComputeEigenElements( vtkIdType n, double* const tensor[6],
+                                                  double* const values[3], double* const vectors[9] )
+{
+    const double thirdOfTurn = 2.0943951023931957; // 2 pi / 3
+    bool computeVectors = vectors != 0;
+
+    for( vtkIdType i = 0; i < n; i++ )
+    {
+        double scale = vtkImageEigenElementsScale( tensor, i );
+        double inv = 1.0 / ( scale > 0.0 ? scale : 1.0 );
+        double a00 = tensor[0][i] * inv, a01 = tensor[1][i] * inv, a02 = tensor[2][i] * inv;
+        double a11 = tensor[3][i] * inv, a12 = tensor[4][i] * inv, a22 = tensor[5][i] * inv;
+
+        // A = q I + p B, with det(B) = 2 cos(3 phi)
+        double q = ( a00 + a11 + a22 ) / 3.0;
+        double b00 = a00 - q, b11 = a11 - q, b22 = a22 - q;
+        double p = sqrt( ( b00*b00 + b11*b11 + b22*b22 
+                           + 2.0 * ( a01*a01 + a02*a02 + a12*a12 ) ) / 6.0 );
+        double det = b00 * ( b11*b22 - a12*a12 ) - a01 * ( a01*b22 - a12*a02 ) 
+                     + a02 * ( a01*a12 - b11*a02 );
+        double r = p > 0.0 ? det / ( 2.0*p*p*p ) : 0.0;
+        r = r < -1.0 ? -1.0 : ( r > 1.0 ? 1.0 : r );
+        double phi = acos( r ) / 3.0;
+        double l0 = q + 2.0 * p * cos( phi );
+        double l2 = q + 2.0 * p * cos( phi + thirdOfTurn );
+        double l1 = 3.0 * q - l0 - l2;
+        values[0][i] = l0 * scale;
+        values[1][i] = l1 * scale;
+        values[2][i] = l2 * scale;
+        if( !computeVectors )
+        {
+            continue;
+        }
+
+        // Largest and smallest eigen vectors, made orthogonal, and the
+        // medium one from their cross product
+        double v0[3], v1[3], v2[3];
+        vtkImageEigenElementsVector( a00, a01, a02, a11, a12, a22, l0, v0 );
+        vtkImageEigenElementsVector( a00, a01, a02, a11, a12, a22, l2, v2 );
+        double dot = v0[0]*v2[0] + v0[1]*v2[1] + v0[2]*v2[2];
+        v2[0] -= dot * v0[0];
+        v2[1] -= dot * v0[1];
+        v2[2] -= dot * v0[2];
+        double norm = v2[0]*v2[0] + v2[1]*v2[1] + v2[2]*v2[2];
+        norm = norm > 0.0 ? 1.0 / sqrt( norm ) : 0.0;
+        v2[0] *= norm;
+        v2[1] *= norm;
+        v2[2] *= norm;
+        v1[0] = v2[1]*v0[2] - v2[2]*v0[1];
+        v1[1] = v2[2]*v0[0] - v2[0]*v0[2];
+        v1[2] = v2[0]*v0[1] - v2[1]*v0[0];
+        vtkImageEigenElementsOrient( v0 );
+        vtkImageEigenElementsOrient( v1 );
+        vtkImageEigenElementsOrient( v2 );
+
+        for( int c = 0; c < 3; c++ )
+        {
+            vectors[c][i] = v0[c];
+            vectors[3+c][i] = v1[c];
+            vectors[6+c][i] = v2[c];
+        }
+    }
+
+    double a[3][3], v[3][3], w[3];
+    double *A[3] = { a[0], a[1], a[2] };
+    double *V[3] = { v[0], v[1], v[2] };
+    for( vtkIdType i = 0; i < n; i++ )
+    {
+        double gap = vtkImageEigenElementsDegenerateGap * vtkImageEigenElementsScale( tensor, i );
+        if( values[0][i] - values[1][i] > gap && values[1][i] - values[2][i] > gap )
+        {
+            continue;
+        }
+        a[0][0] = tensor[0][i];
+        a[0][1] = a[1][0] = tensor[1][i];
+        a[0][2] = a[2][0] = tensor[2][i];
+        a[1][1] = tensor[3][i];
+        a[1][2] = a[2][1] = tensor[4][i];
+        a[2][2] = tensor[5][i];
+        vtkMath::Jacobi( A, w, V );
+        for( int e = 0; e < 3; e++ )
+        {
+            values[e][i] = w[e];
+            for( int c = 0; computeVectors && c < 3; c++ )
+            {
+                vectors[3*e+c][i] = v[c][e];
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+// Measures of the eigen values l1 >= l2 >= l3 (see the class documentation)
+static inline double vtkImageEigenElementsFractionalAnisotropy( double l1, double l2, double l3 )
+{
+    double mean = ( l1 + l2 + l3 ) / 3.0;
+    double norm = l1*l1 + l2*l2 + l3*l3;
+    double deviation = ( l1 - mean )*( l1 - mean ) + ( l2 - mean )*( l2 - mean )
+                       + ( l3 - mean )*( l3 - mean );
+    return( norm > 0.0 ? sqrt( 1.5 * deviation / norm ) : 0.0 );
+}
+
+static inline double vtkImageEigenElementsLinearity( double l1, double l2, double vtkNotUsed(l3) )
+{
+    return( l1 > 0.0 ? ( l1 - l2 ) / l1 : 0.0 );
+}
+
+static inline double vtkImageEigenElementsPlanarity( double l1, double l2, double l3 )
+{
+    return( l1 > 0.0 ? ( l2 - l3 ) / l1 : 0.0 );
+}
+
+static inline double vtkImageEigenElementsVesselness( double l1, double l2, double l3,
+                                                      double alpha, double beta, double c,
+                                                      int bright )
+{
+    // Sort by magnitude: |a1| <= |a2| <= |a3|
+    double a[3] = { l1, l2, l3 };
+    for( int i = 1; i < 3; i++ )
+    {
+        for( int j = i; j > 0 && fabs( a[j] ) < fabs( a[j-1] ); j-- )
+        {
+            double tmp = a[j];
+            a[j] = a[j-1];
+            a[j-1] = tmp;
+        }
+    }
+    if( bright ? ( a[1] >= 0.0 || a[2] >= 0.0 ) : ( a[1] <= 0.0 || a[2] <= 0.0 ) )
+    {
+        return( 0.0 );
+    }
+    double ra2 = ( a[1] * a[1] ) / ( a[2] * a[2] );
+    double rb2 = ( a[0] * a[0] ) / fabs( a[1] * a[2] );
+    double vesselness = ( 1.0 - exp( -ra2 / ( 2.0 * alpha * alpha ) ) )
+                        * exp( -rb2 / ( 2.0 * beta * beta ) );
+    if( c > 0.0 )
+    {
+        double s2 = a[0]*a[0] + a[1]*a[1] + a[2]*a[2];
+        vesselness *= 1.0 - exp( -s2 / ( 2.0 * c * c ) );
+    }
+    return( vesselness );
+}
+
+//----------------------------------------------------------------------------
+// Place of the active voxels in the compact output: from the point FirstId
+// on, in the order of the voxels.
+struct vtkImageEigenElementsCompact
+{
+    float *Points;
+    int *VoxelIndex;
+    vtkIdType FirstId;
+};
+
 //----------------------------------------------------------------------------
 // This templated function executes the filter on any region,
 // whether it needs boundary checking or not.
 // If the filter needs to be faster, the function could be duplicated
 // for strictly center (no boundary) processing.
-template <class T>
+template <class T, class OT>
 void vtkImageEigenElementsExecute(vtkImageEigenElements *self,
                                   vtkImageData *inData, T *inPtr,
-                                  vtkImageData *outData, double *outPtr,
-                                  int outExt[6], int id,
-                                  vtkInformation *inInfo)
+                                  vtkImageData *outData, OT *outPtr[10],
+                                  vtkImageEigenElementsCompact *compact,
+                                  int outExt[6], int id)
 {
     // For looping though output (and input) pixels.
     int outMin0, outMax0, outMin1, outMax1, outMin2, outMax2;
     int outIdx0, outIdx1, outIdx2;
     vtkIdType inInc0, inInc1, inInc2;
-    vtkIdType outInc0, outInc1, outInc2;
     T *inPtr0, *inPtr1, *inPtr2;
-    double *outPtr0, *outPtr1, *outPtr2;
-    int numComps;
-
-
-    // The extent of the whole input image
-    int inImageExt[6];
 
     // to compute the range
     unsigned long count = 0;
@@ -144,92 +755,64 @@ void vtkImageEigenElementsExecute(vtkImageEigenElements *self,
 
     // Get information to march through data
     inData->GetIncrements(inInc0, inInc1, inInc2);
-    inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), inImageExt);
-    outData->GetIncrements(outInc0, outInc1, outInc2);
     outMin0 = outExt[0];
     outMax0 = outExt[1];
     outMin1 = outExt[2];
     outMax1 = outExt[3];
     outMin2 = outExt[4];
     outMax2 = outExt[5];
-    numComps = outData->GetNumberOfScalarComponents();
 
-    outData->GetPointData()->GetScalars()->SetName("MaxEigenVector");
+    // The output arrays cover the whole update extent: each row of outExt
+    // is written at its own point id.
+    int *dataExt = outData->GetExtent( );
+    vtkIdType dataDim0 = dataExt[1] - dataExt[0] + 1;
+    vtkIdType dataDim1 = dataExt[3] - dataExt[2] + 1;
 
     int inM11, inM12, inM13, inM22, inM23, inM33;
     self->GetInputComponentsToTensorMap(inM11, inM12, inM13, inM22, inM23, inM33);
+    int useMask = self->GetUseMask( );
+    int inMask = self->GetInMask( );
 
+    double origin[3], spacing[3];
+    inData->GetOrigin( origin );
+    inData->GetSpacing( spacing );
+    vtkIdType compactId = compact ? compact->FirstId : 0;
 
+    double alpha = self->GetVesselnessAlpha( );
+    double beta = self->GetVesselnessBeta( );
+    double c = self->GetVesselnessC( );
+    int bright = self->GetBrightVessels( );
 
-    vtkDoubleArray* maxEval = vtkDoubleArray::New( );
-    maxEval->SetName( "MaxEigenValue" );
-    maxEval->SetNumberOfComponents( 1 );
-    maxEval->SetNumberOfTuples( outData->GetNumberOfPoints());
-    outData->GetPointData( )->AddArray( maxEval );
-    maxEval->Delete( );
-
-    vtkDoubleArray* medEvec = vtkDoubleArray::New( );
-    medEvec->SetName( "MedEigenVector" );
-    medEvec->SetNumberOfComponents( 3 );
-    medEvec->SetNumberOfTuples( outData->GetNumberOfPoints());
-    outData->GetPointData( )->AddArray( medEvec );
-    medEvec->Delete( );
-
-    vtkDoubleArray* medEval = vtkDoubleArray::New( );
-    medEval->SetName( "MedEigenValue" );
-    medEval->SetNumberOfComponents( 1 );
-    medEval->SetNumberOfTuples( outData->GetNumberOfPoints());
-    outData->GetPointData( )->AddArray( medEval );
-    medEval->Delete( );
-
-    vtkDoubleArray* minEvec = vtkDoubleArray::New( );
-    minEvec->SetName( "MinEigenVector" );
-    minEvec->SetNumberOfComponents( 3 );
-    minEvec->SetNumberOfTuples( outData->GetNumberOfPoints() );
-    outData->GetPointData( )->AddArray( minEvec );
-    minEvec->Delete( );
-
-    vtkDoubleArray* minEval = vtkDoubleArray::New( );
-    minEval->SetName( "MinEigenValue" );
-    minEval->SetNumberOfComponents( 1 );
-    minEval->SetNumberOfTuples( outData->GetNumberOfPoints());
-    outData->GetPointData( )->AddArray( minEval );
-    minEval->Delete( );
-
-
-    double *maxEvecPtr = static_cast<double*>(outData->GetPointData()->GetArray("MaxEigenVector")->GetVoidPointer(0));
-    double *maxEvalPtr = static_cast<double*>(outData->GetPointData()->GetArray("MaxEigenValue")->GetVoidPointer(0));
-    double *medEvecPtr = static_cast<double*>(outData->GetPointData()->GetArray("MedEigenVector")->GetVoidPointer(0));
-    double *medEvalPtr = static_cast<double*>(outData->GetPointData()->GetArray("MedEigenValue")->GetVoidPointer(0));
-    double *minEvecPtr = static_cast<double*>(outData->GetPointData()->GetArray("MinEigenVector")->GetVoidPointer(0));
-    double *minEvalPtr = static_cast<double*>(outData->GetPointData()->GetArray("MinEigenValue")->GetVoidPointer(0));
-
-
-
-
-    // in and out should be marching through corresponding pixels.
-    inPtr = static_cast<T *>(
-                inData->GetScalarPointer(outMin0, outMin1, outMin2));
-
-    target = static_cast<unsigned long>(numComps*(outMax2 - outMin2 + 1)*
+    target = static_cast<unsigned long>((outMax2 - outMin2 + 1)*
                                         (outMax1 - outMin1 + 1)/50.0);
     target++;
 
-    double** matrix, **evect;
-    matrix = new double*[3];
-    evect = new double*[3];
-    for( int i = 0; i < 3; i++)
+    // Tensors of the active voxels of a row, gathered component-wise, their
+    // mask multipliers, their eigen elements and their output point ids. The
+    // vectors are computed only if one is output.
+    vtkIdType rowLength = outMax0 - outMin0 + 1;
+    std::vector<double> buffer( 19 * rowLength );
+    std::vector<vtkIdType> pointIds( rowLength );
+    double *tensor[6], *values[3], *vectors[9];
+    double *multiplier = &buffer[18 * rowLength];
+    bool computeVectors = outPtr[0] || outPtr[2] || outPtr[4];
+    for( int c = 0; c < 6; c++ )
+    {
+        tensor[c] = &buffer[c * rowLength];
+    }
+    for( int e = 0; e < 3; e++ )
+    {
+        values[e] = &buffer[( 6 + e ) * rowLength];
+    }
+    for( int c = 0; c < 9; c++ )
     {
-        matrix[i] = new double[3];
-        evect[i] = new double[3];
+        vectors[c] = &buffer[( 9 + c ) * rowLength];
     }
-    double* eval = new double[3];
+
     // loop through pixels of output
-    outPtr2 = outPtr;
     inPtr2 = inPtr;
     for (outIdx2 = outMin2; outIdx2 <= outMax2; ++outIdx2)
     {
-        outPtr1 = outPtr2;
         inPtr1 = inPtr2;
         for (outIdx1 = outMin1;
                 outIdx1 <= outMax1 && !self->AbortExecute;
@@ -244,63 +827,149 @@ void vtkImageEigenElementsExecute(vtkImageEigenElements *self,
                 count++;
             }
 
-            outPtr0 = outPtr1;
+            // Only the voxels of nonzero mask are solved
+            vtkIdType numActive = 0;
             inPtr0 = inPtr1;
-
-            for (outIdx0 = outMin0; outIdx0 <= outMax0; ++outIdx0)
+            for (outIdx0 = 0; outIdx0 < rowLength; ++outIdx0, inPtr0 += inInc0)
             {
-
-                matrix[0][0] = *(inPtr0+inM11);
-                matrix[0][1] = *(inPtr0+inM12);
-                matrix[0][2] = *(inPtr0+inM13);
-                matrix[1][0] = *(inPtr0+inM12);
-                matrix[1][1] = *(inPtr0+inM22);
-                matrix[1][2] = *(inPtr0+inM23);
-                matrix[2][0] = *(inPtr0+inM13);
-                matrix[2][1] = *(inPtr0+inM23);
-                matrix[2][2] = *(inPtr0+inM33);
-
-                T multiplier = 1;
-                if( self->GetUseMask() )
-                    multiplier = *(inPtr0+self->GetInMask());
-
-                vtkMath::Jacobi(matrix, eval,evect );
-                // Set the output pixel to the correct value
-                for( int comp = 0; comp < 3; comp ++)
+                double mask = useMask ? static_cast<double>( *(inPtr0+inMask) ) : 1.0;
+                if( mask == 0.0 )
                 {
+                    continue;
+                }
+                tensor[0][numActive] = *(inPtr0+inM11);
+                tensor[1][numActive] = *(inPtr0+inM12);
+                tensor[2][numActive] = *(inPtr0+inM13);
+                tensor[3][numActive] = *(inPtr0+inM22);
+                tensor[4][numActive] = *(inPtr0+inM23);
+                tensor[5][numActive] = *(inPtr0+inM33);
+                multiplier[numActive] = mask;
+                pointIds[numActive] = outIdx0;
+                numActive++;
+            }
+
+            vtkImageEigenElements::ComputeEigenElements( numActive, tensor, values,
+                                                         computeVectors ? vectors : 0 );
 
-                    maxEvecPtr[comp] = evect[comp][0]*multiplier;
-                    medEvecPtr[comp] = evect[comp][1]*multiplier;
-                    minEvecPtr[comp] = evect[comp][2]*multiplier;
+            // Output point of each active voxel: the next one of the compact
+            // output, or its point in the image, whose skipped voxels are 0
+            if( compact )
+            {
+                for( vtkIdType i = 0; i < numActive; i++ )
+                {
+                    int ijk[3] = { outMin0 + static_cast<int>( pointIds[i] ), outIdx1, outIdx2 };
+                    for( int comp = 0; comp < 3; comp++ )
+                    {
+                        compact->VoxelIndex[3*compactId+comp] = ijk[comp];
+                        compact->Points[3*compactId+comp] = static_cast<float>(
+                            origin[comp] + spacing[comp] * ijk[comp] );
+                    }
+                    pointIds[i] = compactId++;
                 }
-                maxEvecPtr += 3;
-                medEvecPtr += 3;
-                minEvecPtr += 3;
+            }
+            else
+            {
+                vtkIdType outId = ( ( outIdx2 - dataExt[4] ) * dataDim1 + outIdx1 - dataExt[2] )
+                                  * dataDim0 + outMin0 - dataExt[0];
+                for( int i = 0; numActive < rowLength && i < VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS; i++ )
+                {
+                    int numComps = i < VTK_EIGEN_ELEMENTS_FIRST_MEASURE && i % 2 == 0 ? 3 : 1;
+                    if( outPtr[i] )
+                    {
+                        std::fill( outPtr[i] + numComps * outId,
+                                   outPtr[i] + numComps * ( outId + rowLength ),
+                                   static_cast<OT>( 0 ) );
+                    }
+                }
+                for( vtkIdType i = 0; i < numActive; i++ )
+                {
+                    pointIds[i] += outId;
+                }
+            }
 
-                *maxEvalPtr = eval[0]*multiplier;
-                maxEvalPtr++;
-                *medEvalPtr = eval[1]*multiplier;
-                medEvalPtr++;
-                *minEvalPtr = eval[2]*multiplier;
-                minEvalPtr++;
+            // Set the output points of the requested arrays
+            for( int e = 0; e < 3; e++ )
+            {
+                OT *evecPtr = outPtr[2*e];
+                if( evecPtr )
+                {
+                    for( vtkIdType i = 0; i < numActive; i++ )
+                    {
+                        for( int comp = 0; comp < 3; comp ++)
+                        {
+                            evecPtr[3*pointIds[i]+comp] = static_cast<OT>(
+                                vectors[3*e+comp][i]*multiplier[i] );
+                        }
+                    }
+                }
+                OT *evalPtr = outPtr[2*e+1];
+                if( evalPtr )
+                {
+                    for( vtkIdType i = 0; i < numActive; i++ )
+                    {
+                        evalPtr[pointIds[i]] = static_cast<OT>( values[e][i]*multiplier[i] );
+                    }
+                }
+            }
 
-                inPtr0 += inInc0;
-                outPtr0 += outInc0;
+            // Measures, from the eigen values of the row
+            for( int m = VTK_EIGEN_ELEMENTS_FIRST_MEASURE; m < VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS; m++ )
+            {
+                OT *measurePtr = outPtr[m];
+                if( !measurePtr )
+                {
+                    continue;
+                }
+                for( vtkIdType i = 0; i < numActive; i++ )
+                {
+                    double l1 = values[0][i], l2 = values[1][i], l3 = values[2][i];
+                    double measure;
+                    switch( m )
+                    {
+                    case VTK_EIGEN_ELEMENTS_FIRST_MEASURE:
+                        measure = vtkImageEigenElementsFractionalAnisotropy( l1, l2, l3 );
+                        break;
+                    case VTK_EIGEN_ELEMENTS_FIRST_MEASURE + 1:
+                        measure = vtkImageEigenElementsLinearity( l1, l2, l3 );
+                        break;
+                    case VTK_EIGEN_ELEMENTS_FIRST_MEASURE + 2:
+                        measure = vtkImageEigenElementsPlanarity( l1, l2, l3 );
+                        break;
+                    default:
+                        measure = vtkImageEigenElementsVesselness( l1, l2, l3, alpha, beta, c, bright );
+                        break;
+                    }
+                    measurePtr[pointIds[i]] = static_cast<OT>( measure*multiplier[i] );
+                }
             }
 
             inPtr1 += inInc1;
-            outPtr1 += outInc1;
         }
 
         inPtr2 += inInc2;
-        outPtr2 += outInc2;
     }
-    for( int i = 0; i< 3; i++)
+}
+
+//----------------------------------------------------------------------------
+// Switch on the input scalar type for a given output type.
+template <class OT>
+void vtkImageEigenElementsDispatch(vtkImageEigenElements *self,
+                                   vtkImageData *inData, void *inPtr,
+                                   vtkImageData *outData, OT *outPtr[10],
+                                   vtkImageEigenElementsCompact *compact,
+                                   int outExt[6], int id)
+{
+    switch (inData->GetScalarType())
     {
-        delete matrix[i];
-        delete evect[i];
+        vtkTemplateMacro(
+            vtkImageEigenElementsExecute(self,
+                                         inData, static_cast<VTK_TT *>(inPtr),
+                                         outData, outPtr, compact, outExt, id));
+
+    default:
+        vtkErrorWithObjectMacro(self, << "Execute: Unknown ScalarType");
+        return;
     }
-    delete eval;
 }
 
 //----------------------------------------------------------------------------
@@ -309,28 +978,65 @@ void vtkImageEigenElementsExecute(vtkImageEigenElements *self,
 // It hanldes image boundaries, so the image does not shrink.
 void vtkImageEigenElements::ThreadedRequestData(
     vtkInformation *vtkNotUsed(request),
-    vtkInformationVector **inputVector,
+    vtkInformationVector **vtkNotUsed(inputVector),
     vtkInformationVector *vtkNotUsed(outputVector),
     vtkImageData ***inData,
     vtkImageData **outData,
     int outExt[6], int id)
 {
     void *inPtr = inData[0][0]->GetScalarPointerForExtent(outExt);
-    void *outPtr = outData[0]->GetScalarPointerForExtent(outExt);
-
-    vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
 
+    // The arrays are those of the image, or of the compact output where the
+    // piece starts at the first active voxel of its first slice.
+    vtkImageEigenElementsInternals *internals = this->Internals;
+    vtkPointData *outPD = outData[0]->GetPointData( );
+    vtkImageEigenElementsCompact compact;
+    vtkImageEigenElementsCompact *compactPtr = 0;
+    if( internals->Compact )
+    {
+        int axis = internals->SplitAxis;
+        outPD = internals->Compact->GetPointData( );
+        compact.Points = static_cast<float *>( internals->Compact->GetPoints( )->GetVoidPointer( 0 ) );
+        compact.VoxelIndex = static_cast<int *>( outPD->GetArray( "VoxelIndex" )->GetVoidPointer( 0 ) );
+        compact.FirstId = internals->Offsets[outExt[2*axis] - internals->Extent[2*axis]];
+        compactPtr = &compact;
+    }
 
-    switch (inData[0][0]->GetScalarType())
+    // Base pointers of the requested output arrays, 0 for the others
+    void *outPtr[VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS];
+    for( int i = 0; i < VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS; i++ )
     {
-        vtkTemplateMacro(
-            vtkImageEigenElementsExecute(this,
-                                         inData[0][0], static_cast<VTK_TT *>(inPtr),
-                                         outData[0], static_cast<double *>(outPtr),
-                                         outExt, id, inInfo));
+        vtkDataArray *array = outPD->GetArray( vtkImageEigenElementsNames[i] );
+        outPtr[i] = this->GetOutputNumberOfComponents( i ) && array ?
+                    array->GetVoidPointer( 0 ) : 0;
+    }
 
+    switch (outPD->GetScalars( )->GetDataType( ))
+    {
+    case VTK_DOUBLE:
+    {
+        double *doublePtr[VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS];
+        for( int i = 0; i < VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS; i++ )
+        {
+            doublePtr[i] = static_cast<double *>( outPtr[i] );
+        }
+        vtkImageEigenElementsDispatch(this, inData[0][0], inPtr,
+                                      outData[0], doublePtr, compactPtr, outExt, id);
+        break;
+    }
+    case VTK_FLOAT:
+    {
+        float *floatPtr[VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS];
+        for( int i = 0; i < VTK_EIGEN_ELEMENTS_NUMBER_OF_OUTPUTS; i++ )
+        {
+            floatPtr[i] = static_cast<float *>( outPtr[i] );
+        }
+        vtkImageEigenElementsDispatch(this, inData[0][0], inPtr,
+                                      outData[0], floatPtr, compactPtr, outExt, id);
+        break;
+    }
     default:
-        vtkErrorMacro(<< "Execute: Unknown ScalarType");
+        vtkErrorMacro(<< "Execute: Unsupported output ScalarType");
         return;
     }
 }
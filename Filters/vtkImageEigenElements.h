@@ -31,9 +31,35 @@
 //!    M13 M23 M33
 //!
 //!
-//! The output will provide 6 arrays containing the eigen elements of the
-//! input tensor. The vectors and eigen values are multiplied with mask values
-//! to ensure that eigen elements are computed from non valid tensors.
+//! The output will provide up to 6 arrays containing the eigen elements of
+//! the input tensor: MaxEigenVector, MaxEigenValue, MedEigenVector,
+//! MedEigenValue, MinEigenVector and MinEigenValue. Each one is computed only
+//! if requested (all by default); the first of them in this order is the
+//! active scalars. The arrays are stored as double (default) or float.
+//!
+//! Scalar measures of the eigen values l1 >= l2 >= l3 can be output as well,
+//! computed in the same pass without storing the eigen values:
+//! - FractionalAnisotropy: sqrt(3/2) |l - mean(l)| / |l|
+//! - Linearity: (l1 - l2) / l1 and Planarity: (l2 - l3) / l1 (Westin), for
+//!   positive semi-definite tensors; 0 where l1 <= 0.
+//! - Vesselness: Frangi's measure of tubular structures, on the eigen values
+//!   sorted by magnitude |a1| <= |a2| <= |a3|. It is 0 unless a2 and a3 are
+//!   negative (bright vessels, default) or positive (dark vessels), else
+//!   (1 - exp(-Ra^2/2Alpha^2)) exp(-Rb^2/2Beta^2) (1 - exp(-S^2/2C^2)) with
+//!   Ra = |a2|/|a3|, Rb = |a1|/sqrt(|a2 a3|) and S = |a|. The last factor is
+//!   omitted if C is 0 (default).
+//!
+//! With UseMask, the voxels whose mask component is 0 are skipped: their
+//! outputs are 0. The vectors, eigen values and measures of the others are
+//! multiplied with the mask values. The update extent is then split among
+//! the threads by number of active voxels rather than by size, so that a
+//! mask covering a small part of the volume keeps all the threads busy.
+//!
+//! With CompactOutput, the active voxels (all of them without mask) are
+//! output as a point list on the second output port instead of the image:
+//! one vertex at each voxel position, its VoxelIndex (ijk) and the requested
+//! arrays, in the order of the voxels in the image. The image output then
+//! has no array.
 //!
 //! \author Jerome Velut
 //! \date mar 2011
@@ -41,15 +67,18 @@
 #ifndef __vtkImageEigenElements_h
 #define __vtkImageEigenElements_h
 
-#include "vtkThreadedImageAlgorithm.h"
+#include "vtkThreadedImageExtentAlgorithm.h"
 
-class VTK_EXPORT vtkImageEigenElements : public vtkThreadedImageAlgorithm
+class vtkPolyData;
+class vtkImageEigenElementsInternals;
+
+class VTK_EXPORT vtkImageEigenElements : public vtkThreadedImageExtentAlgorithm
 {
 public:
     // Description:
     // Construct an instance of vtkImageEigenElements filter.
     static vtkImageEigenElements *New();
-    vtkTypeMacro(vtkImageEigenElements,vtkThreadedImageAlgorithm);
+    vtkTypeMacro(vtkImageEigenElements,vtkThreadedImageExtentAlgorithm);
     void PrintSelf(ostream& os, vtkIndent indent);
 
     //! map the input component to the tensor index
@@ -63,6 +92,77 @@ public:
     vtkSetMacro( InMask, int );
     vtkGetMacro( InMask, int );
 
+    //! Output the active voxels as a point list on the second output port
+    //! instead of the image (see the class documentation)
+    vtkSetMacro( CompactOutput, int );
+    vtkGetMacro( CompactOutput, int );
+    vtkBooleanMacro( CompactOutput, int );
+
+    //! Point list of the active voxels, on the second output port
+    vtkPolyData* GetPointListOutput( );
+
+    //! Select the eigen elements to output
+    vtkSetMacro( ComputeMaxEigenVector, int );
+    vtkGetMacro( ComputeMaxEigenVector, int );
+    vtkBooleanMacro( ComputeMaxEigenVector, int );
+    vtkSetMacro( ComputeMaxEigenValue, int );
+    vtkGetMacro( ComputeMaxEigenValue, int );
+    vtkBooleanMacro( ComputeMaxEigenValue, int );
+    vtkSetMacro( ComputeMedEigenVector, int );
+    vtkGetMacro( ComputeMedEigenVector, int );
+    vtkBooleanMacro( ComputeMedEigenVector, int );
+    vtkSetMacro( ComputeMedEigenValue, int );
+    vtkGetMacro( ComputeMedEigenValue, int );
+    vtkBooleanMacro( ComputeMedEigenValue, int );
+    vtkSetMacro( ComputeMinEigenVector, int );
+    vtkGetMacro( ComputeMinEigenVector, int );
+    vtkBooleanMacro( ComputeMinEigenVector, int );
+    vtkSetMacro( ComputeMinEigenValue, int );
+    vtkGetMacro( ComputeMinEigenValue, int );
+    vtkBooleanMacro( ComputeMinEigenValue, int );
+
+    //! Select the measures to output (none by default)
+    vtkSetMacro( ComputeFractionalAnisotropy, int );
+    vtkGetMacro( ComputeFractionalAnisotropy, int );
+    vtkBooleanMacro( ComputeFractionalAnisotropy, int );
+    vtkSetMacro( ComputeLinearity, int );
+    vtkGetMacro( ComputeLinearity, int );
+    vtkBooleanMacro( ComputeLinearity, int );
+    vtkSetMacro( ComputePlanarity, int );
+    vtkGetMacro( ComputePlanarity, int );
+    vtkBooleanMacro( ComputePlanarity, int );
+    vtkSetMacro( ComputeVesselness, int );
+    vtkGetMacro( ComputeVesselness, int );
+    vtkBooleanMacro( ComputeVesselness, int );
+
+    //! Parameters of the vesselness (see the class documentation)
+    vtkSetMacro( VesselnessAlpha, double );
+    vtkGetMacro( VesselnessAlpha, double );
+    vtkSetMacro( VesselnessBeta, double );
+    vtkGetMacro( VesselnessBeta, double );
+    vtkSetMacro( VesselnessC, double );
+    vtkGetMacro( VesselnessC, double );
+    vtkSetMacro( BrightVessels, int );
+    vtkGetMacro( BrightVessels, int );
+    vtkBooleanMacro( BrightVessels, int );
+
+    //! Scalar type of the output arrays: VTK_DOUBLE (default) or VTK_FLOAT.
+    vtkSetMacro( OutputScalarType, int );
+    vtkGetMacro( OutputScalarType, int );
+    void SetOutputScalarTypeToDouble( ) {this->SetOutputScalarType( VTK_DOUBLE );}
+    void SetOutputScalarTypeToFloat( ) {this->SetOutputScalarType( VTK_FLOAT );}
+
+    //! Compute the eigen elements of n tensors stored component-wise:
+    //! tensor[c][i] is the component c (M11, M12, M13, M22, M23, M33) of the
+    //! i-th tensor. The eigen values are stored in decreasing order in
+    //! values[e][i], and the component c of the corresponding eigen vectors
+    //! in vectors[3*e+c][i]. The closed form solution is used, except for
+    //! the nearly degenerate tensors that are solved with vtkMath::Jacobi.
+    //! The vectors are oriented as by vtkMath::Jacobi. If vectors is 0, only
+    //! the eigen values are computed.
+    static void ComputeEigenElements( vtkIdType n, double* const tensor[6],
+                                      double* const values[3], double* const vectors[9] );
+
 protected:
     vtkImageEigenElements();
     ~vtkImageEigenElements();
@@ -80,6 +180,22 @@ protected:
                                    vtkInformationVector** inputVector,
                                    vtkInformationVector* outputVector);
 
+    virtual int FillOutputPortInformation( int port, vtkInformation* info );
+
+    //! With a mask or a compact output, split the update extent in slabs of
+    //! about the same number of active voxels
+    virtual int SplitExtent( int splitExt[6], int startExt[6], int num, int total );
+
+    //! Allocate the requested output arrays and run the threads
+    virtual int RequestData(vtkInformation* request,
+                            vtkInformationVector** inputVector,
+                            vtkInformationVector* outputVector);
+
+    //! Number of components of the i-th output array (eigen elements then
+    //! measures, in the order of the class documentation), 0 if it is not
+    //! requested
+    int GetOutputNumberOfComponents( int i );
+
     char* OutputDataName;
 
 private:
@@ -92,8 +208,25 @@ private:
     int inM22; //!< input component corresponding to tensor index
     int inM23; //!< input component corresponding to tensor index
     int inM33; //!< input component corresponding to tensor index
-    int UseMask; //!< if 1, the eigen elements are multiplied with the mask defined in InMask
+    int UseMask; //!< if 1, the voxels out of the mask defined in InMask are skipped and the others multiplied with it
     int InMask; //!< tell which input component to use as a output multiplier
+    int CompactOutput; //!< if 1, the active voxels are output as a point list
+    int ComputeMaxEigenVector; //!< if 1, MaxEigenVector is output
+    int ComputeMaxEigenValue; //!< if 1, MaxEigenValue is output
+    int ComputeMedEigenVector; //!< if 1, MedEigenVector is output
+    int ComputeMedEigenValue; //!< if 1, MedEigenValue is output
+    int ComputeMinEigenVector; //!< if 1, MinEigenVector is output
+    int ComputeMinEigenValue; //!< if 1, MinEigenValue is output
+    int ComputeFractionalAnisotropy; //!< if 1, FractionalAnisotropy is output
+    int ComputeLinearity; //!< if 1, Linearity is output
+    int ComputePlanarity; //!< if 1, Planarity is output
+    int ComputeVesselness; //!< if 1, Vesselness is output
+    double VesselnessAlpha; //!< sensitivity to the plate/line ratio Ra
+    double VesselnessBeta; //!< sensitivity to the blob/line ratio Rb
+    double VesselnessC; //!< sensitivity to the structure norm S (0: not used)
+    int BrightVessels; //!< if 1, vessels are brighter than the background
+    int OutputScalarType; //!< double or float
+    vtkImageEigenElementsInternals *Internals; //!< active voxels of the update extent
 };
 
 #endif //__vtkImageEigenElements_h
@@ -32,9 +32,39 @@
 #include "vtkCellData.h"
 #include "vtkPolyData.h"
 #include "vtkPointSet.h"
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "vtkMultiThreader.h"
+
+#include <math.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 vtkStandardNewMacro(vtkImageLocalConvolution);
 
+//----------------------------------------------------------------------------
+// Shifted kernels of the linear mode, kept between executions and computed
+// again only when the kernel image or SubVoxelDivisions change, and the
+// order of the sites, kept while the topology of the sites is unchanged.
+class vtkImageLocalConvolutionInternals
+{
+public:
+  //! 1 if Order holds the order of sites of the key below
+  int HasOrder;
+  vtkIdType OrderSize; //!< number of sites
+  unsigned long OrderTime; //!< topology time of the sites
+  //! Site ids along the Z-order curve of their voxels
+  std::vector<vtkIdType> Order;
+  //! 1 if ShiftedKernels hold the kernels of the key below
+  int Prepared;
+  unsigned long KernelTime; //!< MTime of the kernel image
+  int SubVoxelDivisions;
+  //! Kernels shifted by each sub-voxel offset of the lattice, one after the
+  //! other, the offset along x varying first
+  std::vector<double> ShiftedKernels;
+};
+
 //----------------------------------------------------------------------------
 // Construct an instance of vtkImageLocalConvolution filter.
 // Default kernel is : 3 components 3-D. The first and third
@@ -43,6 +73,15 @@ vtkImageLocalConvolution::vtkImageLocalConvolution()
 {
   this->OutputDataName = 0;
   this->NormalizedIntensitiesOff( );
+  this->UseReciprocalSpacingOff( );
+  this->InterpolationMode = VTK_LOCAL_CONVOLUTION_NEAREST;
+  this->SubVoxelDivisions = 4;
+  this->Internals = new vtkImageLocalConvolutionInternals;
+  this->Internals->Prepared = 0;
+  this->Internals->HasOrder = 0;
+  this->SortSitesOn( );
+  this->Threader = vtkMultiThreader::New( );
+  this->NumberOfThreads = this->Threader->GetNumberOfThreads( );
   this->SetNumberOfInputPorts( 3 );
 }
 
@@ -50,12 +89,20 @@ vtkImageLocalConvolution::vtkImageLocalConvolution()
 // Destructor
 vtkImageLocalConvolution::~vtkImageLocalConvolution()
 {
+  this->Threader->Delete( );
+  delete this->Internals;
 }
 
 //----------------------------------------------------------------------------
 void vtkImageLocalConvolution::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "UseReciprocalSpacing: " << this->UseReciprocalSpacing << "\n";
+  os << indent << "InterpolationMode: " << this->InterpolationMode << "\n";
+  os << indent << "SubVoxelDivisions: " << this->SubVoxelDivisions << "\n";
+  os << indent << "SortSites: " << this->SortSites << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -141,33 +188,141 @@ int vtkImageLocalConvolution::FillOutputPortInformation(int port, vtkInformation
  return 1;
 }
 
-template <class T>
-void vtkImageLocalConvolutionExecute(vtkImageLocalConvolution *self,
-                              vtkInformationVector **inputVector, T* inPtr,
-                              vtkInformationVector *outputVector)
+//----------------------------------------------------------------------------
+struct vtkImageLocalConvolutionThreadStruct
 {
-  // get the info objects
-  vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
-  vtkInformation *imageInfo = inputVector[1]->GetInformationObject(0);
-  vtkInformation *kernelInfo = inputVector[2]->GetInformationObject(0);
-  vtkInformation *outInfo = outputVector->GetInformationObject(0);
+  vtkImageLocalConvolution *Filter;
+  vtkPoints *Sites;
+  void *SitesPtr; //!< coordinates of the sites, if they are float or double
+  //! Order in which the sites are traversed, or 0 for the order of their ids
+  const vtkIdType *Order;
+  vtkImageData *Image;
+  vtkIdType Increments[3];
+  double Origin[3];
+  //! Spacing of the image, or its reciprocal if UseReciprocalSpacing is on
+  double Scale[3];
+  int UseReciprocalSpacing;
+  int Linear; //!< 1 if the image is interpolated at the sites
+  int Divisions; //!< sub-voxel offsets per axis in linear mode
+  //! Voxel of the sites whose window starts at the first voxel of the image
+  int Start[3];
+  //! Extent of the voxels of the sites whose window is inside the image
+  int Bounds[6];
+  vtkImageData *Kernel;
+  int WindowSize[3]; //!< size of the window of voxels weighted at each site
+  double *Kernels; //!< kernel, or the shifted kernels in linear mode
+  vtkIdType KernelStride; //!< values between two shifted kernels
+  //! Sum of the weights of each component of each kernel, for the
+  //! NormalizedIntensities mode
+  double *KernelSums;
+  double *OutPtr;
+  //! Number of sites outside the image met by each thread, and the lowest id
+  vtkIdType NumberOfOutsideSites[VTK_MAX_THREADS];
+  vtkIdType FirstOutsideSite[VTK_MAX_THREADS];
+};
+
+// Number of sites located together, before their convolution
+static const vtkIdType vtkImageLocalConvolutionBlockSize = 256;
 
-  // get the inputs and ouptut
-  vtkImageData *image = vtkImageData::SafeDownCast(
-    imageInfo->Get(vtkDataObject::DATA_OBJECT()));
-  vtkImageData *kernelImage = vtkImageData::SafeDownCast(
-    kernelInfo->Get(vtkDataObject::DATA_OBJECT()));
-  vtkPointSet *input = vtkPointSet::SafeDownCast(
-    inInfo->Get(vtkDataObject::DATA_OBJECT()));
+//----------------------------------------------------------------------------
+// Offsets in the image scalars of the windows of num sites, the sites
+// [begin, begin+num[ or the sites ids[0..num[, or -1 for the
+// sites whose window is not inside the image, and their shifted kernels.
+// In nearest mode the voxel of a site is the nearest one, computed from the
+// origin and spacing as vtkImageData::FindPoint does. In linear mode it is
+// the voxel below the site, and the sub-voxel offset of the site is rounded
+// to the lattice of the shifted kernels.
+template <class P>
+void vtkImageLocalConvolutionLocate(vtkImageLocalConvolutionThreadStruct *str,
+                                    const P* pts, vtkIdType begin, vtkIdType num,
+                                    const vtkIdType *ids, vtkIdType *offsets,
+                                    vtkIdType *kernelIds)
+{
+  for( vtkIdType n = 0; n < num; n++ )
+  {
+     const P* pt = pts + 3 * ( ids ? ids[n] : begin + n );
+     vtkIdType offset = 0, kernelId = 0, kernelIdStride = 1;
+     for( int axis = 0; axis < 3; axis++ )
+     {
+        double d = static_cast<double>( pt[axis] ) - str->Origin[axis];
+        double t = str->UseReciprocalSpacing ? d * str->Scale[axis]
+                                             : d / str->Scale[axis];
+        double loc, shift = 0;
+        if( str->Linear )
+        {
+           loc = floor( t );
+           shift = floor( ( t - loc ) * str->Divisions + 0.5 );
+           if( shift == str->Divisions )
+           {
+              loc += 1;
+              shift = 0;
+           }
+        }
+        else
+        {
+           loc = floor( t + 0.5 );
+        }
+        // written to send NaN coordinates outside too
+        if( !( loc >= str->Bounds[axis*2] && loc <= str->Bounds[axis*2 + 1] ) )
+        {
+           offset = -1;
+           break;
+        }
+        offset += ( static_cast<vtkIdType>( loc ) - str->Start[axis] )
+                  * str->Increments[axis];
+        kernelId += static_cast<vtkIdType>( shift ) * kernelIdStride;
+        kernelIdStride *= str->Divisions;
+     }
+     offsets[n] = offset;
+     kernelIds[n] = kernelId;
+  }
+}
 
-  vtkPointSet *output = vtkPointSet::SafeDownCast(
-    outInfo->Get(vtkDataObject::DATA_OBJECT()));
+//----------------------------------------------------------------------------
+// Locates the sites [begin, begin+num[ of the traversal order. Float and
+// double coordinates are read in place, the other types one site at a time.
+static void vtkImageLocalConvolutionLocateSites(vtkImageLocalConvolutionThreadStruct *str,
+                                                vtkIdType begin, vtkIdType num,
+                                                vtkIdType *offsets, vtkIdType *kernelIds)
+{
+  const vtkIdType *ids = str->Order ? str->Order + begin : 0;
+  switch( str->Sites->GetDataType( ) )
+  {
+    case VTK_FLOAT:
+      vtkImageLocalConvolutionLocate( str, static_cast<float*>( str->SitesPtr ),
+                                      begin, num, ids, offsets, kernelIds );
+      break;
+    case VTK_DOUBLE:
+      vtkImageLocalConvolutionLocate( str, static_cast<double*>( str->SitesPtr ),
+                                      begin, num, ids, offsets, kernelIds );
+      break;
+    default:
+      for( vtkIdType n = 0; n < num; n++ )
+      {
+         double point[3];
+         str->Sites->GetPoint( ids ? ids[n] : begin + n, point );
+         vtkImageLocalConvolutionLocate( str, point, 0, 1, static_cast<vtkIdType*>( 0 ),
+                                         offsets + n, kernelIds + n );
+      }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Convolution at the sites [begin, end[ of the traversal order, written in
+// their own output tuples.
+// The sites whose window is not inside the image are set to 0 and counted
+// for the thread.
+template <class T>
+void vtkImageLocalConvolutionExecute(vtkImageLocalConvolution *self,
+                                     vtkImageLocalConvolutionThreadStruct *str,
+                                     T* inPtr, vtkIdType begin, vtkIdType end,
+                                     int threadId)
+{
+  vtkImageData *kernelImage = str->Kernel;
 
   // For looping though output (and input) pixels.
   vtkIdType inInc0, inInc1, inInc2;
   double *localOutput;
-  int numComps;
-  numComps = image->GetNumberOfScalarComponents();
   
   // For looping through hood pixels
   int hoodMin0, hoodMax0, hoodMin1, hoodMax1, hoodMin2, hoodMax2;
@@ -175,222 +330,484 @@ void vtkImageLocalConvolutionExecute(vtkImageLocalConvolution *self,
   T *hoodPtr0, *hoodPtr1, *hoodPtr2, *localInPtr;
 
   // For looping through the kernel, and compute the kernel result
-  int kernelIdx, kernelIdxC, kernelNumComps, *kernelSize, kernelMiddle[3];
-  double sum;
+  int kernelIdx, kernelIdxC, kernelNumComps;
+  double *kernel;
   kernelNumComps = kernelImage->GetNumberOfScalarComponents( );
-  localOutput = new double[kernelNumComps];
-  kernelSize = kernelImage->GetDimensions();
-  // Get the kernel. 
-  double *kernel = static_cast<double*>( kernelImage->GetScalarPointer( ) );
+  // Sums of the thread, written once to the output tuple of each site
+  std::vector<double> sums( kernelNumComps );
+  int normalized = self->GetNormalizedIntensities( );
   
   // Get information to march through data
-  image->GetIncrements(inInc0, inInc1, inInc2);
+  inInc0 = str->Increments[0];
+  inInc1 = str->Increments[1];
+  inInc2 = str->Increments[2];
   
-  kernelMiddle[0] = kernelSize[0] / 2;
-  kernelMiddle[1] = kernelSize[1] / 2;
-  kernelMiddle[2] = kernelSize[2] / 2;
-
-  hoodMin0 = -kernelMiddle[0];
-  hoodMin1 = -kernelMiddle[1];
-  hoodMin2 = -kernelMiddle[2];
-
-  hoodMax0 = hoodMin0 + kernelSize[0] - 1;
-  hoodMax1 = hoodMin1 + kernelSize[1] - 1;
-  hoodMax2 = hoodMin2 + kernelSize[2] - 1;
+  // The window starts at the offset of the site
+  hoodMin0 = 0;
+  hoodMin1 = 0;
+  hoodMin2 = 0;
+
+  hoodMax0 = str->WindowSize[0] - 1;
+  hoodMax1 = str->WindowSize[1] - 1;
+  hoodMax2 = str->WindowSize[2] - 1;
   
-  // Handle boundaries : change temporarily the image extent for 
-  // the FindPoint function : if the convolution place is inside the 
-  // boundary (ie 'image border' - kernelSize/2 ), the execution abort
-  //! \bug it seems that FindPoint does not handle boundaries...
-  int* imageExtent = image->GetExtent( );
-  int tempExtent[6];
-  for( int comp = 0; comp < 3; comp++ )
+  vtkIdType offsets[vtkImageLocalConvolutionBlockSize];
+  vtkIdType kernelIds[vtkImageLocalConvolutionBlockSize];
+  vtkIdType progressInterval = ( end - begin ) / ( 50 * vtkImageLocalConvolutionBlockSize ) + 1;
+  vtkIdType blockCount = 0;
+
+  // Loop over the blocks of sites of the thread
+  for( vtkIdType blockBegin = begin; blockBegin < end && !self->AbortExecute;
+       blockBegin += vtkImageLocalConvolutionBlockSize, blockCount++ )
   {
-     tempExtent[comp*2]= imageExtent[comp*2] + kernelMiddle[comp] + 1;
-     tempExtent[comp*2 + 1] = imageExtent[comp*2 + 1] - kernelMiddle[comp] - 1;
-  }
-  //image->SetUpdateExtent( tempExtent );
-  
-  // Prepare output
-  vtkPoints *outPoints = vtkPoints::New( );
-  vtkDoubleArray* outData = vtkDoubleArray::New( );
-  outData->SetNumberOfComponents( kernelNumComps );
-
-  // Loop over input points
-  for( int ptId = 0; ptId < input->GetPoints( )->GetNumberOfPoints( ); ptId++ )
-  {
-     double* point = input->GetPoint( ptId );
-     vtkIdType imagePtId = image->FindPoint( point );
-
-     int gridLoc[3];
-     self->GetGridLocation( image, imagePtId, gridLoc );
-     
-     if( imagePtId < 0 ) 
+   if( threadId == 0 && blockCount % progressInterval == 0 )
+   {
+      self->UpdateProgress( ( blockBegin - begin ) / static_cast<double>( end - begin ) );
+   }
+
+   vtkIdType blockEnd = blockBegin + vtkImageLocalConvolutionBlockSize;
+   if( blockEnd > end )
+   {
+      blockEnd = end;
+   }
+   vtkImageLocalConvolutionLocateSites( str, blockBegin, blockEnd - blockBegin, offsets,
+                                        kernelIds );
+
+   for( vtkIdType ptId = blockBegin; ptId < blockEnd; ptId++ )
+   {
+     // results are scattered back to the tuple of the site
+     vtkIdType siteId = str->Order ? str->Order[ptId] : ptId;
+     localOutput = str->OutPtr + siteId * kernelNumComps;
+     if( offsets[ptId - blockBegin] < 0 )
      {
-        vtkErrorWithObjectMacro(self, <<"Convolution site is outside the image ( "
-                                      <<  point[0] << ", "
-                                      <<  point[1] << ", "
-                                      <<  point[2] << " )" );
+        if( str->NumberOfOutsideSites[threadId]++ == 0
+            || siteId < str->FirstOutsideSite[threadId] )
+        {
+           str->FirstOutsideSite[threadId] = siteId;
+        }
         for( int i = 0; i < kernelNumComps ; i++ )
            localOutput[i] = 0;
+        continue;
      }
-     else if(    gridLoc[0] < tempExtent[0] || gridLoc[0] > tempExtent[1]
-              || gridLoc[1] < tempExtent[2] || gridLoc[1] > tempExtent[3]
-              || gridLoc[2] < tempExtent[4] || gridLoc[2] > tempExtent[5] )
+
+     // initialize the data pointer to the point position
+     localInPtr = inPtr + offsets[ptId - blockBegin];
+     kernel = str->Kernels + kernelIds[ptId - blockBegin] * str->KernelStride;
+
+     // Single pass through the window: the weighted sums of all the kernel
+     // components, and the min and max values if NormalizedIntensities is on
+     double *sum = &sums[0];
+     for (kernelIdxC = 0; kernelIdxC < kernelNumComps; ++kernelIdxC)
      {
-        vtkErrorWithObjectMacro(self, <<"Convolution site is outside the image ( "
-                                      <<  point[0] << ", "
-                                      <<  point[1] << ", "
-                                      <<  point[2] << " )" );
-        for( int i = 0; i < kernelNumComps ; i++ )
-           localOutput[i] = 0;
+        sum[kernelIdxC] = 0;
      }
-     else 
+     double min = *localInPtr, max = *localInPtr;
+     hoodPtr2 = localInPtr;
+     kernelIdx = 0;
+
+     for (hoodIdx2 = hoodMin2; hoodIdx2 <= hoodMax2; ++hoodIdx2)
      {
-      
-         // initialize the data pointer to the point position
-         localInPtr = inPtr + imagePtId * image->GetNumberOfScalarComponents( );
-   
-         // loop through kernel components
-         for (kernelIdxC = 0; kernelIdxC < kernelNumComps; ++kernelIdxC)
-         {
-            // Inner loop where we compute the kernel
-            // Set the sum to zero
-            sum = 0;
-            T min = 0, max = 1;
-
-
-            // If NormizedIntensities is On, pre-loop through neighbors
-            // to find min and max values
-
-            if( self->GetNormalizedIntensities( ) )
-            {
-               hoodPtr2 = localInPtr - kernelMiddle[0] * inInc0 
-                                    - kernelMiddle[1] * inInc1 
-                                    - kernelMiddle[2] * inInc2;
-               min = *hoodPtr2;
-               max = *hoodPtr2;
-
-               for (hoodIdx2 = hoodMin2; hoodIdx2 <= hoodMax2; ++hoodIdx2)
-               {
-                  hoodPtr1 = hoodPtr2;
-                     
-                  for (hoodIdx1 = hoodMin1; hoodIdx1 <= hoodMax1; ++hoodIdx1)
-                  {
-                     hoodPtr0 = hoodPtr1;
-                  
-                     for (hoodIdx0 = hoodMin0; hoodIdx0 <= hoodMax0; ++hoodIdx0)
-                     {
-                        if( *hoodPtr0 > max )
-                           max = *hoodPtr0;
-                        if( *hoodPtr0 < min )
-                           min = *hoodPtr0;
-                  
-                        hoodPtr0 += inInc0;
-                     }
-                  
-                     hoodPtr1 += inInc1;
-                  }
-                  
-                     hoodPtr2 += inInc2;
-               }
-               if( min == max ) // constant image!! don't performed the normalization
-               {
-                  min = 0;
-                  max = 1;
-               }
-            }
-            // loop through neighborhood pixels
-            hoodPtr2 = localInPtr - kernelMiddle[0] * inInc0 
-                                 - kernelMiddle[1] * inInc1 
-                                 - kernelMiddle[2] * inInc2;
-
-            // Set the kernel index to the starting position
-            // according to the current component
-            kernelIdx = kernelIdxC;
-
-            for (hoodIdx2 = hoodMin2; hoodIdx2 <= hoodMax2; ++hoodIdx2)
-            {
-               hoodPtr1 = hoodPtr2;
-                  
-               for (hoodIdx1 = hoodMin1; hoodIdx1 <= hoodMax1; ++hoodIdx1)
-               {
-                  hoodPtr0 = hoodPtr1;
-               
-                  for (hoodIdx0 = hoodMin0; hoodIdx0 <= hoodMax0; ++hoodIdx0)
-                  {
-                     // update the convolution sum.
-                     sum += (*hoodPtr0 - min)/(max-min) * kernel[kernelIdx];
-               
-                     // Take the next position in the kernel
-                     kernelIdx += kernelNumComps;
-                     hoodPtr0 += inInc0;
-                  }
-               
-                  hoodPtr1 += inInc1;
-               }
-               
-                  hoodPtr2 += inInc2;
-            }
-            // Set the output to the correct value
-            localOutput[kernelIdxC] = sum;
-         } // End loop through kernel comp
-      }
-      outPoints->InsertNextPoint( input->GetPoints( )->GetPoint( ptId ) );
-      outData->InsertNextTuple( localOutput );
+        hoodPtr1 = hoodPtr2;
+           
+        for (hoodIdx1 = hoodMin1; hoodIdx1 <= hoodMax1; ++hoodIdx1)
+        {
+           hoodPtr0 = hoodPtr1;
+        
+           for (hoodIdx0 = hoodMin0; hoodIdx0 <= hoodMax0; ++hoodIdx0)
+           {
+              double value = *hoodPtr0;
+              if( normalized )
+              {
+                 if( value > max )
+                    max = value;
+                 if( value < min )
+                    min = value;
+              }
+
+              // update the convolution sums.
+              for (kernelIdxC = 0; kernelIdxC < kernelNumComps; ++kernelIdxC)
+              {
+                 sum[kernelIdxC] += value * kernel[kernelIdx++];
+              }
+              hoodPtr0 += inInc0;
+           }
+        
+           hoodPtr1 += inInc1;
+        }
+        
+           hoodPtr2 += inInc2;
+     }
+
+     // The sum of w * (I - min) / (max - min) is computed from the sum of w * I
+     // and the sum of the weights w. A constant window is not normalized.
+     if( normalized && min != max )
+     {
+        double *weightSums = str->KernelSums + kernelIds[ptId - blockBegin] * kernelNumComps;
+        for (kernelIdxC = 0; kernelIdxC < kernelNumComps; ++kernelIdxC)
+        {
+           sum[kernelIdxC] = ( sum[kernelIdxC] - min * weightSums[kernelIdxC] ) / ( max - min );
+        }
+     }
+
+     // Set the output to the correct value
+     for (kernelIdxC = 0; kernelIdxC < kernelNumComps; ++kernelIdxC)
+     {
+        localOutput[kernelIdxC] = sum[kernelIdxC];
+     }
    }// End loop over input points
-   
-   // The image has been temporarily shrinked for handling of boundaries.
-   // Now get back to the original extent.
-   //image->SetUpdateExtent( imageExtent );
-   
-   // output has new points and data.
-   output->SetPoints( outPoints );
-   output->GetPointData( )->DeepCopy( input->GetPointData( ) );
-   output->GetPointData( )->AddArray( outData );
-   outData->SetName( self->GetOutputDataName( ) );
-
-   output->GetCellData( )->DeepCopy( input->GetCellData( ) );
-   
-   delete localOutput;
-   outPoints->Delete( );
-   outData->Delete( );
-   
-   return;
+  }// End loop over blocks
 }
 
 //----------------------------------------------------------------------------
-// This method contains the first switch statement that calls the correct
-// templated function for the input and output Data types.
+// Shifted kernels of the linear mode. The image interpolated at a sub-voxel
+// offset f is a weighted sum of the 8 voxels around, so the kernel applied
+// to it is the same as the kernel spread over these 8 corners, with the
+// trilinear weights of f, applied to a window one voxel larger on each axis.
+static void vtkImageLocalConvolutionShiftKernels(vtkImageData *kernelImage,
+                                                 int divisions,
+                                                 std::vector<double>& kernels)
+{
+  int size[3], window[3];
+  kernelImage->GetDimensions( size );
+  int numComps = kernelImage->GetNumberOfScalarComponents( );
+  double *kernel = static_cast<double*>( kernelImage->GetScalarPointer( ) );
+  window[0] = size[0] + 1;
+  window[1] = size[1] + 1;
+  window[2] = size[2] + 1;
+  vtkIdType stride = static_cast<vtkIdType>( window[0] ) * window[1] * window[2] * numComps;
+
+  kernels.assign( stride * divisions * divisions * divisions, 0.0 );
+  double *shifted = &kernels[0];
+  for( int qz = 0; qz < divisions; qz++ )
+     for( int qy = 0; qy < divisions; qy++ )
+        for( int qx = 0; qx < divisions; qx++, shifted += stride )
+        {
+           double f[3] = { static_cast<double>( qx ) / divisions,
+                           static_cast<double>( qy ) / divisions,
+                           static_cast<double>( qz ) / divisions };
+           for( int corner = 0; corner < 8; corner++ )
+           {
+              int c[3] = { corner & 1, ( corner >> 1 ) & 1, corner >> 2 };
+              double weight = ( c[0] ? f[0] : 1 - f[0] )
+                              * ( c[1] ? f[1] : 1 - f[1] )
+                              * ( c[2] ? f[2] : 1 - f[2] );
+              if( weight == 0 )
+              {
+                 continue;
+              }
+              double *kernelPtr = kernel;
+              for( int k = 0; k < size[2]; k++ )
+                 for( int j = 0; j < size[1]; j++ )
+                    for( int i = 0; i < size[0]; i++ )
+                    {
+                       double *shiftedPtr = shifted
+                          + ( ( static_cast<vtkIdType>( k + c[2] ) * window[1] + j + c[1] )
+                              * window[0] + i + c[0] ) * numComps;
+                       for( int comp = 0; comp < numComps; comp++ )
+                       {
+                          shiftedPtr[comp] += weight * *kernelPtr++;
+                       }
+                    }
+           }
+        }
+}
+
+//----------------------------------------------------------------------------
+// Site ids sorted along the Z-order (Morton) curve of their nearest voxel,
+// so that the sites following each other read close windows of the image.
+// The voxel indices are clamped to the extent and their bits interleaved.
+static void vtkImageLocalConvolutionSortSites(vtkPoints *sites, vtkImageData *image,
+                                              std::vector<vtkIdType>& order)
+{
+  double origin[3], spacing[3];
+  int dims[3], numBits = 0;
+  image->GetOrigin( origin );
+  image->GetSpacing( spacing );
+  image->GetDimensions( dims );
+  for( int axis = 0; axis < 3; axis++ )
+  {
+    while( numBits < 21 && ( dims[axis] - 1 ) >> numBits )
+    {
+      numBits++;
+    }
+  }
+
+  vtkIdType numSites = sites->GetNumberOfPoints( );
+  std::vector< std::pair<vtkTypeUInt64, vtkIdType> > keys( numSites );
+  for( vtkIdType ptId = 0; ptId < numSites; ptId++ )
+  {
+    double point[3];
+    sites->GetPoint( ptId, point );
+    vtkTypeUInt64 key = 0;
+    for( int axis = 0; axis < 3; axis++ )
+    {
+      double loc = floor( ( point[axis] - origin[axis] ) / spacing[axis] + 0.5 )
+                   - image->GetExtent( )[axis*2];
+      vtkTypeUInt64 index = 0;
+      if( loc >= dims[axis] - 1 )
+      {
+        index = dims[axis] - 1;
+      }
+      else if( loc > 0 )
+      {
+        index = static_cast<vtkTypeUInt64>( loc );
+      }
+      for( int bit = 0; bit < numBits; bit++ )
+      {
+        key |= ( ( index >> bit ) & 1 ) << ( 3 * bit + axis );
+      }
+    }
+    keys[ptId] = std::make_pair( key, ptId );
+  }
+  std::sort( keys.begin( ), keys.end( ) );
+
+  order.resize( numSites );
+  for( vtkIdType ptId = 0; ptId < numSites; ptId++ )
+  {
+    order[ptId] = keys[ptId].second;
+  }
+}
+
+//----------------------------------------------------------------------------
+// Time of the topology of the sites: the time of the cells of a vtkPolyData,
+// which does not change while its points move, or else the time of the
+// points.
+static unsigned long vtkImageLocalConvolutionTopologyTime(vtkPointSet *input)
+{
+  vtkPolyData *polyData = vtkPolyData::SafeDownCast( input );
+  if( polyData && polyData->GetNumberOfCells( ) > 0 )
+  {
+    vtkCellArray *cells[4] = { polyData->GetVerts( ), polyData->GetLines( ),
+                               polyData->GetPolys( ), polyData->GetStrips( ) };
+    unsigned long time = 0;
+    for( int i = 0; i < 4; i++ )
+    {
+      if( cells[i]->GetMTime( ) > time )
+      {
+        time = cells[i]->GetMTime( );
+      }
+    }
+    return( time );
+  }
+  return( input->GetPoints( )->GetMTime( ) );
+}
+
+//----------------------------------------------------------------------------
+// Each thread computes a contiguous range of sites.
+template <class T>
+static VTK_THREAD_RETURN_TYPE vtkImageLocalConvolutionThreadedExecute( void *arg )
+{
+  vtkMultiThreader::ThreadInfo *info = static_cast<vtkMultiThreader::ThreadInfo*>( arg );
+  vtkImageLocalConvolutionThreadStruct *str = 
+    static_cast<vtkImageLocalConvolutionThreadStruct*>( info->UserData );
+  int threadId = info->ThreadID;
+  int numThreads = info->NumberOfThreads;
+
+  vtkIdType numSites = str->Sites->GetNumberOfPoints( );
+  vtkIdType begin = numSites * threadId / numThreads;
+  vtkIdType end = numSites * ( threadId + 1 ) / numThreads;
+  vtkImageLocalConvolutionExecute( str->Filter, str,
+                                   static_cast<T*>( str->Image->GetScalarPointer( ) ),
+                                   begin, end, threadId );
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+// The output array is allocated once, then filled by the threads. The
+// switch statement selects the thread function of the image scalar type.
 int vtkImageLocalConvolution::RequestData(
-                              vtkInformation *request,
+                              vtkInformation *vtkNotUsed(request),
                               vtkInformationVector **inputVector,
                               vtkInformationVector *outputVector)
 {
-  vtkInformation *imageInfo = inputVector[1]->GetInformationObject(0);
+  // get the inputs and ouptut
+  vtkPointSet *input = vtkPointSet::SafeDownCast(
+    inputVector[0]->GetInformationObject(0)->Get(vtkDataObject::DATA_OBJECT()));
   vtkImageData *image = vtkImageData::SafeDownCast(
-    imageInfo->Get(vtkDataObject::DATA_OBJECT()));
-  void* inPtr = image->GetScalarPointer( );
+    inputVector[1]->GetInformationObject(0)->Get(vtkDataObject::DATA_OBJECT()));
+  vtkImageData *kernelImage = vtkImageData::SafeDownCast(
+    inputVector[2]->GetInformationObject(0)->Get(vtkDataObject::DATA_OBJECT()));
+  vtkPointSet *output = vtkPointSet::SafeDownCast(
+    outputVector->GetInformationObject(0)->Get(vtkDataObject::DATA_OBJECT()));
+
+  // Preserve topology and geometry
+  output->CopyStructure( input );
+  output->GetPointData( )->PassData( input->GetPointData( ) );
+  output->GetCellData( )->PassData( input->GetCellData( ) );
+  if( !input->GetPoints( ) )
+  {
+    return 1;
+  }
+
+  if( kernelImage->GetScalarType( ) != VTK_DOUBLE )
+  {
+    vtkErrorMacro(<< "Execute: the kernel must be of type double");
+    return 0;
+  }
+
+  int kernelNumComps = kernelImage->GetNumberOfScalarComponents( );
+  vtkDoubleArray* outData = vtkDoubleArray::New( );
+  outData->SetName( this->GetOutputDataName( ) );
+  outData->SetNumberOfComponents( kernelNumComps );
+  outData->SetNumberOfTuples( input->GetNumberOfPoints( ) );
+
+  vtkImageLocalConvolutionThreadStruct str;
+  str.Filter = this;
+  str.Sites = input->GetPoints( );
+  str.SitesPtr = str.Sites->GetVoidPointer( 0 );
+  str.Image = image;
+  image->GetIncrements( str.Increments );
+  image->GetOrigin( str.Origin );
+  image->GetSpacing( str.Scale );
+  str.UseReciprocalSpacing = this->UseReciprocalSpacing;
+  str.Linear = this->InterpolationMode == VTK_LOCAL_CONVOLUTION_LINEAR;
+  str.Divisions = str.Linear ? this->SubVoxelDivisions : 1;
+  str.Kernel = kernelImage;
+
+  // Handle boundaries : in nearest mode the convolution is computed only if
+  // the site is inside the image border shrunk by kernelSize/2. In linear
+  // mode the window, one voxel larger, must be inside the image.
+  int extent[6], kernelSize[3];
+  image->GetExtent( extent );
+  kernelImage->GetDimensions( kernelSize );
+  for( int axis = 0; axis < 3; axis++ )
+  {
+    if( this->UseReciprocalSpacing )
+    {
+      str.Scale[axis] = 1.0 / str.Scale[axis];
+    }
+    str.Start[axis] = extent[axis*2] + kernelSize[axis] / 2;
+    str.WindowSize[axis] = kernelSize[axis] + str.Linear;
+    if( str.Linear )
+    {
+      str.Bounds[axis*2] = str.Start[axis];
+      str.Bounds[axis*2 + 1] = str.Start[axis] + extent[axis*2 + 1] - extent[axis*2]
+                               - kernelSize[axis];
+    }
+    else
+    {
+      str.Bounds[axis*2] = extent[axis*2] + kernelSize[axis] / 2 + 1;
+      str.Bounds[axis*2 + 1] = extent[axis*2 + 1] - kernelSize[axis] / 2 - 1;
+    }
+  }
+
+  if( str.Linear )
+  {
+    vtkImageLocalConvolutionInternals *internals = this->Internals;
+    if( !internals->Prepared || internals->KernelTime != kernelImage->GetMTime( )
+        || internals->SubVoxelDivisions != this->SubVoxelDivisions )
+    {
+      vtkImageLocalConvolutionShiftKernels( kernelImage, this->SubVoxelDivisions,
+                                            internals->ShiftedKernels );
+      internals->KernelTime = kernelImage->GetMTime( );
+      internals->SubVoxelDivisions = this->SubVoxelDivisions;
+      internals->Prepared = 1;
+    }
+    else
+    {
+      vtkDebugMacro( << "Reusing the shifted kernels." );
+    }
+    str.Kernels = &internals->ShiftedKernels[0];
+    str.KernelStride = static_cast<vtkIdType>( str.WindowSize[0] ) * str.WindowSize[1]
+                       * str.WindowSize[2] * kernelNumComps;
+  }
+  else
+  {
+    str.Kernels = static_cast<double*>( kernelImage->GetScalarPointer( ) );
+    str.KernelStride = 0;
+  }
+
+  // Sums of the weights of each kernel, which the normalization subtracts
+  // times the min of the window
+  std::vector<double> kernelSums;
+  str.KernelSums = 0;
+  if( this->NormalizedIntensities )
+  {
+    vtkIdType numKernels = str.Divisions * str.Divisions * str.Divisions;
+    vtkIdType numTaps = static_cast<vtkIdType>( str.WindowSize[0] ) * str.WindowSize[1]
+                        * str.WindowSize[2];
+    kernelSums.assign( numKernels * kernelNumComps, 0.0 );
+    const double *weight = str.Kernels;
+    for( vtkIdType kernelId = 0; kernelId < numKernels; kernelId++ )
+    {
+      for( vtkIdType tap = 0; tap < numTaps; tap++ )
+      {
+        for( int comp = 0; comp < kernelNumComps; comp++ )
+        {
+          kernelSums[kernelId * kernelNumComps + comp] += *weight++;
+        }
+      }
+    }
+    str.KernelSums = &kernelSums[0];
+  }
+  str.OutPtr = outData->GetPointer( 0 );
+
+  // The sites are traversed along the Z-order curve of their voxels. The
+  // order is kept while the number of sites and their topology are the same.
+  str.Order = 0;
+  if( this->SortSites )
+  {
+    vtkImageLocalConvolutionInternals *internals = this->Internals;
+    vtkIdType numSites = input->GetNumberOfPoints( );
+    unsigned long topologyTime = vtkImageLocalConvolutionTopologyTime( input );
+    if( !internals->HasOrder || internals->OrderSize != numSites
+        || internals->OrderTime != topologyTime )
+    {
+      vtkImageLocalConvolutionSortSites( str.Sites, image, internals->Order );
+      internals->OrderSize = numSites;
+      internals->OrderTime = topologyTime;
+      internals->HasOrder = 1;
+    }
+    else
+    {
+      vtkDebugMacro( << "Reusing the order of the sites." );
+    }
+    // an input without sites has no order to follow
+    str.Order = internals->Order.empty( ) ? 0 : &internals->Order[0];
+  }
+  for( int t = 0; t < this->NumberOfThreads; t++ )
+  {
+    str.NumberOfOutsideSites[t] = 0;
+    str.FirstOutsideSite[t] = -1;
+  }
+
+  this->Threader->SetNumberOfThreads( this->NumberOfThreads );
   switch (image->GetScalarType())
   {
     vtkTemplateMacro(
-      vtkImageLocalConvolutionExecute(this, inputVector, 
-                                   static_cast<VTK_TT *>(inPtr),
-                                   outputVector));
+      this->Threader->SetSingleMethod( vtkImageLocalConvolutionThreadedExecute<VTK_TT>,
+                                       &str ));
 
     default:
       vtkErrorMacro(<< "Execute: Unknown ScalarType");
+      outData->Delete( );
       return 0;
   }
+  this->Threader->SingleMethodExecute( );
 
-  // Preserve topology and geometry
-    vtkPointSet *output = vtkPointSet::SafeDownCast(
-                           outputVector->GetInformationObject(0)
-		                               ->Get(vtkDataObject::DATA_OBJECT()));
-    vtkPointSet *input = vtkPointSet::SafeDownCast(
-                           inputVector[0]->GetInformationObject(0)
-	                                     ->Get(vtkDataObject::DATA_OBJECT()));
-	output->CopyStructure( input );
+  // The sites outside the image are reported once
+  vtkIdType numOutside = 0, firstOutside = -1;
+  for( int t = 0; t < this->NumberOfThreads; t++ )
+  {
+    numOutside += str.NumberOfOutsideSites[t];
+    if( str.NumberOfOutsideSites[t]
+        && ( firstOutside < 0 || str.FirstOutsideSite[t] < firstOutside ) )
+    {
+      firstOutside = str.FirstOutsideSite[t];
+    }
+  }
+  if( numOutside )
+  {
+    double point[3];
+    input->GetPoint( firstOutside, point );
+    vtkErrorMacro(<< numOutside << " convolution site(s) outside the image, the first one at ( "
+                  <<  point[0] << ", "
+                  <<  point[1] << ", "
+                  <<  point[2] << " )" );
+  }
+
+  output->GetPointData( )->AddArray( outData );
+  outData->Delete( );
 
   return 1;
 }
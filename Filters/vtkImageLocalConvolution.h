@@ -28,6 +28,12 @@
 //! The kernel input is a vtkImageData of dimension i,j,k and possibly multi-
 //! components. The image input is a vtkImageData. 
 //! The convolution is computed at sites given through the PointSet input.
+//! The sites are shared between NumberOfThreads threads, each one filling
+//! its own tuples of the output array. The voxel of each site is computed
+//! from the origin and spacing of the image, as vtkImageData::FindPoint does.
+//! In linear mode, the kernel is applied at the site itself, on the image
+//! interpolated trilinearly, instead of at the nearest voxel. This gives
+//! smooth responses along moving sites without upsampling the image.
 //! \note vtkPolyDataSource are of interest for such input. One can use a vtkPointSource
 //! and computes a convolution at discrete sites inside a sphere
 //!
@@ -40,6 +46,12 @@
 #include "vtkPointSetAlgorithm.h"
 #include "vtkImageData.h"
 
+class vtkMultiThreader;
+class vtkImageLocalConvolutionInternals;
+
+#define VTK_LOCAL_CONVOLUTION_NEAREST 0
+#define VTK_LOCAL_CONVOLUTION_LINEAR 1
+
 class VTK_EXPORT vtkImageLocalConvolution : public vtkPointSetAlgorithm
 {
 public:
@@ -77,6 +89,47 @@ public:
   vtkGetMacro( NormalizedIntensities, int );
   vtkBooleanMacro( NormalizedIntensities, int );
 
+  //! Set/Get the number of threads evaluating the convolution sites
+  vtkSetClampMacro( NumberOfThreads, int, 1, VTK_MAX_THREADS );
+  vtkGetMacro( NumberOfThreads, int );
+
+  //! If on, the voxel of a site is computed with the reciprocal of the
+  //! spacing instead of a division. It is faster, but a site halfway
+  //! between two voxels may be given the other one. Off by default.
+  vtkSetMacro( UseReciprocalSpacing, int );
+  vtkGetMacro( UseReciprocalSpacing, int );
+  vtkBooleanMacro( UseReciprocalSpacing, int );
+
+  //! Set/Get how the image is sampled at the sites: at the nearest voxel
+  //! (default), or interpolated trilinearly. In linear mode the kernel is
+  //! shifted by the sub-voxel offset of the site, rounded to
+  //! 1/SubVoxelDivisions of a voxel, and weights a window one voxel larger
+  //! than the kernel on each axis. With NormalizedIntensities, the minimum
+  //! and maximum are taken on this window. Sites whose window is not
+  //! inside the image are set to 0.
+  vtkSetClampMacro( InterpolationMode, int, VTK_LOCAL_CONVOLUTION_NEAREST,
+                    VTK_LOCAL_CONVOLUTION_LINEAR );
+  vtkGetMacro( InterpolationMode, int );
+  void SetInterpolationModeToNearest( )
+    {this->SetInterpolationMode( VTK_LOCAL_CONVOLUTION_NEAREST );}
+  void SetInterpolationModeToLinear( )
+    {this->SetInterpolationMode( VTK_LOCAL_CONVOLUTION_LINEAR );}
+
+  //! Set/Get the number of sub-voxel offsets per axis in linear mode. The
+  //! kernel shifted by each of the SubVoxelDivisions^3 offsets is computed
+  //! once and kept until the kernel changes. Default is 4.
+  vtkSetClampMacro( SubVoxelDivisions, int, 1, 16 );
+  vtkGetMacro( SubVoxelDivisions, int );
+
+  //! If on (default), the sites are traversed along the Z-order curve of
+  //! their voxels, so that close sites share the cached image data, and the
+  //! results are written back to the tuples of the sites. The order is kept
+  //! between executions while the number of sites and their cells are the
+  //! same, e.g. for a mesh deforming in the image.
+  vtkSetMacro( SortSites, int );
+  vtkGetMacro( SortSites, int );
+  vtkBooleanMacro( SortSites, int );
+
   static void GetGridLocation( vtkImageData* img, vtkIdType ptId, int* ijk );
 
 protected:
@@ -96,6 +149,13 @@ private:
 
   int NormalizedIntensities; //! if 1, the image intensities I are mapped in [0,1] 
                             //! regarding values inside the kernel window
+  int UseReciprocalSpacing; //!< if 1, multiply by the reciprocal of the spacing
+  int InterpolationMode; //!< nearest voxel or trilinear interpolation
+  int SubVoxelDivisions; //!< sub-voxel offsets per axis in linear mode
+  int SortSites; //!< if 1, the sites are traversed along the Z-order curve
+  vtkImageLocalConvolutionInternals *Internals; //!< shifted kernels, order of the sites
+  int NumberOfThreads; //!< number of threads evaluating the convolution sites
+  vtkMultiThreader *Threader; //!< threads evaluating the convolution sites
 };
 
 #endif //__VTKLOCALIMAGECONVOLUTION_H
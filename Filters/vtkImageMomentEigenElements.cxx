@@ -0,0 +1,463 @@
+// Copyright (c) 2010, Jérôme Velut
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER ``AS IS'' AND ANY EXPRESS 
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN 
+// NO EVENT SHALL THE COPYRIGHT OWNER BE LIABLE FOR ANY DIRECT, INDIRECT, 
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+// EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+#include "vtkImageMomentEigenElements.h"
+#include "vtkImageMomentKernelSource.h"
+#include "vtkImageEigenElements.h"
+#include "vtkImageData.h"
+#include "vtkPointData.h"
+#include "vtkFloatArray.h"
+#include "vtkInformation.h"
+#include "vtkInformationVector.h"
+#include "vtkObjectFactory.h"
+#include "vtkStreamingDemandDrivenPipeline.h"
+#include "vtkMultiThreader.h"
+
+#include <vector>
+
+vtkStandardNewMacro(vtkImageMomentEigenElements);
+
+//----------------------------------------------------------------------------
+// Outputs, in the order of the class documentation
+#define VTK_MOMENT_EIGEN_NUMBER_OF_OUTPUTS 6
+static const char *vtkImageMomentEigenElementsNames[VTK_MOMENT_EIGEN_NUMBER_OF_OUTPUTS] =
+{
+  "MaxEigenVector", "MaxEigenValue", 
+  "MedEigenVector", "MedEigenValue",
+  "MinEigenVector", "MinEigenValue"
+};
+
+//----------------------------------------------------------------------------
+// Kernel data prepared in RequestData and shared by the threads.
+class vtkImageMomentEigenElementsInternals
+{
+public:
+  //! Non zero taps of the moment kernel: 10 moments per tap
+  std::vector<double> Taps;
+  //! Position of each tap relative to the kernel center (3 per tap)
+  std::vector<int> TapOffsets;
+  //! Half-widths of the kernel: the tap offsets are in [-Low, High]
+  int Low[3], High[3];
+  //! Output arrays (0 if not requested), in the order of the outputs
+  float *Outputs[VTK_MOMENT_EIGEN_NUMBER_OF_OUTPUTS];
+};
+
+//----------------------------------------------------------------------------
+vtkImageMomentEigenElements::vtkImageMomentEigenElements()
+{
+  this->KernelSize = 5;
+  this->SubSampling = 100;
+  this->AutoSubSampling = 1;
+  this->AdaptiveSubSampling = 0;
+  this->CentralMoments = 1;
+  this->ComputeMaxEigenVector = 1;
+  this->ComputeMaxEigenValue = 1;
+  this->ComputeMedEigenVector = 0;
+  this->ComputeMedEigenValue = 0;
+  this->ComputeMinEigenVector = 0;
+  this->ComputeMinEigenValue = 0;
+  this->KernelSource = vtkImageMomentKernelSource::New( );
+  this->Internals = new vtkImageMomentEigenElementsInternals;
+}
+
+//----------------------------------------------------------------------------
+vtkImageMomentEigenElements::~vtkImageMomentEigenElements()
+{
+  this->KernelSource->Delete( );
+  delete this->Internals;
+}
+
+//----------------------------------------------------------------------------
+void vtkImageMomentEigenElements::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "KernelSize: " << this->KernelSize << "\n";
+  os << indent << "SubSampling: " << this->SubSampling << "\n";
+  os << indent << "AutoSubSampling: " << this->AutoSubSampling << "\n";
+  os << indent << "AdaptiveSubSampling: " << this->AdaptiveSubSampling << "\n";
+  os << indent << "CentralMoments: " << this->CentralMoments << "\n";
+  for( int i = 0; i < VTK_MOMENT_EIGEN_NUMBER_OF_OUTPUTS; i++ )
+    {
+    os << indent << "Compute" << vtkImageMomentEigenElementsNames[i] << ": " 
+       << ( this->GetOutputNumberOfComponents( i ) > 0 ) << "\n";
+    }
+}
+
+//----------------------------------------------------------------------------
+int vtkImageMomentEigenElements::GetOutputNumberOfComponents( int i )
+{
+  int compute[VTK_MOMENT_EIGEN_NUMBER_OF_OUTPUTS] = 
+    { this->ComputeMaxEigenVector, this->ComputeMaxEigenValue,
+      this->ComputeMedEigenVector, this->ComputeMedEigenValue,
+      this->ComputeMinEigenVector, this->ComputeMinEigenValue };
+  return( compute[i] ? ( i % 2 ? 1 : 3 ) : 0 );
+}
+
+//----------------------------------------------------------------------------
+// The scalars are the first requested output.
+int vtkImageMomentEigenElements::RequestInformation(vtkInformation*,
+                                       vtkInformationVector** vtkNotUsed(inputVector),
+                                       vtkInformationVector* outputVector)
+{
+  vtkInformation* outInfo = outputVector->GetInformationObject(0);
+  for( int i = 0; i < VTK_MOMENT_EIGEN_NUMBER_OF_OUTPUTS; i++ )
+    {
+    if( this->GetOutputNumberOfComponents( i ) )
+      {
+      vtkDataObject::SetPointDataActiveScalarInfo(outInfo, VTK_FLOAT,
+                                      this->GetOutputNumberOfComponents( i ));
+      return( 1 );
+      }
+    }
+  vtkErrorMacro(<< "No eigen element is requested.");
+  return( 0 );
+}
+
+//----------------------------------------------------------------------------
+// The input update extent is the output update extent grown by the kernel
+// half-width, inside the whole extent.
+int vtkImageMomentEigenElements::RequestUpdateExtent(vtkInformation*,
+                                         vtkInformationVector** inputVector,
+                                         vtkInformationVector* outputVector)
+{
+  vtkInformation* outInfo = outputVector->GetInformationObject(0);
+  vtkInformation* inInfo = inputVector[0]->GetInformationObject(0);
+
+  int inWholeExt[6], inExt[6];
+  inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), inWholeExt);
+  outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), inExt);
+  // The kernel source rounds an even size up to the next odd one
+  int kernelSize = this->KernelSize | 1;
+  int middle = kernelSize / 2;
+  for( int axis = 0; axis < 3; axis++ )
+    {
+    inExt[2*axis] -= middle;
+    inExt[2*axis+1] += kernelSize - 1 - middle;
+    inExt[2*axis] = inExt[2*axis] < inWholeExt[2*axis] ? inWholeExt[2*axis] 
+                                                        : inExt[2*axis];
+    inExt[2*axis+1] = inExt[2*axis+1] > inWholeExt[2*axis+1] ? inWholeExt[2*axis+1] 
+                                                              : inExt[2*axis+1];
+    }
+  inInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), inExt, 6);
+  return( 1 );
+}
+
+//----------------------------------------------------------------------------
+// The requested outputs are allocated once, on the update extent, before
+// the threads fill their own piece of it.
+int vtkImageMomentEigenElements::RequestData(vtkInformation* request,
+                                     vtkInformationVector** inputVector,
+                                     vtkInformationVector* outputVector)
+{
+  vtkInformation* inInfo = inputVector[0]->GetInformationObject(0);
+  vtkInformation* outInfo = outputVector->GetInformationObject(0);
+  vtkImageData *inImage = vtkImageData::SafeDownCast( inInfo->Get(vtkDataObject::DATA_OBJECT()));
+  vtkImageData *outImage = vtkImageData::SafeDownCast( outInfo->Get(vtkDataObject::DATA_OBJECT()));
+
+  int updateExt[6];
+  outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), updateExt);
+  outImage->SetExtent( updateExt );
+  outImage->GetPointData( )->Initialize( );
+  vtkIdType numPoints = outImage->GetNumberOfPoints( );
+
+  vtkImageMomentEigenElementsInternals *internals = this->Internals;
+  bool scalars = true;
+  for( int i = 0; i < VTK_MOMENT_EIGEN_NUMBER_OF_OUTPUTS; i++ )
+    {
+    int numComps = this->GetOutputNumberOfComponents( i );
+    internals->Outputs[i] = 0;
+    if( !numComps )
+      {
+      continue;
+      }
+    vtkFloatArray *array = vtkFloatArray::New( );
+    array->SetName( vtkImageMomentEigenElementsNames[i] );
+    array->SetNumberOfComponents( numComps );
+    array->SetNumberOfTuples( numPoints );
+    if( scalars )
+      {
+      outImage->GetPointData( )->SetScalars( array );
+      scalars = false;
+      }
+    else
+      {
+      outImage->GetPointData( )->AddArray( array );
+      }
+    internals->Outputs[i] = array->GetPointer( 0 );
+    array->Delete( );
+    }
+  if( scalars )
+    {
+    vtkErrorMacro(<< "No eigen element is requested.");
+    return( 0 );
+    }
+
+  // Moment kernel: only the taps inside the sphere are kept.
+  this->KernelSource->SetKernelSize( this->KernelSize );
+  this->KernelSource->SetSubSampling( this->SubSampling );
+  this->KernelSource->SetAutoSubSampling( this->AutoSubSampling );
+  this->KernelSource->SetAdaptiveSubSampling( this->AdaptiveSubSampling );
+  this->KernelSource->SetMaximumOrder( 2 );
+  this->KernelSource->Update( );
+  vtkImageData *kernel = this->KernelSource->GetOutput( );
+  double *kernelPtr = static_cast<double*>( kernel->GetScalarPointer( ) );
+  int kernelSize[3];
+  kernel->GetDimensions( kernelSize );
+
+  internals->Taps.clear( );
+  internals->TapOffsets.clear( );
+  for( int axis = 0; axis < 3; axis++ )
+    {
+    internals->Low[axis] = kernelSize[axis] / 2;
+    internals->High[axis] = kernelSize[axis] - 1 - internals->Low[axis];
+    }
+  for( int k = 0; k < kernelSize[2]; k++ )
+    for( int j = 0; j < kernelSize[1]; j++ )
+      for( int i = 0; i < kernelSize[0]; i++, kernelPtr += 10 )
+        {
+        if( kernelPtr[0] == 0.0 )
+          {
+          continue;
+          }
+        internals->Taps.insert( internals->Taps.end( ), kernelPtr, kernelPtr + 10 );
+        internals->TapOffsets.push_back( i - internals->Low[0] );
+        internals->TapOffsets.push_back( j - internals->Low[1] );
+        internals->TapOffsets.push_back( k - internals->Low[2] );
+        }
+
+  vtkImageData *inputImages[1] = { inImage };
+  vtkImageData **inputs[1] = { inputImages };
+
+  this->ThreadedRequestExtent( request, inputVector, outputVector, inputs,
+                               &outImage, updateExt );
+
+  return( 1 );
+}
+
+//----------------------------------------------------------------------------
+// Moments of the voxels of outExt, then eigen elements of their tensors,
+// row by row.
+// The neighbourhood of the voxels far enough from the edges of the whole
+// extent is not checked; elsewhere the taps outside are skipped (zero image).
+template <class T>
+void vtkImageMomentEigenElementsExecute(vtkImageMomentEigenElements *self,
+                                  vtkImageMomentEigenElementsInternals *internals,
+                                  vtkImageData *inData, T *,
+                                  vtkImageData *outData, int outExt[6],
+                                  int wholeExt[6], int centralMoments, int id)
+{
+  vtkIdType inInc0, inInc1, inInc2;
+  inData->GetIncrements( inInc0, inInc1, inInc2 );
+  int *inExt = inData->GetExtent( );
+  int *dataExt = outData->GetExtent( );
+  vtkIdType dataDim0 = dataExt[1] - dataExt[0] + 1;
+  vtkIdType dataDim1 = dataExt[3] - dataExt[2] + 1;
+
+  int numTaps = static_cast<int>( internals->TapOffsets.size( ) / 3 );
+  const double *taps = numTaps ? &internals->Taps[0] : 0;
+  const int *tapOffsets = numTaps ? &internals->TapOffsets[0] : 0;
+  std::vector<vtkIdType> offsets( numTaps );
+  for( int t = 0; t < numTaps; t++ )
+    {
+    offsets[t] = tapOffsets[3*t] * inInc0 + tapOffsets[3*t+1] * inInc1 
+                 + tapOffsets[3*t+2] * inInc2;
+    }
+
+  // Voxels whose whole neighbourhood is inside the whole extent
+  int interior[6];
+  for( int axis = 0; axis < 3; axis++ )
+    {
+    interior[2*axis] = wholeExt[2*axis] + internals->Low[axis];
+    interior[2*axis+1] = wholeExt[2*axis+1] - internals->High[axis];
+    }
+
+  unsigned long count = 0;
+  unsigned long target = static_cast<unsigned long>(
+    (outExt[5] - outExt[4] + 1) * (outExt[3] - outExt[2] + 1) / 50.0 );
+  target++;
+
+  // Tensors of a row, stored component-wise, and their eigen elements.
+  // The vectors are computed only if one is output.
+  vtkIdType rowLength = outExt[1] - outExt[0] + 1;
+  bool computeVectors = internals->Outputs[0] || internals->Outputs[2] 
+                        || internals->Outputs[4];
+  std::vector<double> buffer( 18 * rowLength );
+  double *tensor[6], *values[3], *vectors[9];
+  for( int c = 0; c < 6; c++ )
+    {
+    tensor[c] = &buffer[c * rowLength];
+    }
+  for( int e = 0; e < 3; e++ )
+    {
+    values[e] = &buffer[( 6 + e ) * rowLength];
+    }
+  for( int c = 0; c < 9; c++ )
+    {
+    vectors[c] = &buffer[( 9 + c ) * rowLength];
+    }
+
+  for( int idx2 = outExt[4]; idx2 <= outExt[5]; idx2++ )
+    {
+    for( int idx1 = outExt[2]; idx1 <= outExt[3] && !self->AbortExecute; idx1++ )
+      {
+      if( !id )
+        {
+        if( !( count % target ) )
+          {
+          self->UpdateProgress( count / ( 50.0 * target ) );
+          }
+        count++;
+        }
+      bool interiorRow = idx1 >= interior[2] && idx1 <= interior[3]
+                         && idx2 >= interior[4] && idx2 <= interior[5];
+      vtkIdType outIdx = ( ( idx2 - dataExt[4] ) * dataDim1 + idx1 - dataExt[2] ) 
+                           * dataDim0 + outExt[0] - dataExt[0];
+      T *inPtr = static_cast<T*>( inData->GetScalarPointer( outExt[0], idx1, idx2 ) );
+
+      for( int idx0 = outExt[0]; idx0 <= outExt[1]; idx0++, inPtr += inInc0 )
+        {
+        vtkIdType i = idx0 - outExt[0];
+        double m[10] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+        if( interiorRow && idx0 >= interior[0] && idx0 <= interior[1] )
+          {
+          for( int t = 0; t < numTaps; t++ )
+            {
+            double value = static_cast<double>( inPtr[offsets[t]] );
+            const double *tap = taps + 10 * t;
+            for( int c = 0; c < 10; c++ )
+              {
+              m[c] += tap[c] * value;
+              }
+            }
+          }
+        else
+          {
+          for( int t = 0; t < numTaps; t++ )
+            {
+            int i0 = idx0 + tapOffsets[3*t];
+            int i1 = idx1 + tapOffsets[3*t+1];
+            int i2 = idx2 + tapOffsets[3*t+2];
+            if( i0 < inExt[0] || i0 > inExt[1] || i1 < inExt[2] || i1 > inExt[3] 
+                || i2 < inExt[4] || i2 > inExt[5] )
+              {
+              continue;
+              }
+            double value = static_cast<double>( inPtr[offsets[t]] );
+            const double *tap = taps + 10 * t;
+            for( int c = 0; c < 10; c++ )
+              {
+              m[c] += tap[c] * value;
+              }
+            }
+          }
+
+        // Tensor: M200 M110 M101 M020 M011 M002 are the components 7 4 5 8 6 9
+        if( centralMoments )
+          {
+          if( m[0] != 0.0 )
+            {
+            double mean[3] = { m[1] / m[0], m[2] / m[0], m[3] / m[0] };
+            tensor[0][i] = m[7] / m[0] - mean[0] * mean[0];
+            tensor[1][i] = m[4] / m[0] - mean[0] * mean[1];
+            tensor[2][i] = m[5] / m[0] - mean[0] * mean[2];
+            tensor[3][i] = m[8] / m[0] - mean[1] * mean[1];
+            tensor[4][i] = m[6] / m[0] - mean[1] * mean[2];
+            tensor[5][i] = m[9] / m[0] - mean[2] * mean[2];
+            }
+          else
+            {
+            for( int c = 0; c < 6; c++ )
+              {
+              tensor[c][i] = 0.0;
+              }
+            }
+          }
+        else
+          {
+          tensor[0][i] = m[7];
+          tensor[1][i] = m[4];
+          tensor[2][i] = m[5];
+          tensor[3][i] = m[8];
+          tensor[4][i] = m[6];
+          tensor[5][i] = m[9];
+          }
+        }
+
+      vtkImageEigenElements::ComputeEigenElements( rowLength, tensor, values,
+                                                   computeVectors ? vectors : 0 );
+
+      for( int e = 0; e < 3; e++ )
+        {
+        float *vector = internals->Outputs[2*e];
+        if( vector )
+          {
+          vector += 3 * outIdx;
+          for( vtkIdType i = 0; i < rowLength; i++ )
+            {
+            for( int comp = 0; comp < 3; comp++ )
+              {
+              vector[3 * i + comp] = static_cast<float>( vectors[3*e+comp][i] );
+              }
+            }
+          }
+        float *value = internals->Outputs[2*e+1];
+        if( value )
+          {
+          value += outIdx;
+          for( vtkIdType i = 0; i < rowLength; i++ )
+            {
+            value[i] = static_cast<float>( values[e][i] );
+            }
+          }
+        }
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkImageMomentEigenElements::ThreadedRequestData(
+    vtkInformation *vtkNotUsed(request),
+    vtkInformationVector **inputVector,
+    vtkInformationVector *vtkNotUsed(outputVector),
+    vtkImageData ***inData,
+    vtkImageData **outData,
+    int outExt[6], int id)
+{
+  int wholeExt[6];
+  inputVector[0]->GetInformationObject(0)->Get(
+    vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), wholeExt );
+
+  switch (inData[0][0]->GetScalarType())
+    {
+    vtkTemplateMacro(
+      vtkImageMomentEigenElementsExecute(this, this->Internals,
+                                         inData[0][0], static_cast<VTK_TT *>(0),
+                                         outData[0], outExt, wholeExt,
+                                         this->CentralMoments, id));
+    default:
+      vtkErrorMacro(<< "Execute: Unknown ScalarType");
+      return;
+    }
+}
@@ -0,0 +1,166 @@
+// Copyright (c) 2010, Jérôme Velut
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER ``AS IS'' AND ANY EXPRESS 
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN 
+// NO EVENT SHALL THE COPYRIGHT OWNER BE LIABLE FOR ANY DIRECT, INDIRECT, 
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+// EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+//! \class vtkImageMomentEigenElements
+//! \brief Eigen elements of the local moment tensor, without the moment volume.
+//!
+//! vtkImageMomentEigenElements computes, for each voxel, the geometric moments
+//! up to order 2 of the first component of the input in the sphere of
+//! diameter KernelSize around the voxel, forms a 3x3 tensor from them and
+//! outputs its eigen elements. With CentralMoments off, it gives the same
+//! result as the pipeline vtkImageMomentKernelSource -> vtkImageConvolution
+//! -> vtkImageEigenElements without storing the 10 moment components of
+//! each voxel: the moments of a voxel are accumulated in local variables,
+//! and only the requested eigen elements are stored, as floats.
+//!
+//! With CentralMoments (default), the tensor is the covariance of the
+//! coordinates weighted by the image in the sphere:
+//!    C = M2 / M000 - (M1 / M000) (M1 / M000)^T
+//! (zero where M000 is zero). Otherwise it is the raw second order moments:
+//!    M200 M110 M101
+//!    M110 M020 M011
+//!    M101 M011 M002
+//!
+//! The outputs are named as the ones of vtkImageEigenElements: MaxEigenVector,
+//! MaxEigenValue, MedEigenVector, MedEigenValue, MinEigenVector and
+//! MinEigenValue. Each one is computed only if requested (by default the
+//! largest eigen value and its vector); the first of them in this order is
+//! the active scalars.
+//!
+//! The image is zero outside its whole extent. The moment kernel is computed
+//! by an internal vtkImageMomentKernelSource with KernelSize, SubSampling,
+//! AutoSubSampling and AdaptiveSubSampling.
+
+#ifndef __vtkImageMomentEigenElements_h
+#define __vtkImageMomentEigenElements_h
+
+#include "vtkThreadedImageExtentAlgorithm.h"
+
+class vtkImageMomentKernelSource;
+class vtkImageMomentEigenElementsInternals;
+
+class VTK_EXPORT vtkImageMomentEigenElements : public vtkThreadedImageExtentAlgorithm
+{
+public:
+  static vtkImageMomentEigenElements *New();
+  vtkTypeMacro(vtkImageMomentEigenElements,vtkThreadedImageExtentAlgorithm);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  //! Set/Get the diameter of the moment sphere (in voxels). An even size
+  //! is rounded up to the next odd one, as in vtkImageMomentKernelSource.
+  vtkSetClampMacro( KernelSize, int, 1, VTK_LARGE_INTEGER );
+  vtkGetMacro( KernelSize, int );
+
+  //! Set/Get the sub-sampling of the moment kernel
+  //! (see vtkImageMomentKernelSource)
+  vtkSetMacro( SubSampling, int );
+  vtkGetMacro( SubSampling, int );
+
+  //! Set/Get the automatic sub-sampling of the moment kernel
+  //! (see vtkImageMomentKernelSource)
+  vtkSetMacro( AutoSubSampling, int );
+  vtkGetMacro( AutoSubSampling, int );
+  vtkBooleanMacro( AutoSubSampling, int );
+
+  //! Set/Get the adaptive sub-sampling of the moment kernel
+  //! (see vtkImageMomentKernelSource)
+  vtkSetMacro( AdaptiveSubSampling, int );
+  vtkGetMacro( AdaptiveSubSampling, int );
+  vtkBooleanMacro( AdaptiveSubSampling, int );
+
+  //! Use the covariance (1, default) or the raw second order moments (0) as
+  //! the tensor.
+  vtkSetMacro( CentralMoments, int );
+  vtkGetMacro( CentralMoments, int );
+  vtkBooleanMacro( CentralMoments, int );
+
+  //! Select the eigen elements to output
+  vtkSetMacro( ComputeMaxEigenVector, int );
+  vtkGetMacro( ComputeMaxEigenVector, int );
+  vtkBooleanMacro( ComputeMaxEigenVector, int );
+  vtkSetMacro( ComputeMaxEigenValue, int );
+  vtkGetMacro( ComputeMaxEigenValue, int );
+  vtkBooleanMacro( ComputeMaxEigenValue, int );
+  vtkSetMacro( ComputeMedEigenVector, int );
+  vtkGetMacro( ComputeMedEigenVector, int );
+  vtkBooleanMacro( ComputeMedEigenVector, int );
+  vtkSetMacro( ComputeMedEigenValue, int );
+  vtkGetMacro( ComputeMedEigenValue, int );
+  vtkBooleanMacro( ComputeMedEigenValue, int );
+  vtkSetMacro( ComputeMinEigenVector, int );
+  vtkGetMacro( ComputeMinEigenVector, int );
+  vtkBooleanMacro( ComputeMinEigenVector, int );
+  vtkSetMacro( ComputeMinEigenValue, int );
+  vtkGetMacro( ComputeMinEigenValue, int );
+  vtkBooleanMacro( ComputeMinEigenValue, int );
+
+  //! Compute the voxels of outExt. Called by the threads of RequestData.
+  virtual void ThreadedRequestData(vtkInformation *request,
+                                   vtkInformationVector **inputVector,
+                                   vtkInformationVector *outputVector,
+                                   vtkImageData ***inData, vtkImageData **outData,
+                                   int outExt[6], int id);
+
+protected:
+  vtkImageMomentEigenElements();
+  ~vtkImageMomentEigenElements();
+
+  virtual int RequestInformation(vtkInformation*,
+                         vtkInformationVector** inputVector,
+                         vtkInformationVector* outputVector);
+
+  virtual int RequestUpdateExtent(vtkInformation*,
+                         vtkInformationVector** inputVector,
+                         vtkInformationVector* outputVector);
+
+  //! Allocate the requested outputs, prepare the kernel and run the threads
+  virtual int RequestData(vtkInformation* request,
+                         vtkInformationVector** inputVector,
+                         vtkInformationVector* outputVector);
+
+  //! Number of components of the i-th output (in the order of the class
+  //! documentation), 0 if it is not requested
+  int GetOutputNumberOfComponents( int i );
+
+  int KernelSize; //!< diameter of the moment sphere
+  int SubSampling; //!< sub-sampling of the moment kernel
+  int AutoSubSampling; //!< automatic sub-sampling of the moment kernel
+  int AdaptiveSubSampling; //!< adaptive sub-sampling of the moment kernel
+  int CentralMoments; //!< if 1, the tensor is the covariance
+  int ComputeMaxEigenVector; //!< if 1, MaxEigenVector is output
+  int ComputeMaxEigenValue; //!< if 1, MaxEigenValue is output
+  int ComputeMedEigenVector; //!< if 1, MedEigenVector is output
+  int ComputeMedEigenValue; //!< if 1, MedEigenValue is output
+  int ComputeMinEigenVector; //!< if 1, MinEigenVector is output
+  int ComputeMinEigenValue; //!< if 1, MinEigenValue is output
+
+  vtkImageMomentKernelSource *KernelSource; //!< computes the moment kernel
+  vtkImageMomentEigenElementsInternals *Internals; //!< taps of the kernel
+
+private:
+  vtkImageMomentEigenElements(const vtkImageMomentEigenElements&);  // Not implemented.
+  void operator=(const vtkImageMomentEigenElements&);  // Not implemented.
+};
+
+#endif //__vtkImageMomentEigenElements_h
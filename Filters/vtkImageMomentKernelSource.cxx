@@ -30,7 +30,26 @@
 #include "vtkPointData.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 #include "vtkDataArray.h"
+#include "vtkMultiThreader.h"
+#include "vtkDirectory.h"
 #include <math.h>
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef _WIN32
+#include <process.h>
+#define vtkImageMomentKernelGetPid _getpid
+#else
+#include <unistd.h>
+#define vtkImageMomentKernelGetPid getpid
+#endif
+
+//----------------------------------------------------------------------------
+// Version of the cache file format and of the kernel computation. It has to
+// be incremented when any of them changes, so that older entries are ignored.
+#define VTK_MOMENT_KERNEL_CACHE_VERSION 1
 
 vtkStandardNewMacro(vtkImageMomentKernelSource);
 
@@ -40,10 +59,23 @@ vtkImageMomentKernelSource::vtkImageMomentKernelSource()
   this->KernelSize = 5;
   this->SubSampling = 100;
   this->AutoSubSampling = 1;
+  this->AdaptiveSubSampling = 0;
+  this->MaximumOrder = 2;
+  this->TrueSubSampling = 0;
+  this->Threader = vtkMultiThreader::New( );
+  this->NumberOfThreads = this->Threader->GetNumberOfThreads( );
+  this->CacheDirectory = 0;
   
   this->SetNumberOfInputPorts( 0 );
 }
 
+//----------------------------------------------------------------------------
+vtkImageMomentKernelSource::~vtkImageMomentKernelSource()
+{
+  this->Threader->Delete( );
+  this->SetCacheDirectory( 0 );
+}
+
 void vtkImageMomentKernelSource::SetKernelSize( int kernelSize )
 {
    if( kernelSize%2 == 0)
@@ -77,52 +109,403 @@ int vtkImageMomentKernelSource::RequestInformation (
                extent,6);
   outInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(),
                extent,6);
-  vtkDataObject::SetPointDataActiveScalarInfo(outInfo, VTK_DOUBLE, 10);
+  vtkDataObject::SetPointDataActiveScalarInfo(outInfo, VTK_DOUBLE, 
+                                              this->GetNumberOfMoments( ));
   return 1;
 }
 
+//----------------------------------------------------------------------------
+// Exponents (x,y,z) of the monomial of each output component. The moments of
+// order n follow the ones of order n-1, so the moments up to an order are the
+// first vtkImageMomentKernelOrder<order>::NumberOfMoments components. Orders
+// 3 and 4 are in decreasing lexicographic order. The table is written out
+// rather than generated by templates: the order 2 layout of the original
+// 10-component kernel is not lexicographic, and the loops over the moments
+// have constant bounds, so the compiler already folds the exponents.
+static const int vtkImageMomentKernelExponents[35][3] =
+{
+  {0,0,0},
+  {1,0,0}, {0,1,0}, {0,0,1},
+  {1,1,0}, {1,0,1}, {0,1,1}, {2,0,0}, {0,2,0}, {0,0,2},
+  {3,0,0}, {2,1,0}, {2,0,1}, {1,2,0}, {1,1,1}, 
+  {1,0,2}, {0,3,0}, {0,2,1}, {0,1,2}, {0,0,3},
+  {4,0,0}, {3,1,0}, {3,0,1}, {2,2,0}, {2,1,1}, 
+  {2,0,2}, {1,3,0}, {1,2,1}, {1,1,2}, {1,0,3},
+  {0,4,0}, {0,3,1}, {0,2,2}, {0,1,3}, {0,0,4}
+};
+
+//----------------------------------------------------------------------------
+// Number of moments up to the order Order. The integration functions are
+// specialized on the order, so that their loops over the moments and the
+// powers have constant bounds and are unrolled by the compiler.
+template <int Order>
+struct vtkImageMomentKernelOrder
+{
+  enum { NumberOfMoments = ( Order + 1 ) * ( Order + 2 ) * ( Order + 3 ) / 6 };
+};
+
+//----------------------------------------------------------------------------
+// Add the moments of the box [lo, lo + h] (normalized coordinates) to
+// moments, integrated exactly.
+template <int Order>
+static void vtkImageMomentKernelBoxMoments( const double lo[3], const double h[3],
+                                            double *moments )
+{
+  // I[axis][p]: integral of u^p along the axis
+  double I[3][Order + 1];
+  for( int axis = 0; axis < 3; axis++ )
+  {
+    double a = lo[axis], b = lo[axis] + h[axis];
+    double powA = a, powB = b;
+    for( int p = 0; p <= Order; p++ )
+    {
+      I[axis][p] = ( powB - powA ) / ( p + 1 );
+      powA *= a;
+      powB *= b;
+    }
+  }
+  for( int m = 0; m < vtkImageMomentKernelOrder<Order>::NumberOfMoments; m++ )
+  {
+    const int *e = vtkImageMomentKernelExponents[m];
+    moments[m] += I[0][e[0]] * I[1][e[1]] * I[2][e[2]];
+  }
+}
+
+//----------------------------------------------------------------------------
+// Add the sampled moments of the point c, weighted by dv, to moments.
+template <int Order>
+static inline void vtkImageMomentKernelSampleMoments( const double c[3], double dv,
+                                                      double *moments )
+{
+  // P[axis][p]: c[axis]^p
+  double P[3][Order + 1];
+  for( int axis = 0; axis < 3; axis++ )
+  {
+    P[axis][0] = 1.0;
+    for( int p = 1; p <= Order; p++ )
+      P[axis][p] = P[axis][p-1] * c[axis];
+  }
+  for( int m = 0; m < vtkImageMomentKernelOrder<Order>::NumberOfMoments; m++ )
+  {
+    const int *e = vtkImageMomentKernelExponents[m];
+    moments[m] += dv * P[0][e[0]] * P[1][e[1]] * P[2][e[2]];
+  }
+}
+
+//----------------------------------------------------------------------------
+// Add to moments the moments of the part of the cell inside the unit sphere.
+// The cell starts at lo (normalized coordinates) and is made of n[0]*n[1]*n[2]
+// sub-voxels of size step. A cell inside the sphere is integrated exactly, a
+// cell outside is skipped, and a cell crossed by the sphere is split in two
+// along its longest axis, down to single sub-voxels that are counted if their
+// center is inside the sphere.
+template <int Order>
+static void vtkImageMomentKernelAdaptiveMoments( const double lo[3], const int n[3],
+                                                 double step, double *moments )
+{
+  double h[3], nearSq = 0, farSq = 0;
+  for( int axis = 0; axis < 3; axis++ )
+  {
+    h[axis] = n[axis] * step;
+    double a = lo[axis], b = lo[axis] + h[axis];
+    double nearest = a > 0 ? a : ( b < 0 ? b : 0 );
+    double farthest = -a > b ? a : b;
+    nearSq += nearest * nearest;
+    farSq += farthest * farthest;
+  }
+  if( nearSq >= 1.0 )
+  {
+    return;
+  }
+  if( farSq < 1.0 )
+  {
+    vtkImageMomentKernelBoxMoments<Order>( lo, h, moments );
+    return;
+  }
+
+  int split = 0;
+  for( int axis = 1; axis < 3; axis++ )
+  {
+    split = n[axis] > n[split] ? axis : split;
+  }
+  if( n[split] == 1 )
+  {
+    double c[3];
+    for( int axis = 0; axis < 3; axis++ )
+    {
+      c[axis] = lo[axis] + step / 2.0;
+    }
+    if( c[0] * c[0] + c[1] * c[1] + c[2] * c[2] < 1.0 )
+    {
+      vtkImageMomentKernelSampleMoments<Order>( c, step * step * step, moments );
+    }
+    return;
+  }
+
+  double subLo[3] = { lo[0], lo[1], lo[2] };
+  int subN[3] = { n[0], n[1], n[2] };
+  subN[split] = n[split] / 2;
+  vtkImageMomentKernelAdaptiveMoments<Order>( subLo, subN, step, moments );
+  subLo[split] += subN[split] * step;
+  subN[split] = n[split] - subN[split];
+  vtkImageMomentKernelAdaptiveMoments<Order>( subLo, subN, step, moments );
+}
+
+//----------------------------------------------------------------------------
+// Moments of the voxel idx of the kernel. offset is the half kernel size,
+// step the sub-voxel size and subVoxels the number of sub-voxels per axis
+// (voxel units).
+template <int Order>
+static void vtkImageMomentKernelVoxel( const int idx[3], double offset,
+                                       double step, int subVoxels, int adaptive,
+                                       double *moments )
+{
+  const int numMoments = vtkImageMomentKernelOrder<Order>::NumberOfMoments;
+  double dx = 1.0 / offset;
+  for( int m = 0; m < numMoments; m++ )
+    moments[m] = 0;
+
+  // Adaptive integration: the voxel, in normalized coordinates, is only
+  // sub-sampled where the sphere crosses it.
+  if( adaptive )
+  {
+    double lo[3];
+    int n[3] = { subVoxels, subVoxels, subVoxels };
+    for( int axis = 0; axis < 3; axis++ )
+      lo[axis] = ( idx[axis] - offset ) * dx;
+    vtkImageMomentKernelAdaptiveMoments<Order>( lo, n, step * dx, moments );
+    return;
+  }
+
+  // The sums are computed in voxel units, then scaled to the normalized
+  // coordinates.
+  double sp[3]; // Sub-pixel coordinates for the integral approximation
+  double c[3]; // Centered coordinates
+  double sphereRadiusSq = offset * offset;
+  for( int axis = 0; axis < 3; axis++ )
+    c[axis] = idx[axis] + step / 2.0 - offset;
+
+  for( int idxSpX = 0; idxSpX < subVoxels; idxSpX++ ) 
+  {
+    sp[0] = c[0] + idxSpX * step;
+    for( int idxSpY = 0; idxSpY < subVoxels; idxSpY++)
+    {
+      sp[1] = c[1] + idxSpY * step;
+      for( int idxSpZ = 0; idxSpZ < subVoxels; idxSpZ++)
+      {
+        sp[2] = c[2] + idxSpZ * step;
+        if( (sp[0]*sp[0] + sp[1]*sp[1] + sp[2]*sp[2]) < sphereRadiusSq )
+        {
+          vtkImageMomentKernelSampleMoments<Order>( sp, 1.0, moments );
+        }
+      }
+    }
+  }
+
+  double dv = pow( step * dx, 3 );
+  for( int m = 0; m < numMoments; m++ )
+  {
+    const int *e = vtkImageMomentKernelExponents[m];
+    double scale = dv;
+    for( int p = 0; p < e[0] + e[1] + e[2]; p++ )
+      scale *= dx;
+    moments[m] *= scale;
+  }
+}
+
+//----------------------------------------------------------------------------
+struct vtkImageMomentKernelThreadStruct
+{
+  vtkImageMomentKernelSource *Filter;
+  double *OutPtr; //!< output scalars (whole extent, one component per moment)
+  int KernelSize;
+  double Step; //!< sub-voxel size (voxel units)
+  int SubVoxels; //!< number of sub-voxels per axis
+  int Adaptive;
+};
+
+//----------------------------------------------------------------------------
+// Each thread computes the rows (j,k) of the octant i,j,k >= KernelSize/2
+// for which (row index) % numThreads == threadId, and copies each voxel to its
+// 7 mirrors. The moments of the voxel mirrored through the kernel center
+// along an axis are multiplied by -1 if their monomial is odd along this
+// axis. Voxels on a symmetry plane have zero odd moments along the normal of
+// the plane.
+template <int Order>
+static VTK_THREAD_RETURN_TYPE vtkImageMomentKernelThreadedExecute( void *arg )
+{
+  vtkMultiThreader::ThreadInfo *info = static_cast<vtkMultiThreader::ThreadInfo*>( arg );
+  vtkImageMomentKernelThreadStruct *str = 
+    static_cast<vtkImageMomentKernelThreadStruct*>( info->UserData );
+  int threadId = info->ThreadID;
+  int numThreads = info->NumberOfThreads;
+
+  const int numMoments = vtkImageMomentKernelOrder<Order>::NumberOfMoments;
+  int size = str->KernelSize;
+  int middle = size / 2;
+  int octantSize = size - middle;
+  int numRows = octantSize * octantSize;
+  double offset = size / 2.0;
+  double moments[numMoments];
+
+  for( int row = threadId; row < numRows; row += numThreads )
+  {
+    if( str->Filter->GetAbortExecute( ) )
+      break;
+    if( threadId == 0 )
+      str->Filter->UpdateProgress( row / static_cast<double>( numRows ) );
+
+    int idx[3];
+    idx[1] = middle + row % octantSize;
+    idx[2] = middle + row / octantSize;
+    for( idx[0] = middle; idx[0] < size; idx[0]++ )
+    {
+      vtkImageMomentKernelVoxel<Order>( idx, offset, str->Step, str->SubVoxels,
+                                        str->Adaptive, moments );
+
+      for( int mirror = 0; mirror < 8; mirror++ )
+      {
+        int mirrorIdx[3], sign[3];
+        bool duplicate = false;
+        for( int axis = 0; axis < 3; axis++ )
+        {
+          int flip = ( mirror >> axis ) & 1;
+          duplicate = duplicate || ( flip && idx[axis] == middle );
+          mirrorIdx[axis] = flip ? 2 * middle - idx[axis] : idx[axis];
+          sign[axis] = idx[axis] == middle ? 0 : ( flip ? -1 : 1 );
+        }
+        if( duplicate )
+          continue;
+
+        double *outPtr = str->OutPtr + numMoments * 
+          ( ( static_cast<vtkIdType>( mirrorIdx[2] ) * size + mirrorIdx[1] ) 
+                                                             * size + mirrorIdx[0] );
+        for( int m = 0; m < numMoments; m++ )
+        {
+          double value = moments[m];
+          for( int axis = 0; axis < 3; axis++ )
+          {
+            if( vtkImageMomentKernelExponents[m][axis] % 2 )
+              value *= sign[axis];
+          }
+          outPtr[m] = value;
+        }
+      }
+    }
+  }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+// Cache entry of a kernel: a header (magic, version, kernel size, sub-voxels
+// per axis, adaptive flag, number of components) followed by the raw
+// doubles of the kernel, in the byte order of the host.
+static const char vtkImageMomentKernelCacheMagic[8] = "MOMKRNL";
+
+static std::string vtkImageMomentKernelCacheFile( const char *directory,
+                                                  const int header[5] )
+{
+  std::ostringstream name;
+  name << directory << "/MomentKernel_v" << header[0] << "_K" << header[1] 
+       << "_S" << header[2] << "_A" << header[3] << "_C" << header[4] << ".bin";
+  return( name.str( ) );
+}
+
+//----------------------------------------------------------------------------
+// Read the kernel of the given header in values. Returns 0 if the entry does
+// not exist or does not match.
+static int vtkImageMomentKernelReadCache( const std::string& fileName,
+                                          const int header[5], double *values, 
+                                          vtkIdType numValues )
+{
+  std::ifstream file( fileName.c_str( ), std::ios::in | std::ios::binary );
+  if( !file )
+  {
+    return( 0 );
+  }
+  char magic[8];
+  int fileHeader[5];
+  file.read( magic, sizeof( magic ) );
+  file.read( reinterpret_cast<char*>( fileHeader ), sizeof( fileHeader ) );
+  if( !file || std::string( magic, 8 ) != std::string( vtkImageMomentKernelCacheMagic, 8 ) )
+  {
+    return( 0 );
+  }
+  for( int i = 0; i < 5; i++ )
+  {
+    if( fileHeader[i] != header[i] )
+    {
+      return( 0 );
+    }
+  }
+  file.read( reinterpret_cast<char*>( values ), numValues * sizeof( double ) );
+  return( file.gcount( ) == static_cast<std::streamsize>( numValues * sizeof( double ) ) );
+}
+
+//----------------------------------------------------------------------------
+// Store the kernel in the cache. The entry is written in a file private to
+// the writer, named after the process and the source writing it, then
+// renamed, so that concurrent processes or sources never read a partial
+// entry.
+static int vtkImageMomentKernelWriteCache( const std::string& fileName,
+                                           const void *writer,
+                                           const int header[5], const double *values, 
+                                           vtkIdType numValues )
+{
+  std::ostringstream tmpName;
+  tmpName << fileName << "." << vtkImageMomentKernelGetPid( ) << "." << writer << ".tmp";
+  {
+    std::ofstream file( tmpName.str( ).c_str( ), std::ios::out | std::ios::binary );
+    if( !file )
+    {
+      return( 0 );
+    }
+    file.write( vtkImageMomentKernelCacheMagic, 8 );
+    file.write( reinterpret_cast<const char*>( header ), 5 * sizeof( int ) );
+    file.write( reinterpret_cast<const char*>( values ), numValues * sizeof( double ) );
+    if( !file )
+    {
+      file.close( );
+      remove( tmpName.str( ).c_str( ) );
+      return( 0 );
+    }
+  }
+  // rename does not replace an existing file on Windows: another process
+  // stored the same entry in the meantime.
+  if( rename( tmpName.str( ).c_str( ), fileName.c_str( ) ) != 0 )
+  {
+    remove( tmpName.str( ).c_str( ) );
+  }
+  return( 1 );
+}
+
 //----------------------------------------------------------------------------
 int vtkImageMomentKernelSource::RequestData(
-  vtkInformation* request,
+  vtkInformation* vtkNotUsed(request),
   vtkInformationVector** vtkNotUsed(inputVector),
   vtkInformationVector* outputVector)
 {
-  double *outPtr;
-  int idxX, idxY, idxZ;
-  int maxX, maxY, maxZ;
-  int maxApproxX, maxApproxY, maxApproxZ;
-  vtkIdType outIncX, outIncY, outIncZ;
-  unsigned long count = 0;
-  unsigned long target;
-  
-  // Moment kernel specifics
-   double offset = (double)this->KernelSize/2.0;
-   double step;
+  double step;
    
-   //! User asked to compute automatically the subvoxel approximation rate
-   if( this->AutoSubSampling )
-   {
-      //! Find the closest integer divisor of SubSampling for KernelSize
-      //! this ensure that each voxel will be divided entirely, ie no
-      //! partial volume effect will appear.
-      double dDiv = this->SubSampling / static_cast<double>( this->KernelSize );
-      int iDiv = static_cast<int>(dDiv);
-      ( dDiv - iDiv ) > 0.5 ? iDiv++:iDiv;
-      this->TrueSubSampling = this->KernelSize * iDiv;
+  //! User asked to compute automatically the subvoxel approximation rate
+  if( this->AutoSubSampling )
+  {
+    //! Find the closest integer divisor of SubSampling for KernelSize
+    //! this ensure that each voxel will be divided entirely, ie no
+    //! partial volume effect will appear.
+    double dDiv = this->SubSampling / static_cast<double>( this->KernelSize );
+    int iDiv = static_cast<int>(dDiv);
+    ( dDiv - iDiv ) > 0.5 ? iDiv++:iDiv;
+    iDiv = iDiv < 1 ? 1 : iDiv;
+    this->TrueSubSampling = this->KernelSize * iDiv;
       
-      step = this->KernelSize / static_cast<double>(this->TrueSubSampling);
-   }
-   else
-      step = 1.0 / static_cast<double>(this->SubSampling);
-   
-   double dv = pow(2.0 * step / static_cast<double>(this->KernelSize), 3);
-   double dx = 2.0 / static_cast<double>(this->KernelSize);
-   double sphereRadiusSq = offset * offset;
-  
-  double cX, cY, cZ; // Centered coordinates
-  double sum[10]; // the kernel values of a given moment come from an integral
-  double spX, spY, spZ; // Sub-pixel coordinates for the integral approximation
-  int idxSpX, idxSpY, idxSpZ; // for-loop variable for the sub-sampling
+    step = this->KernelSize / static_cast<double>(this->TrueSubSampling);
+  }
+  else
+  {
+    this->TrueSubSampling = this->KernelSize * this->SubSampling;
+    step = 1.0 / static_cast<double>(this->SubSampling);
+  }
   
   vtkInformation *outInfo = outputVector->GetInformationObject(0);
   vtkImageData *data = vtkImageData::SafeDownCast(
@@ -132,112 +515,75 @@ int vtkImageMomentKernelSource::RequestData(
   outInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(),extent);
   
   data->SetExtent(extent);
-  data->AllocateScalars(VTK_DOUBLE,10);
-  outPtr = static_cast<double*>(data->GetScalarPointerForExtent(extent));
+  int numMoments = this->GetNumberOfMoments( );
+  data->AllocateScalars(VTK_DOUBLE,numMoments);
 
   if (data->GetScalarType() != VTK_DOUBLE)
   {
     vtkErrorMacro("Execute: This source only outputs doubles");
+    return 0;
   }
-  
-  // find the region to loop over
-  maxX = extent[1] - extent[0];
-  maxY = extent[3] - extent[2]; 
-  maxZ = extent[5] - extent[4];
-  
-  maxApproxX = this->TrueSubSampling / this->KernelSize - 1;
-  maxApproxY = this->TrueSubSampling / this->KernelSize - 1;
-  maxApproxZ = this->TrueSubSampling / this->KernelSize - 1;
- 
-  //! Get increments to march through data 
-  data->GetContinuousIncrements(extent, outIncX, outIncY, outIncZ);
-  
-  target = static_cast<unsigned long>((maxZ+1)*(maxY+1)/50.0);
-  target++;
 
-  //! Loop through ouput pixels
-  for (idxZ = 0; idxZ <= maxZ; idxZ++)
+  double *outPtr = static_cast<double*>(data->GetScalarPointerForExtent(extent));
+  vtkIdType numValues = data->GetNumberOfPoints( ) * numMoments;
+
+  //! The kernel depends on the kernel size, the effective sub-sampling and
+  //! the integration mode only.
+  std::string cacheFile;
+  int header[5] = { VTK_MOMENT_KERNEL_CACHE_VERSION, this->KernelSize, 
+                    this->TrueSubSampling / this->KernelSize, 
+                    this->AdaptiveSubSampling, numMoments };
+  if( this->CacheDirectory && *this->CacheDirectory )
   {
-    cZ = idxZ + step / 2.0 - offset;
-    for (idxY = 0; !this->AbortExecute && idxY <= maxY; idxY++)
+    cacheFile = vtkImageMomentKernelCacheFile( this->CacheDirectory, header );
+    if( vtkImageMomentKernelReadCache( cacheFile, header, outPtr, numValues ) )
     {
-      if (!(count%target))
-        this->UpdateProgress(count/(50.0*target));
-      count++;
+      vtkDebugMacro( << "Kernel read from " << cacheFile );
+      data->GetPointData( )->GetScalars( )->SetName( "MomentKernel" );
+      data->GetPointData( )->SetActiveScalars( "MomentKernel" );
+      return 1;
+    }
+  }
 
-      cY = idxY + step / 2.0 - offset;
-      for (idxX = 0; idxX <= maxX; idxX++)
-      {
-        cX = idxX + step / 2.0 - offset; 
+  //! The 7 other octants are mirrors of the octant i,j,k >= KernelSize/2,
+  //! which is shared between the threads.
+  vtkImageMomentKernelThreadStruct str;
+  str.Filter = this;
+  str.OutPtr = outPtr;
+  str.KernelSize = this->KernelSize;
+  str.Step = step;
+  str.SubVoxels = this->TrueSubSampling / this->KernelSize;
+  str.Adaptive = this->AdaptiveSubSampling;
 
-        // Compute the kernel values for each moment
-        for( int i = 0; i < 10; i++)
-            sum[i] = 0;
+  this->Threader->SetNumberOfThreads( this->NumberOfThreads );
+  switch( this->MaximumOrder )
+  {
+    case 0:
+      this->Threader->SetSingleMethod( vtkImageMomentKernelThreadedExecute<0>, &str );
+      break;
+    case 1:
+      this->Threader->SetSingleMethod( vtkImageMomentKernelThreadedExecute<1>, &str );
+      break;
+    case 2:
+      this->Threader->SetSingleMethod( vtkImageMomentKernelThreadedExecute<2>, &str );
+      break;
+    case 3:
+      this->Threader->SetSingleMethod( vtkImageMomentKernelThreadedExecute<3>, &str );
+      break;
+    default:
+      this->Threader->SetSingleMethod( vtkImageMomentKernelThreadedExecute<4>, &str );
+      break;
+  }
+  this->Threader->SingleMethodExecute( );
 
-        for( idxSpX = 0; idxSpX <= maxApproxX; idxSpX++ ) 
-        {
-            spX = cX + idxSpX * step;
-            for( idxSpY = 0; idxSpY <= maxApproxY; idxSpY++)
-            {
-               spY = cY + idxSpY * step;
-               for(idxSpZ = 0; idxSpZ <= maxApproxZ; idxSpZ++)
-               {
-                  spZ = cZ + idxSpZ * step;
-                  if( (spX*spX + spY*spY + spZ*spZ) < sphereRadiusSq )
-                  {
-                     sum[0] += 1.0;
-                     sum[1] += spX;
-                     sum[2] += spY;
-                     sum[3] += spZ;
-                     sum[4] += spX*spY;
-                     sum[5] += spX*spZ;
-                     sum[6] += spY*spZ;
-                     sum[7] += spX*spX;
-                     sum[8] += spY*spY;
-                     sum[9] += spZ*spZ;
-                  }
-               }
-            }
-         }
-
-        // Pixel operation
-        // M000
-        *outPtr = dv * sum[0];
-        outPtr++;
-        //M100;
-        *outPtr = dv * dx * sum[1];
-        outPtr++;
-        //M010;
-        *outPtr = dv * dx * sum[2];
-        outPtr++;
-        //M001;
-        *outPtr = dv * dx * sum[3];
-        outPtr++;
-        //M110;
-        *outPtr = dv * dx * dx * sum[4];
-        outPtr++;
-        //M101;
-        *outPtr = dv * dx * dx * sum[5];
-        outPtr++;
-        //M011;
-        *outPtr = dv * dx * dx * sum[6];
-        outPtr++;
-        //M200;
-        *outPtr = dv * dx * dx * sum[7];
-        outPtr++;
-        //M020;
-        *outPtr = dv * dx * dx * sum[8];
-        outPtr++;
-        //M002;
-        *outPtr = dv * dx * dx * sum[9];
-        outPtr++;
-      }
-      
-      outPtr += outIncY;
-    }
-    
-    outPtr += outIncZ;
+  if( !cacheFile.empty( ) && !this->AbortExecute )
+  {
+    vtkDirectory::MakeDirectory( this->CacheDirectory );
+    if( !vtkImageMomentKernelWriteCache( cacheFile, this, header, outPtr, numValues ) )
+    {
+      vtkWarningMacro( << "Cannot store the kernel in " << cacheFile );
     }
+  }
 
   data->GetPointData( )->GetScalars( )->SetName( "MomentKernel" );
   data->GetPointData( )->SetActiveScalars( "MomentKernel" );
@@ -251,6 +597,11 @@ void vtkImageMomentKernelSource::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "KernelSize: " << this->KernelSize << "\n";
   os << indent << "AutoSubSampling: " << this->AutoSubSampling << "\n";
   os << indent << "SubSampling: " << this->SubSampling << "\n";
+  os << indent << "AdaptiveSubSampling: " << this->AdaptiveSubSampling << "\n";
+  os << indent << "MaximumOrder: " << this->MaximumOrder << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "CacheDirectory: " 
+     << ( this->CacheDirectory ? this->CacheDirectory : "(none)" ) << "\n";
   os << indent << indent   << "approximation step: " 
                            << this->KernelSize / (double)this->SubSampling << "\n";
   os << indent << indent   << "max approximation step: " 
@@ -29,6 +29,34 @@
 //! If one single of these moments is of interest, use vtkImageExtractComponents
 //! from the vtk library.
 //!
+//! The moments up to MaximumOrder (0 to 4, default 2) are computed, so the
+//! output has 1, 4, 10, 20 or 35 components. The moments of order 3 and 4
+//! follow the ones above, in decreasing lexicographic order:
+//! component: 10   11   12   13   14   15   16   17   18   19
+//! moment :   M300 M210 M201 M120 M111 M102 M030 M021 M012 M003
+//! component: 20   21   22   23   24   25   26   27   28   29  ... 34
+//! moment :   M400 M310 M301 M220 M211 M202 M130 M121 M112 M103 ... M004
+//!
+//! Each voxel value is the integral of the monomial on the part of the voxel
+//! inside the sphere of diameter KernelSize, in coordinates normalized to the
+//! unit sphere. By default every sub-voxel of every voxel is sampled at its
+//! center. With AdaptiveSubSampling, the voxels inside the sphere are
+//! integrated exactly, the voxels outside are zero, and the voxels crossed by
+//! the sphere are split recursively: only the sub-voxels the sphere boundary
+//! crosses are sampled. This is faster and closer to the exact integral, but
+//! the order 2 moments of the boundary voxels differ from the sampled ones.
+//!
+//! The kernels are symmetric or antisymmetric under the reflections through
+//! the kernel center, so only one octant is computed, by NumberOfThreads
+//! threads, and mirrored with the sign of each moment.
+//!
+//! If a CacheDirectory is set, the kernel is first looked up in this
+//! directory, and stored there once computed. The entries are keyed by the
+//! kernel size, the effective sub-sampling, the integration mode, the number
+//! of moments and a format version; they are raw doubles in the byte order
+//! of the host, so the directory should not be shared between different
+//! architectures.
+//!
 //! \author Jerome Velut
 //! \date 8 apr 2010
 
@@ -37,6 +65,8 @@
 
 #include "vtkImageAlgorithm.h"
 
+class vtkMultiThreader;
+
 class VTK_EXPORT vtkImageMomentKernelSource : public vtkImageAlgorithm
 {
 public:
@@ -60,10 +90,35 @@ public:
   vtkSetMacro( AutoSubSampling, int );
   vtkGetMacro( AutoSubSampling, int );
 
+  //! Integrates exactly the sub-voxels inside the sphere and samples only the
+  //! ones crossed by its boundary (1), or samples all of them (0, default)
+  vtkBooleanMacro( AdaptiveSubSampling, int );
+  vtkSetMacro( AdaptiveSubSampling, int );
+  vtkGetMacro( AdaptiveSubSampling, int );
+
+  //! Set/Get the highest order of the computed moments (0 to 4, default 2)
+  vtkSetClampMacro( MaximumOrder, int, 0, 4 );
+  vtkGetMacro( MaximumOrder, int );
+
+  //! Number of output components for MaximumOrder
+  int GetNumberOfMoments( )
+    {
+    return( ( this->MaximumOrder + 1 ) * ( this->MaximumOrder + 2 ) 
+            * ( this->MaximumOrder + 3 ) / 6 );
+    }
+
+  //! Set/Get the number of threads computing the kernel octant
+  vtkSetClampMacro( NumberOfThreads, int, 1, VTK_MAX_THREADS );
+  vtkGetMacro( NumberOfThreads, int );
+
+  //! Set/Get the directory where the kernels are cached (none by default)
+  vtkSetStringMacro( CacheDirectory );
+  vtkGetStringMacro( CacheDirectory );
+
 protected:
   //! constructor
   vtkImageMomentKernelSource();
-  ~vtkImageMomentKernelSource() {};
+  ~vtkImageMomentKernelSource();
 
   int KernelSize; //!< Moment kernel size. Equal to output extent
   int SubSampling; //!< Depending on AutoSubSampling value, it has 2 meanings:
@@ -72,6 +127,11 @@ protected:
   int TrueSubSampling; //!< Internal use : it is the closest divisor of SubSampling according to KernelSize
   int AutoSubSampling; //!< specify wether the voxel subsampling is the same for any kernel size or if
                        //!< it depends on it.
+  int AdaptiveSubSampling; //!< if 1, only the voxels crossed by the sphere are sub-sampled
+  int MaximumOrder; //!< highest order of the computed moments
+  int NumberOfThreads; //!< number of threads computing the kernel octant
+  vtkMultiThreader *Threader; //!< threads computing the kernel octant
+  char *CacheDirectory; //!< directory of the kernel cache, if any
 
   //! VTK Pipelining functions
   virtual int RequestInformation (vtkInformation *, vtkInformationVector**, vtkInformationVector *);
@@ -0,0 +1,88 @@
+// Copyright (c) 2010, Jérôme Velut
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER ``AS IS'' AND ANY EXPRESS 
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN 
+// NO EVENT SHALL THE COPYRIGHT OWNER BE LIABLE FOR ANY DIRECT, INDIRECT, 
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+// EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+#include "vtkThreadedImageExtentAlgorithm.h"
+#include "vtkMultiThreader.h"
+
+//----------------------------------------------------------------------------
+// Arguments of vtkThreadedImageExtentAlgorithmExecute
+struct vtkThreadedImageExtentAlgorithmThreadStruct
+{
+  vtkThreadedImageAlgorithm *Filter;
+  vtkInformation *Request;
+  vtkInformationVector **InputsInfo;
+  vtkInformationVector *OutputsInfo;
+  vtkImageData ***Inputs;
+  vtkImageData **Outputs;
+  int *Extent;
+};
+
+//----------------------------------------------------------------------------
+// Same as the thread function of vtkThreadedImageAlgorithm, on the given
+// extent instead of the update extent.
+static VTK_THREAD_RETURN_TYPE vtkThreadedImageExtentAlgorithmExecute( void *arg )
+{
+  vtkMultiThreader::ThreadInfo *info = static_cast<vtkMultiThreader::ThreadInfo*>( arg );
+  vtkThreadedImageExtentAlgorithmThreadStruct *str = 
+          static_cast<vtkThreadedImageExtentAlgorithmThreadStruct*>( info->UserData );
+
+  int splitExt[6];
+  int total = str->Filter->SplitExtent( splitExt, str->Extent, 
+                                        info->ThreadID, info->NumberOfThreads );
+  if( info->ThreadID < total )
+    {
+    str->Filter->ThreadedRequestData( str->Request, str->InputsInfo, 
+                                      str->OutputsInfo, str->Inputs,
+                                      str->Outputs, splitExt, info->ThreadID );
+    }
+  return( VTK_THREAD_RETURN_VALUE );
+}
+
+//----------------------------------------------------------------------------
+void vtkThreadedImageExtentAlgorithm::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+}
+
+//----------------------------------------------------------------------------
+void vtkThreadedImageExtentAlgorithm::ThreadedRequestExtent( vtkInformation *request,
+                                              vtkInformationVector **inputVector,
+                                              vtkInformationVector *outputVector,
+                                              vtkImageData ***inData,
+                                              vtkImageData **outData,
+                                              int extent[6] )
+{
+  vtkThreadedImageExtentAlgorithmThreadStruct str;
+  str.Filter = this;
+  str.Request = request;
+  str.InputsInfo = inputVector;
+  str.OutputsInfo = outputVector;
+  str.Inputs = inData;
+  str.Outputs = outData;
+  str.Extent = extent;
+
+  this->Threader->SetNumberOfThreads( this->NumberOfThreads );
+  this->Threader->SetSingleMethod( vtkThreadedImageExtentAlgorithmExecute, &str );
+  this->Threader->SingleMethodExecute( );
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2010, Jérôme Velut
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER ``AS IS'' AND ANY EXPRESS 
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN 
+// NO EVENT SHALL THE COPYRIGHT OWNER BE LIABLE FOR ANY DIRECT, INDIRECT, 
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+// EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+//! \class vtkThreadedImageExtentAlgorithm
+//! \brief vtkThreadedImageAlgorithm threading any extent of allocated outputs
+//!
+//! vtkThreadedImageAlgorithm::RequestData allocates the outputs on the update
+//! extent before it splits this extent between the threads. The subclasses
+//! that allocate their outputs themselves (only the requested arrays, or one
+//! slab at a time) call ThreadedRequestExtent from their RequestData instead:
+//! it splits the given extent with SplitExtent and runs ThreadedRequestData
+//! on each piece, as the superclass would.
+
+#ifndef __vtkThreadedImageExtentAlgorithm_h
+#define __vtkThreadedImageExtentAlgorithm_h
+
+#include "vtkThreadedImageAlgorithm.h"
+
+class VTK_EXPORT vtkThreadedImageExtentAlgorithm : public vtkThreadedImageAlgorithm
+{
+public:
+  vtkTypeMacro(vtkThreadedImageExtentAlgorithm,vtkThreadedImageAlgorithm);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+protected:
+  vtkThreadedImageExtentAlgorithm( ) {};
+  ~vtkThreadedImageExtentAlgorithm( ) {};
+
+  //! Split extent between NumberOfThreads threads and execute
+  //! ThreadedRequestData on each piece. The outputs must be allocated.
+  void ThreadedRequestExtent( vtkInformation *request,
+                              vtkInformationVector **inputVector,
+                              vtkInformationVector *outputVector,
+                              vtkImageData ***inData,
+                              vtkImageData **outData,
+                              int extent[6] );
+
+private:
+  vtkThreadedImageExtentAlgorithm(const vtkThreadedImageExtentAlgorithm&);  // Not implemented.
+  void operator=(const vtkThreadedImageExtentAlgorithm&);  // Not implemented.
+};
+
+#endif //__vtkThreadedImageExtentAlgorithm_h
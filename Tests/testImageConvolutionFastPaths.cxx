@@ -0,0 +1,480 @@
+// Copyright (c) 2010, Jérôme Velut
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER ``AS IS'' AND ANY EXPRESS 
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN 
+// NO EVENT SHALL THE COPYRIGHT OWNER BE LIABLE FOR ANY DIRECT, INDIRECT, 
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+// EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Compares the fast execution paths of vtkImageConvolution with the direct
+// neighbourhood loop.
+
+#include <vtkImageConvolution.h>
+#include <vtkImageMomentKernelSource.h>
+
+#include <vtkSmartPointer.h>
+#include <vtkImageNoiseSource.h>
+#include <vtkImageGaussianSource.h>
+#include <vtkImageAppendComponents.h>
+#include <vtkImageDataStreamer.h>
+#include <vtkImageThreshold.h>
+#include <vtkImageClip.h>
+#include <vtkImageShiftScale.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkFloatArray.h>
+#include <vtkObjectFactory.h>
+
+#include <math.h>
+
+// Maximum difference between two images, relative to the range of the first.
+double MaxRelativeDifference( vtkImageData* reference, vtkImageData* image )
+{
+   vtkDataArray* refScalars = reference->GetPointData( )->GetScalars( );
+   vtkDataArray* scalars = image->GetPointData( )->GetScalars( );
+   double maxDiff = 0, maxValue = 0;
+   for( vtkIdType i = 0; i < refScalars->GetNumberOfTuples( ); i++ )
+   {
+      for( int c = 0; c < refScalars->GetNumberOfComponents( ); c++ )
+      {
+         double ref = refScalars->GetComponent( i, c );
+         double diff = fabs( ref - scalars->GetComponent( i, c ) );
+         maxDiff = diff > maxDiff ? diff : maxDiff;
+         maxValue = fabs( ref ) > maxValue ? fabs( ref ) : maxValue;
+      }
+   }
+   return( maxValue > 0 ? maxDiff / maxValue : maxDiff );
+}
+
+// Convolution counting the preparations of its kernel
+class vtkCountingImageConvolution : public vtkImageConvolution
+{
+public:
+   static vtkCountingImageConvolution *New();
+   vtkTypeMacro(vtkCountingImageConvolution,vtkImageConvolution);
+
+   int NumberOfPreparations;
+
+protected:
+   vtkCountingImageConvolution( ) { this->NumberOfPreparations = 0; }
+
+   virtual void PrepareKernel( vtkImageData* kernel, int inNumComps )
+   {
+      this->NumberOfPreparations++;
+      this->Superclass::PrepareKernel( kernel, inNumComps );
+   }
+};
+
+vtkStandardNewMacro(vtkCountingImageConvolution);
+
+int main( int argc, char* argv[] )
+{
+   int status = 0;
+
+   vtkSmartPointer<vtkImageNoiseSource> image = vtkSmartPointer<vtkImageNoiseSource>::New( );
+   image->SetWholeExtent( 0, 40, 0, 35, 0, 30 );
+   image->SetMinimum( 0 );
+   image->SetMaximum( 100 );
+   image->Update( );
+
+   // Separable kernel (gaussian) next to non separable ones (moments)
+   vtkSmartPointer<vtkImageGaussianSource> gaussian = vtkSmartPointer<vtkImageGaussianSource>::New( );
+   gaussian->SetWholeExtent( 0, 8, 0, 8, 0, 8 );
+   gaussian->SetCenter( 4, 4, 4 );
+   gaussian->SetStandardDeviation( 2 );
+
+   vtkSmartPointer<vtkImageMomentKernelSource> moments = vtkSmartPointer<vtkImageMomentKernelSource>::New( );
+   moments->SetKernelSize( 9 );
+   moments->SetSubSampling( 36 );
+
+   vtkSmartPointer<vtkImageAppendComponents> kernel = vtkSmartPointer<vtkImageAppendComponents>::New( );
+   kernel->AddInputConnection( gaussian->GetOutputPort( ) );
+   kernel->AddInputConnection( moments->GetOutputPort( ) );
+
+   vtkSmartPointer<vtkImageConvolution> direct = vtkSmartPointer<vtkImageConvolution>::New( );
+   direct->SetInputData( image->GetOutput( ) );
+   direct->SetKernelConnection( kernel->GetOutputPort( ) );
+   direct->SeparableKernelOff( );
+   direct->SetFFTKernelSizeThreshold( 0 );
+   direct->Update( );
+
+   // Neighbourhood loop instead of the blocked product
+   vtkSmartPointer<vtkImageConvolution> loop = vtkSmartPointer<vtkImageConvolution>::New( );
+   loop->SetInputData( image->GetOutput( ) );
+   loop->SetKernelConnection( kernel->GetOutputPort( ) );
+   loop->SeparableKernelOff( );
+   loop->SetFFTKernelSizeThreshold( 0 );
+   loop->BlockedKernelProductOff( );
+   loop->Update( );
+
+   double diff = MaxRelativeDifference( loop->GetOutput( ), direct->GetOutput( ) );
+   if( diff > 1e-9 )
+   {
+      std::cerr << "Blocked product differs from the neighbourhood loop: " << diff << std::endl;
+      status = 1;
+   }
+
+   // Separable kernel components
+   vtkSmartPointer<vtkImageConvolution> separable = vtkSmartPointer<vtkImageConvolution>::New( );
+   separable->SetInputData( image->GetOutput( ) );
+   separable->SetKernelConnection( kernel->GetOutputPort( ) );
+   separable->SeparableKernelOn( );
+   separable->SetFFTKernelSizeThreshold( 0 );
+   separable->Update( );
+
+   diff = MaxRelativeDifference( direct->GetOutput( ), separable->GetOutput( ) );
+   if( diff > 1e-9 )
+   {
+      std::cerr << "Separable path differs from the direct loop: " << diff << std::endl;
+      status = 1;
+   }
+
+   // All kernel components in the frequency domain
+   vtkSmartPointer<vtkCountingImageConvolution> fft = vtkSmartPointer<vtkCountingImageConvolution>::New( );
+   fft->SetInputData( image->GetOutput( ) );
+   fft->SetKernelConnection( kernel->GetOutputPort( ) );
+   fft->SeparableKernelOff( );
+   fft->SetFFTKernelSizeThreshold( 1 );
+   fft->Update( );
+
+   diff = MaxRelativeDifference( direct->GetOutput( ), fft->GetOutput( ) );
+   if( diff > 1e-9 )
+   {
+      std::cerr << "FFT path differs from the direct loop: " << diff << std::endl;
+      status = 1;
+   }
+
+   // Separable passes with the clamp and mirror boundary conditions
+   for( int boundary = VTK_CONVOLUTION_BOUNDARY_CLAMP; 
+        boundary <= VTK_CONVOLUTION_BOUNDARY_MIRROR; boundary++ )
+   {
+      direct->SetBoundaryCondition( boundary );
+      direct->Update( );
+      separable->SetBoundaryCondition( boundary );
+      separable->Update( );
+
+      diff = MaxRelativeDifference( direct->GetOutput( ), separable->GetOutput( ) );
+      if( diff > 1e-9 )
+      {
+         std::cerr << "Separable path differs from the direct loop with the "
+                   << separable->GetBoundaryConditionAsString( ) 
+                   << " boundary condition: " << diff << std::endl;
+         status = 1;
+      }
+   }
+
+   // Streamed pieces, and slabs, against the whole volume execution
+   direct->SetBoundaryCondition( VTK_CONVOLUTION_BOUNDARY_ZERO );
+   direct->Update( );
+
+   vtkSmartPointer<vtkImageConvolution> piece = vtkSmartPointer<vtkImageConvolution>::New( );
+   piece->SetInputData( image->GetOutput( ) );
+   piece->SetKernelConnection( kernel->GetOutputPort( ) );
+   vtkSmartPointer<vtkImageDataStreamer> streamer = vtkSmartPointer<vtkImageDataStreamer>::New( );
+   streamer->SetInputConnection( piece->GetOutputPort( ) );
+   streamer->SetNumberOfStreamDivisions( 4 );
+   streamer->Update( );
+
+   diff = MaxRelativeDifference( direct->GetOutput( ), streamer->GetOutput( ) );
+   if( diff > 1e-9 )
+   {
+      std::cerr << "Streamed execution differs from the whole volume: " << diff << std::endl;
+      status = 1;
+   }
+
+   // The input carries a second point data array, passed to the output by
+   // both executions
+   vtkSmartPointer<vtkImageData> attributed = vtkSmartPointer<vtkImageData>::New( );
+   attributed->ShallowCopy( image->GetOutput( ) );
+   vtkSmartPointer<vtkFloatArray> index = vtkSmartPointer<vtkFloatArray>::New( );
+   index->SetName( "Index" );
+   index->SetNumberOfTuples( attributed->GetNumberOfPoints( ) );
+   for( vtkIdType i = 0; i < attributed->GetNumberOfPoints( ); i++ )
+   {
+      index->SetValue( i, static_cast<float>( i ) );
+   }
+   attributed->GetPointData( )->AddArray( index );
+
+   vtkSmartPointer<vtkImageConvolution> whole = vtkSmartPointer<vtkImageConvolution>::New( );
+   whole->SetInputData( attributed );
+   whole->SetKernelConnection( kernel->GetOutputPort( ) );
+   whole->Update( );
+
+   vtkSmartPointer<vtkImageConvolution> slabs = vtkSmartPointer<vtkImageConvolution>::New( );
+   slabs->SetInputData( attributed );
+   slabs->SetKernelConnection( kernel->GetOutputPort( ) );
+   slabs->SetMemoryLimit( 256 );
+   slabs->Update( );
+
+   diff = MaxRelativeDifference( direct->GetOutput( ), slabs->GetOutput( ) );
+   if( diff > 1e-9 )
+   {
+      std::cerr << "Slab execution differs from the whole volume: " << diff << std::endl;
+      status = 1;
+   }
+
+   vtkPointData* wholeData = whole->GetOutput( )->GetPointData( );
+   vtkPointData* slabData = slabs->GetOutput( )->GetPointData( );
+   vtkDataArray* passed = slabData->GetArray( "Index" );
+   if( slabData->GetNumberOfArrays( ) != wholeData->GetNumberOfArrays( ) 
+       || !wholeData->GetArray( "Index" ) || !passed 
+       || passed->GetNumberOfTuples( ) != index->GetNumberOfTuples( ) )
+   {
+      std::cerr << "Slab execution does not pass the input arrays" << std::endl;
+      status = 1;
+   }
+   else
+   {
+      for( vtkIdType i = 0; i < index->GetNumberOfTuples( ); i++ )
+      {
+         if( passed->GetComponent( i, 0 ) != index->GetValue( i ) )
+         {
+            std::cerr << "Slab execution passes a wrong Index at point " << i << std::endl;
+            status = 1;
+            break;
+         }
+      }
+   }
+
+   // Single precision storage
+   vtkSmartPointer<vtkImageConvolution> single = vtkSmartPointer<vtkImageConvolution>::New( );
+   single->SetInputData( image->GetOutput( ) );
+   single->SetKernelConnection( kernel->GetOutputPort( ) );
+   single->SetOutputScalarTypeToFloat( );
+   single->Update( );
+
+   diff = MaxRelativeDifference( direct->GetOutput( ), single->GetOutput( ) );
+   if( single->GetOutput( )->GetScalarType( ) != VTK_FLOAT || diff > 1e-6 )
+   {
+      std::cerr << "Float output differs from the double output: " << diff << std::endl;
+      status = 1;
+   }
+
+   // An unsupported output type is rejected before the execution
+   vtkSmartPointer<vtkImageConvolution> integer = vtkSmartPointer<vtkImageConvolution>::New( );
+   integer->SetInputData( image->GetOutput( ) );
+   integer->SetKernelConnection( kernel->GetOutputPort( ) );
+   integer->SetOutputScalarType( VTK_INT );
+   integer->Update( );
+   if( integer->GetOutput( )->GetPointData( )->GetScalars( ) )
+   {
+      std::cerr << "An int output was computed" << std::endl;
+      status = 1;
+   }
+
+   // Mask: the masked voxels are the ones of the whole volume run, the others
+   // are zero
+   vtkSmartPointer<vtkImageThreshold> mask = vtkSmartPointer<vtkImageThreshold>::New( );
+   mask->SetInputData( image->GetOutput( ) );
+   mask->ThresholdByUpper( 95 );
+   mask->SetInValue( 1 );
+   mask->SetOutValue( 0 );
+   mask->SetOutputScalarTypeToUnsignedChar( );
+   mask->Update( );
+
+   vtkSmartPointer<vtkImageConvolution> masked = vtkSmartPointer<vtkImageConvolution>::New( );
+   masked->SetInputData( image->GetOutput( ) );
+   masked->SetKernelConnection( kernel->GetOutputPort( ) );
+   masked->SetMaskConnection( mask->GetOutputPort( ) );
+   masked->Update( );
+
+   vtkDataArray* maskScalars = mask->GetOutput( )->GetPointData( )->GetScalars( );
+   vtkDataArray* maskedScalars = masked->GetOutput( )->GetPointData( )->GetScalars( );
+   vtkDataArray* directScalars = direct->GetOutput( )->GetPointData( )->GetScalars( );
+   double maxDiff = 0;
+   for( vtkIdType i = 0; i < maskedScalars->GetNumberOfTuples( ); i++ )
+   {
+      for( int c = 0; c < maskedScalars->GetNumberOfComponents( ); c++ )
+      {
+         double expected = maskScalars->GetComponent( i, 0 ) ? directScalars->GetComponent( i, c ) : 0;
+         double d = fabs( expected - maskedScalars->GetComponent( i, c ) );
+         maxDiff = d > maxDiff ? d : maxDiff;
+      }
+   }
+   if( maxDiff > 1e-6 )
+   {
+      std::cerr << "Masked execution differs from the whole volume: " << maxDiff << std::endl;
+      status = 1;
+   }
+
+   // A mask smaller than the output is rejected: no output
+   vtkSmartPointer<vtkImageClip> smallMask = vtkSmartPointer<vtkImageClip>::New( );
+   smallMask->SetInputConnection( mask->GetOutputPort( ) );
+   smallMask->SetOutputWholeExtent( 0, 20, 0, 35, 0, 30 );
+   smallMask->ClipDataOn( );
+
+   vtkSmartPointer<vtkImageConvolution> mismatched = vtkSmartPointer<vtkImageConvolution>::New( );
+   mismatched->SetInputData( image->GetOutput( ) );
+   mismatched->SetKernelConnection( kernel->GetOutputPort( ) );
+   mismatched->SetMaskConnection( smallMask->GetOutputPort( ) );
+   vtkObject::GlobalWarningDisplayOff( );
+   mismatched->Update( );
+   vtkObject::GlobalWarningDisplayOn( );
+   if( mismatched->GetOutput( )->GetNumberOfPoints( ) != 0 )
+   {
+      std::cerr << "A mask smaller than the output is accepted" << std::endl;
+      status = 1;
+   }
+
+   // Fixed point accumulation on 12 bits data stored as unsigned short
+   vtkSmartPointer<vtkImageShiftScale> cast = vtkSmartPointer<vtkImageShiftScale>::New( );
+   cast->SetInputData( image->GetOutput( ) );
+   cast->SetScale( 40 );
+   cast->SetOutputScalarTypeToUnsignedShort( );
+   cast->Update( );
+
+   vtkSmartPointer<vtkImageConvolution> floating = vtkSmartPointer<vtkImageConvolution>::New( );
+   floating->SetInputConnection( cast->GetOutputPort( ) );
+   floating->SetKernelConnection( kernel->GetOutputPort( ) );
+   floating->SeparableKernelOff( );
+   floating->SetFFTKernelSizeThreshold( 0 );
+   floating->Update( );
+
+   // Without the blocked product, all the components are in fixed point
+   vtkSmartPointer<vtkImageConvolution> fixed = vtkSmartPointer<vtkImageConvolution>::New( );
+   fixed->SetInputConnection( cast->GetOutputPort( ) );
+   fixed->SetKernelConnection( kernel->GetOutputPort( ) );
+   fixed->SeparableKernelOff( );
+   fixed->SetFFTKernelSizeThreshold( 0 );
+   fixed->BlockedKernelProductOff( );
+   fixed->FixedPointOn( );
+   fixed->SetFixedPointInputBits( 12 );
+   fixed->Update( );
+
+   // Inputs below 4096: 16 bits taps, error about N max(input) max|w| 2^-16
+   diff = MaxRelativeDifference( floating->GetOutput( ), fixed->GetOutput( ) );
+   if( diff > 1e-4 )
+   {
+      std::cerr << "Fixed point accumulation differs from the double one: " << diff << std::endl;
+      status = 1;
+   }
+
+   // The slabs and the streamed pieces use the same taps as the whole volume
+   vtkSmartPointer<vtkImageConvolution> fixedSlabs = vtkSmartPointer<vtkImageConvolution>::New( );
+   fixedSlabs->SetInputConnection( cast->GetOutputPort( ) );
+   fixedSlabs->SetKernelConnection( kernel->GetOutputPort( ) );
+   fixedSlabs->SeparableKernelOff( );
+   fixedSlabs->SetFFTKernelSizeThreshold( 0 );
+   fixedSlabs->BlockedKernelProductOff( );
+   fixedSlabs->FixedPointOn( );
+   fixedSlabs->SetFixedPointInputBits( 12 );
+   fixedSlabs->SetMemoryLimit( 256 );
+   fixedSlabs->Update( );
+
+   diff = MaxRelativeDifference( fixed->GetOutput( ), fixedSlabs->GetOutput( ) );
+   if( diff != 0 )
+   {
+      std::cerr << "Fixed point slabs differ from the whole volume: " << diff << std::endl;
+      status = 1;
+   }
+
+   vtkSmartPointer<vtkImageConvolution> fixedPiece = vtkSmartPointer<vtkImageConvolution>::New( );
+   fixedPiece->SetInputConnection( cast->GetOutputPort( ) );
+   fixedPiece->SetKernelConnection( kernel->GetOutputPort( ) );
+   fixedPiece->SeparableKernelOff( );
+   fixedPiece->SetFFTKernelSizeThreshold( 0 );
+   fixedPiece->BlockedKernelProductOff( );
+   fixedPiece->FixedPointOn( );
+   fixedPiece->SetFixedPointInputBits( 12 );
+   vtkSmartPointer<vtkImageDataStreamer> fixedStreamer = vtkSmartPointer<vtkImageDataStreamer>::New( );
+   fixedStreamer->SetInputConnection( fixedPiece->GetOutputPort( ) );
+   fixedStreamer->SetNumberOfStreamDivisions( 4 );
+   fixedStreamer->Update( );
+
+   diff = MaxRelativeDifference( fixed->GetOutput( ), fixedStreamer->GetOutput( ) );
+   if( diff != 0 )
+   {
+      std::cerr << "Fixed point pieces differ from the whole volume: " << diff << std::endl;
+      status = 1;
+   }
+
+   // Input values above 2^FixedPointInputBits - 1 are rejected: no output
+   vtkSmartPointer<vtkImageConvolution> narrow = vtkSmartPointer<vtkImageConvolution>::New( );
+   narrow->SetInputConnection( cast->GetOutputPort( ) );
+   narrow->SetKernelConnection( kernel->GetOutputPort( ) );
+   narrow->SeparableKernelOff( );
+   narrow->SetFFTKernelSizeThreshold( 0 );
+   narrow->FixedPointOn( );
+   narrow->SetFixedPointInputBits( 8 );
+   vtkObject::GlobalWarningDisplayOff( );
+   narrow->Update( );
+   vtkObject::GlobalWarningDisplayOn( );
+   if( narrow->GetOutput( )->GetNumberOfPoints( ) != 0 )
+   {
+      std::cerr << "Input values above FixedPointInputBits are accepted" << std::endl;
+      status = 1;
+   }
+
+   // With the blocked product, the 11 direct components keep it
+   vtkSmartPointer<vtkImageConvolution> fixedBlocked = vtkSmartPointer<vtkImageConvolution>::New( );
+   fixedBlocked->SetInputConnection( cast->GetOutputPort( ) );
+   fixedBlocked->SetKernelConnection( kernel->GetOutputPort( ) );
+   fixedBlocked->SeparableKernelOff( );
+   fixedBlocked->SetFFTKernelSizeThreshold( 0 );
+   fixedBlocked->FixedPointOn( );
+   fixedBlocked->Update( );
+
+   diff = MaxRelativeDifference( floating->GetOutput( ), fixedBlocked->GetOutput( ) );
+   if( diff > 1e-9 )
+   {
+      std::cerr << "The blocked product is not used with many components: " << diff << std::endl;
+      status = 1;
+   }
+
+   // The prepared kernel of fft is reused on a new image of the same size
+   vtkSmartPointer<vtkImageNoiseSource> image2 = vtkSmartPointer<vtkImageNoiseSource>::New( );
+   image2->SetWholeExtent( 0, 40, 0, 35, 0, 30 );
+   image2->SetMinimum( -50 );
+   image2->SetMaximum( 50 );
+   image2->Update( );
+
+   fft->SetInputData( image2->GetOutput( ) );
+   fft->Update( );
+
+   vtkSmartPointer<vtkImageConvolution> fresh = vtkSmartPointer<vtkImageConvolution>::New( );
+   fresh->SetInputData( image2->GetOutput( ) );
+   fresh->SetKernelConnection( kernel->GetOutputPort( ) );
+   fresh->SeparableKernelOff( );
+   fresh->SetFFTKernelSizeThreshold( 0 );
+   fresh->Update( );
+
+   diff = MaxRelativeDifference( fresh->GetOutput( ), fft->GetOutput( ) );
+   if( diff > 1e-9 )
+   {
+      std::cerr << "Reused kernel differs from a new preparation: " << diff << std::endl;
+      status = 1;
+   }
+   if( fft->NumberOfPreparations != 1 )
+   {
+      std::cerr << "The kernel was prepared " << fft->NumberOfPreparations
+                << " times for two executions with the same kernel" << std::endl;
+      status = 1;
+   }
+
+   // A setting driving the preparation prepares the kernel again
+   fft->SetMaximumSeparableRank( 2 );
+   fft->Update( );
+   if( fft->NumberOfPreparations != 2 )
+   {
+      std::cerr << "The kernel was not prepared again after a change of the settings"
+                << std::endl;
+      status = 1;
+   }
+
+   return( status );
+}
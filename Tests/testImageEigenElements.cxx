@@ -0,0 +1,504 @@
+// Copyright (c) 2010, Jérôme Velut
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER ``AS IS'' AND ANY EXPRESS 
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN 
+// NO EVENT SHALL THE COPYRIGHT OWNER BE LIABLE FOR ANY DIRECT, INDIRECT, 
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+// EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Compares the closed form eigen solver of vtkImageEigenElements with
+// vtkMath::Jacobi, on random and on (nearly) degenerate tensors, the
+// threaded filter with a single thread, the selected float outputs, the
+// measures (Vesselness against the Frangi formula), and the masked and
+// compact outputs with the complete double eigen elements.
+
+#include <vtkImageEigenElements.h>
+
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkPolyData.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkMath.h>
+#include <vtkPolyDataAlgorithm.h>
+#include <vtkInformation.h>
+#include <vtkInformationVector.h>
+#include <vtkObjectFactory.h>
+
+#include <vector>
+#include <math.h>
+
+// Downstream filter of the point list: a shallow copy of its input
+class vtkPassPolyData : public vtkPolyDataAlgorithm
+{
+public:
+   static vtkPassPolyData *New();
+   vtkTypeMacro(vtkPassPolyData,vtkPolyDataAlgorithm);
+
+protected:
+   virtual int RequestData( vtkInformation*, vtkInformationVector** inputVector,
+                            vtkInformationVector* outputVector )
+   {
+      vtkPolyData* input = vtkPolyData::GetData( inputVector[0] );
+      vtkPolyData* output = vtkPolyData::GetData( outputVector );
+      output->ShallowCopy( input );
+      return( 1 );
+   }
+};
+
+vtkStandardNewMacro(vtkPassPolyData);
+
+int main( int argc, char* argv[] )
+{
+   const int n = 3000;
+   std::vector<double> buffer( 18 * n );
+   double *tensor[6], *values[3], *vectors[9];
+   for( int c = 0; c < 6; c++ )
+   {
+      tensor[c] = &buffer[c * n];
+   }
+   for( int e = 0; e < 3; e++ )
+   {
+      values[e] = &buffer[( 6 + e ) * n];
+   }
+   for( int c = 0; c < 9; c++ )
+   {
+      vectors[c] = &buffer[( 9 + c ) * n];
+   }
+
+   // Random tensors, then tensors with two or three equal eigen values
+   vtkMath::RandomSeed( 1 );
+   for( int i = 0; i < n; i++ )
+   {
+      for( int c = 0; c < 6; c++ )
+      {
+         tensor[c][i] = vtkMath::Random( -1, 1 );
+      }
+      if( i >= n / 3 )
+      {
+         double u[3] = { tensor[0][i], tensor[1][i], tensor[2][i] };
+         double d = i < 2 * n / 3 ? 2 * tensor[3][i] : 0;
+         tensor[0][i] = d + u[0] * u[0];
+         tensor[1][i] = u[0] * u[1];
+         tensor[2][i] = u[0] * u[2];
+         tensor[3][i] = d + u[1] * u[1];
+         tensor[4][i] = u[1] * u[2];
+         tensor[5][i] = d + u[2] * u[2];
+      }
+   }
+   tensor[0][0] = tensor[1][0] = tensor[2][0] = tensor[3][0] = tensor[4][0] = tensor[5][0] = 0;
+
+   vtkImageEigenElements::ComputeEigenElements( n, tensor, values, vectors );
+
+   // Tensor component of each matrix element
+   const int component[3][3] = { { 0, 1, 2 }, { 1, 3, 4 }, { 2, 4, 5 } };
+   double a[3][3], v[3][3], w[3];
+   double *A[3] = { a[0], a[1], a[2] };
+   double *V[3] = { v[0], v[1], v[2] };
+   for( int i = 0; i < n; i++ )
+   {
+      for( int r = 0; r < 3; r++ )
+      {
+         for( int c = 0; c < 3; c++ )
+         {
+            a[r][c] = tensor[component[r][c]][i];
+         }
+      }
+      vtkMath::Jacobi( A, w, V );
+
+      for( int e = 0; e < 3; e++ )
+      {
+         if( fabs( values[e][i] - w[e] ) > 1e-9 )
+         {
+            std::cerr << "Eigen value " << e << " of tensor " << i << " differs from Jacobi: " 
+                      << values[e][i] << " instead of " << w[e] << std::endl;
+            return( 1 );
+         }
+
+         // Eigen vector: A v = w v, and unit
+         double residual = 0, norm = 0;
+         for( int r = 0; r < 3; r++ )
+         {
+            double x = -values[e][i] * vectors[3*e+r][i];
+            for( int c = 0; c < 3; c++ )
+            {
+               x += tensor[component[r][c]][i] * vectors[3*e+c][i];
+            }
+            residual += x * x;
+            norm += vectors[3*e+r][i] * vectors[3*e+r][i];
+         }
+         if( sqrt( residual ) > 1e-9 || fabs( norm - 1 ) > 1e-9 )
+         {
+            std::cerr << "Eigen vector " << e << " of tensor " << i << " is wrong" << std::endl;
+            return( 1 );
+         }
+      }
+   }
+
+   // Each thread writes its own piece of the output arrays
+   vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New( );
+   image->SetExtent( 0, 30, 0, 20, 0, 10 );
+   image->AllocateScalars( VTK_DOUBLE, 6 );
+   vtkDataArray* scalars = image->GetPointData( )->GetScalars( );
+   for( vtkIdType i = 0; i < scalars->GetNumberOfTuples( ); i++ )
+   {
+      for( int c = 0; c < 6; c++ )
+      {
+         scalars->SetComponent( i, c, vtkMath::Random( -1, 1 ) );
+      }
+   }
+
+   vtkSmartPointer<vtkImageEigenElements> single = vtkSmartPointer<vtkImageEigenElements>::New( );
+   single->SetInputData( image );
+   single->MapInputComponentsToTensor( 0, 1, 2, 3, 4, 5 );
+   single->SetNumberOfThreads( 1 );
+   single->Update( );
+
+   vtkSmartPointer<vtkImageEigenElements> threaded = vtkSmartPointer<vtkImageEigenElements>::New( );
+   threaded->SetInputData( image );
+   threaded->MapInputComponentsToTensor( 0, 1, 2, 3, 4, 5 );
+   threaded->SetNumberOfThreads( 4 );
+   threaded->Update( );
+
+   vtkPointData* reference = single->GetOutput( )->GetPointData( );
+   vtkPointData* output = threaded->GetOutput( )->GetPointData( );
+   if( output->GetNumberOfArrays( ) != 6 )
+   {
+      std::cerr << "Unexpected number of output arrays: " << output->GetNumberOfArrays( ) << std::endl;
+      return( 1 );
+   }
+   for( int a = 0; a < reference->GetNumberOfArrays( ); a++ )
+   {
+      vtkDataArray* refArray = reference->GetArray( a );
+      vtkDataArray* array = output->GetArray( refArray->GetName( ) );
+      for( vtkIdType i = 0; i < refArray->GetNumberOfTuples( ); i++ )
+      {
+         for( int c = 0; c < refArray->GetNumberOfComponents( ); c++ )
+         {
+            if( refArray->GetComponent( i, c ) != array->GetComponent( i, c ) )
+            {
+               std::cerr << refArray->GetName( ) << " differs between 1 and 4 threads at point "
+                         << i << std::endl;
+               return( 1 );
+            }
+         }
+      }
+   }
+
+   // Eigen values only, as float
+   vtkSmartPointer<vtkImageEigenElements> valuesOnly = vtkSmartPointer<vtkImageEigenElements>::New( );
+   valuesOnly->SetInputData( image );
+   valuesOnly->MapInputComponentsToTensor( 0, 1, 2, 3, 4, 5 );
+   valuesOnly->ComputeMaxEigenVectorOff( );
+   valuesOnly->ComputeMedEigenVectorOff( );
+   valuesOnly->ComputeMinEigenVectorOff( );
+   valuesOnly->SetOutputScalarTypeToFloat( );
+   valuesOnly->Update( );
+
+   output = valuesOnly->GetOutput( )->GetPointData( );
+   if( output->GetNumberOfArrays( ) != 3 || output->GetScalars( ) != output->GetArray( "MaxEigenValue" )
+       || output->GetScalars( )->GetDataType( ) != VTK_FLOAT )
+   {
+      std::cerr << "Unexpected eigen value arrays" << std::endl;
+      return( 1 );
+   }
+   for( int a = 0; a < output->GetNumberOfArrays( ); a++ )
+   {
+      vtkDataArray* array = output->GetArray( a );
+      vtkDataArray* refArray = reference->GetArray( array->GetName( ) );
+      for( vtkIdType i = 0; i < refArray->GetNumberOfTuples( ); i++ )
+      {
+         if( fabs( refArray->GetComponent( i, 0 ) - array->GetComponent( i, 0 ) ) > 1e-6 )
+         {
+            std::cerr << array->GetName( ) << " differs from the double output at point "
+                      << i << std::endl;
+            return( 1 );
+         }
+      }
+   }
+
+   // Measures only
+   vtkSmartPointer<vtkImageEigenElements> measures = vtkSmartPointer<vtkImageEigenElements>::New( );
+   measures->SetInputData( image );
+   measures->MapInputComponentsToTensor( 0, 1, 2, 3, 4, 5 );
+   measures->ComputeMaxEigenVectorOff( );
+   measures->ComputeMaxEigenValueOff( );
+   measures->ComputeMedEigenVectorOff( );
+   measures->ComputeMedEigenValueOff( );
+   measures->ComputeMinEigenVectorOff( );
+   measures->ComputeMinEigenValueOff( );
+   measures->ComputeFractionalAnisotropyOn( );
+   measures->ComputeLinearityOn( );
+   measures->ComputePlanarityOn( );
+   measures->Update( );
+
+   output = measures->GetOutput( )->GetPointData( );
+   if( output->GetNumberOfArrays( ) != 3 || output->GetScalars( ) != output->GetArray( "FractionalAnisotropy" ) )
+   {
+      std::cerr << "Unexpected measure arrays" << std::endl;
+      return( 1 );
+   }
+   vtkDataArray* maxValues = reference->GetArray( "MaxEigenValue" );
+   vtkDataArray* medValues = reference->GetArray( "MedEigenValue" );
+   vtkDataArray* minValues = reference->GetArray( "MinEigenValue" );
+   for( vtkIdType i = 0; i < maxValues->GetNumberOfTuples( ); i++ )
+   {
+      double l1 = maxValues->GetComponent( i, 0 );
+      double l2 = medValues->GetComponent( i, 0 );
+      double l3 = minValues->GetComponent( i, 0 );
+      double mean = ( l1 + l2 + l3 ) / 3;
+      double fa = sqrt( 1.5 * ( ( l1 - mean ) * ( l1 - mean ) + ( l2 - mean ) * ( l2 - mean )
+                                + ( l3 - mean ) * ( l3 - mean ) ) / ( l1 * l1 + l2 * l2 + l3 * l3 ) );
+      double linearity = l1 > 0 ? ( l1 - l2 ) / l1 : 0;
+      double planarity = l1 > 0 ? ( l2 - l3 ) / l1 : 0;
+      if( fabs( output->GetArray( "FractionalAnisotropy" )->GetComponent( i, 0 ) - fa ) > 1e-9
+          || fabs( output->GetArray( "Linearity" )->GetComponent( i, 0 ) - linearity ) > 1e-9
+          || fabs( output->GetArray( "Planarity" )->GetComponent( i, 0 ) - planarity ) > 1e-9 )
+      {
+         std::cerr << "Measures differ from the eigen values at point " << i << std::endl;
+         return( 1 );
+      }
+   }
+
+   // Vesselness of hand-built tensors, whose eigen values sorted by magnitude
+   // are known: a bright tube, a dark tube, eigen values of mixed signs, a
+   // blob, a zero tensor and a rotated bright tube
+   const int numTubes = 6;
+   const double tubeTensors[numTubes][6] = { { -0.05, 0, 0, -2, 0, -2.5 },
+                                             { 0.05, 0, 0, 2, 0, 2.5 },
+                                             { 0.05, 0, 0, -2, 0, 1.5 },
+                                             { -1, 0, 0, -1.2, 0, -1.5 },
+                                             { 0, 0, 0, 0, 0, 0 },
+                                             { -1, -1, 0, -1, 0, -2 } };
+   const double tubeValues[numTubes][3] = { { -0.05, -2, -2.5 },
+                                            { 0.05, 2, 2.5 },
+                                            { 0.05, 1.5, -2 },
+                                            { -1, -1.2, -1.5 },
+                                            { 0, 0, 0 },
+                                            { 0, -2, -2 } };
+   vtkSmartPointer<vtkImageData> tubes = vtkSmartPointer<vtkImageData>::New( );
+   tubes->SetExtent( 0, numTubes - 1, 0, 0, 0, 0 );
+   tubes->AllocateScalars( VTK_DOUBLE, 6 );
+   for( int t = 0; t < numTubes; t++ )
+   {
+      for( int c = 0; c < 6; c++ )
+      {
+         tubes->GetPointData( )->GetScalars( )->SetComponent( t, c, tubeTensors[t][c] );
+      }
+   }
+
+   vtkSmartPointer<vtkImageEigenElements> vesselness = vtkSmartPointer<vtkImageEigenElements>::New( );
+   vesselness->SetInputData( tubes );
+   vesselness->MapInputComponentsToTensor( 0, 1, 2, 3, 4, 5 );
+   vesselness->ComputeVesselnessOn( );
+
+   // Bright and dark vessels, without and with the structure norm factor
+   const int bright[4] = { 1, 0, 1, 0 };
+   const double alpha[4] = { 0.5, 0.5, 0.3, 0.5 };
+   const double beta[4] = { 0.5, 0.5, 0.8, 0.5 };
+   const double C[4] = { 0, 0, 0, 1.5 };
+   for( int run = 0; run < 4; run++ )
+   {
+      vesselness->SetBrightVessels( bright[run] );
+      vesselness->SetVesselnessAlpha( alpha[run] );
+      vesselness->SetVesselnessBeta( beta[run] );
+      vesselness->SetVesselnessC( C[run] );
+      vesselness->Update( );
+      vtkDataArray* measure = vesselness->GetOutput( )->GetPointData( )->GetArray( "Vesselness" );
+      for( int t = 0; t < numTubes; t++ )
+      {
+         // Frangi: 0 unless a2 and a3 have the sign of a vessel (negative
+         // for bright ones)
+         const double *a = tubeValues[t];
+         double expected = 0;
+         if( bright[run] ? ( a[1] < 0 && a[2] < 0 ) : ( a[1] > 0 && a[2] > 0 ) )
+         {
+            double ra = fabs( a[1] ) / fabs( a[2] );
+            double rb = fabs( a[0] ) / sqrt( fabs( a[1] * a[2] ) );
+            double s = sqrt( a[0] * a[0] + a[1] * a[1] + a[2] * a[2] );
+            expected = ( 1 - exp( -ra * ra / ( 2 * alpha[run] * alpha[run] ) ) ) 
+                       * exp( -rb * rb / ( 2 * beta[run] * beta[run] ) );
+            if( C[run] > 0 )
+            {
+               expected *= 1 - exp( -s * s / ( 2 * C[run] * C[run] ) );
+            }
+         }
+         if( !measure || fabs( measure->GetComponent( t, 0 ) - expected ) > 1e-9 )
+         {
+            std::cerr << "Vesselness of tensor " << t << " is " 
+                      << ( measure ? measure->GetComponent( t, 0 ) : 0 ) << " instead of "
+                      << expected << " (run " << run << ")" << std::endl;
+            return( 1 );
+         }
+      }
+   }
+
+   // The tubes are detected as such, and only for their own contrast
+   vesselness->SetVesselnessAlpha( 0.5 );
+   vesselness->SetVesselnessBeta( 0.5 );
+   vesselness->SetVesselnessC( 0 );
+   vesselness->BrightVesselsOn( );
+   vesselness->Update( );
+   vtkDataArray* measure = vesselness->GetOutput( )->GetPointData( )->GetArray( "Vesselness" );
+   if( measure->GetComponent( 0, 0 ) < 0.5 || measure->GetComponent( 5, 0 ) < 0.5
+       || measure->GetComponent( 1, 0 ) != 0 || measure->GetComponent( 2, 0 ) != 0 
+       || measure->GetComponent( 4, 0 ) != 0 
+       || measure->GetComponent( 3, 0 ) >= measure->GetComponent( 0, 0 ) )
+   {
+      std::cerr << "Bright vessels are not detected" << std::endl;
+      return( 1 );
+   }
+   vesselness->BrightVesselsOff( );
+   vesselness->Update( );
+   measure = vesselness->GetOutput( )->GetPointData( )->GetArray( "Vesselness" );
+   if( measure->GetComponent( 1, 0 ) < 0.5 || measure->GetComponent( 0, 0 ) != 0 
+       || measure->GetComponent( 2, 0 ) != 0 || measure->GetComponent( 5, 0 ) != 0 )
+   {
+      std::cerr << "Dark vessels are not detected" << std::endl;
+      return( 1 );
+   }
+
+   // Mask in the last component, mostly in the first slices
+   vtkSmartPointer<vtkImageData> maskedImage = vtkSmartPointer<vtkImageData>::New( );
+   maskedImage->SetExtent( 0, 30, 0, 20, 0, 10 );
+   maskedImage->SetOrigin( 1, 2, 3 );
+   maskedImage->SetSpacing( 0.5, 2, 1.5 );
+   maskedImage->AllocateScalars( VTK_DOUBLE, 7 );
+   vtkDataArray* maskedScalars = maskedImage->GetPointData( )->GetScalars( );
+   vtkIdType numActive = 0;
+   for( vtkIdType i = 0; i < maskedScalars->GetNumberOfTuples( ); i++ )
+   {
+      for( int c = 0; c < 6; c++ )
+      {
+         maskedScalars->SetComponent( i, c, scalars->GetComponent( i, c ) );
+      }
+      double mask = i % 7 == 0 || ( i < 3 * 31 * 21 && i % 3 == 0 ) ? 1 + i % 2 : 0;
+      maskedScalars->SetComponent( i, 6, mask );
+      numActive += mask != 0;
+   }
+
+   vtkSmartPointer<vtkImageEigenElements> masked = vtkSmartPointer<vtkImageEigenElements>::New( );
+   masked->SetInputData( maskedImage );
+   masked->MapInputComponentsToTensor( 0, 1, 2, 3, 4, 5 );
+   masked->UseMaskOn( );
+   masked->SetInMask( 6 );
+   masked->SetNumberOfThreads( 4 );
+   masked->Update( );
+
+   output = masked->GetOutput( )->GetPointData( );
+   for( int a = 0; a < reference->GetNumberOfArrays( ); a++ )
+   {
+      vtkDataArray* refArray = reference->GetArray( a );
+      vtkDataArray* array = output->GetArray( refArray->GetName( ) );
+      for( vtkIdType i = 0; i < refArray->GetNumberOfTuples( ); i++ )
+      {
+         double mask = maskedScalars->GetComponent( i, 6 );
+         for( int c = 0; c < refArray->GetNumberOfComponents( ); c++ )
+         {
+            if( fabs( refArray->GetComponent( i, c ) * mask - array->GetComponent( i, c ) ) > 1e-12 )
+            {
+               std::cerr << refArray->GetName( ) << " is not masked at point " << i << std::endl;
+               return( 1 );
+            }
+         }
+      }
+   }
+
+   // Point list of the active voxels
+   masked->CompactOutputOn( );
+   masked->Update( );
+
+   vtkPolyData* points = masked->GetPointListOutput( );
+   output = points->GetPointData( );
+   vtkDataArray* voxelIndex = output->GetArray( "VoxelIndex" );
+   if( points->GetNumberOfPoints( ) != numActive || points->GetNumberOfVerts( ) != numActive
+       || !voxelIndex || masked->GetOutput( )->GetPointData( )->GetNumberOfArrays( ) != 0 )
+   {
+      std::cerr << "Unexpected point list: " << points->GetNumberOfPoints( ) << " points instead of "
+                << numActive << std::endl;
+      return( 1 );
+   }
+   vtkIdType id = 0;
+   for( int k = 0; k <= 10; k++ )
+   {
+      for( int j = 0; j <= 20; j++ )
+      {
+         for( int i = 0; i <= 30; i++ )
+         {
+            int ijk[3] = { i, j, k };
+            vtkIdType voxel = maskedImage->ComputePointId( ijk );
+            double mask = maskedScalars->GetComponent( voxel, 6 );
+            if( mask == 0 )
+            {
+               continue;
+            }
+            double *point = points->GetPoint( id );
+            if( voxelIndex->GetComponent( id, 0 ) != i || voxelIndex->GetComponent( id, 1 ) != j
+                || voxelIndex->GetComponent( id, 2 ) != k || fabs( point[0] - ( 1 + 0.5 * i ) ) > 1e-5
+                || fabs( point[1] - ( 2 + 2 * j ) ) > 1e-5 || fabs( point[2] - ( 3 + 1.5 * k ) ) > 1e-5 )
+            {
+               std::cerr << "Point " << id << " is not at voxel " << i << " " << j << " " << k << std::endl;
+               return( 1 );
+            }
+            for( int a = 0; a < reference->GetNumberOfArrays( ); a++ )
+            {
+               vtkDataArray* refArray = reference->GetArray( a );
+               vtkDataArray* array = output->GetArray( refArray->GetName( ) );
+               for( int c = 0; c < refArray->GetNumberOfComponents( ); c++ )
+               {
+                  if( fabs( refArray->GetComponent( voxel, c ) * mask - array->GetComponent( id, c ) ) > 1e-12 )
+                  {
+                     std::cerr << refArray->GetName( ) << " differs at point " << id << std::endl;
+                     return( 1 );
+                  }
+               }
+            }
+            id++;
+         }
+      }
+   }
+
+   // Point list pulled by a downstream filter, the image output not updated
+   vtkSmartPointer<vtkImageEigenElements> listOnly = vtkSmartPointer<vtkImageEigenElements>::New( );
+   listOnly->SetInputData( maskedImage );
+   listOnly->MapInputComponentsToTensor( 0, 1, 2, 3, 4, 5 );
+   listOnly->UseMaskOn( );
+   listOnly->SetInMask( 6 );
+   listOnly->CompactOutputOn( );
+   vtkSmartPointer<vtkPassPolyData> downstream = vtkSmartPointer<vtkPassPolyData>::New( );
+   downstream->SetInputConnection( listOnly->GetOutputPort( 1 ) );
+   downstream->Update( );
+
+   vtkPolyData* pulled = downstream->GetOutput( );
+   if( pulled->GetNumberOfPoints( ) != numActive )
+   {
+      std::cerr << "Point list pulled from port 1: " << pulled->GetNumberOfPoints( ) 
+                << " points instead of " << numActive << std::endl;
+      return( 1 );
+   }
+   for( vtkIdType p = 0; p < numActive; p++ )
+   {
+      double *point = pulled->GetPoint( p ), *expected = points->GetPoint( p );
+      if( point[0] != expected[0] || point[1] != expected[1] || point[2] != expected[2] )
+      {
+         std::cerr << "Point " << p << " pulled from port 1 differs" << std::endl;
+         return( 1 );
+      }
+   }
+
+   return( 0 );
+}
@@ -0,0 +1,408 @@
+// Copyright (c) 2010, Jérôme Velut
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER ``AS IS'' AND ANY EXPRESS 
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN 
+// NO EVENT SHALL THE COPYRIGHT OWNER BE LIABLE FOR ANY DIRECT, INDIRECT, 
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+// EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// Compares vtkImageLocalConvolution with the convolution computed voxel by
+// voxel, on sites inside and outside the image, with 1 thread in the order
+// of the sites and 4 threads in the Z-order of their voxels. The spacing is
+// a power of two, so that its reciprocal gives the same voxels. Normalized
+// intensities are also checked on an image of shorts.
+// The linear mode is compared with the kernel applied to the interpolated
+// image, on sites of the sub-voxel lattice, before and after a change of the
+// kernel.
+
+#include <vtkImageLocalConvolution.h>
+
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkPolyData.h>
+#include <vtkPoints.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkMath.h>
+
+#include <vector>
+#include <math.h>
+
+// Convolution of image at the voxel nearest to point, or 0 if the kernel
+// window is not inside the image
+static void Convolve( vtkImageData* image, vtkImageData* kernel, double point[3],
+                      int normalized, double* result )
+{
+   int ext[6], size[3], ijk[3];
+   double origin[3], spacing[3];
+   image->GetExtent( ext );
+   image->GetOrigin( origin );
+   image->GetSpacing( spacing );
+   kernel->GetDimensions( size );
+   int numComps = kernel->GetNumberOfScalarComponents( );
+   bool inside = true;
+   for( int axis = 0; axis < 3; axis++ )
+   {
+      ijk[axis] = static_cast<int>( floor( ( point[axis] - origin[axis] ) / spacing[axis] + 0.5 ) );
+      inside = inside && ijk[axis] > ext[2*axis] + size[axis] / 2
+                      && ijk[axis] < ext[2*axis+1] - size[axis] / 2;
+   }
+   double min = 0, max = 1;
+   if( inside && normalized )
+   {
+      min = max = image->GetScalarComponentAsDouble( ijk[0] - size[0] / 2, ijk[1] - size[1] / 2,
+                                                     ijk[2] - size[2] / 2, 0 );
+      for( int k = 0; k < size[2]; k++ )
+         for( int j = 0; j < size[1]; j++ )
+            for( int i = 0; i < size[0]; i++ )
+            {
+               double value = image->GetScalarComponentAsDouble( ijk[0] + i - size[0] / 2,
+                                                                 ijk[1] + j - size[1] / 2,
+                                                                 ijk[2] + k - size[2] / 2, 0 );
+               min = value < min ? value : min;
+               max = value > max ? value : max;
+            }
+      if( min == max )
+      {
+         min = 0;
+         max = 1;
+      }
+   }
+   for( int c = 0; c < numComps; c++ )
+   {
+      result[c] = 0;
+      for( int k = 0; inside && k < size[2]; k++ )
+         for( int j = 0; j < size[1]; j++ )
+            for( int i = 0; i < size[0]; i++ )
+            {
+               double value = image->GetScalarComponentAsDouble( ijk[0] + i - size[0] / 2,
+                                                                 ijk[1] + j - size[1] / 2,
+                                                                 ijk[2] + k - size[2] / 2, 0 );
+               result[c] += ( value - min ) / ( max - min )
+                            * kernel->GetScalarComponentAsDouble( i, j, k, c );
+            }
+   }
+}
+
+// Convolution of image interpolated trilinearly at point, with the sub-voxel
+// offset rounded to 1/divisions of a voxel, or 0 if the window is not inside
+// the image
+static void ConvolveLinear( vtkImageData* image, vtkImageData* kernel, double point[3],
+                            int divisions, int normalized, double* result )
+{
+   int ext[6], size[3], first[3];
+   double origin[3], spacing[3], f[3];
+   image->GetExtent( ext );
+   image->GetOrigin( origin );
+   image->GetSpacing( spacing );
+   kernel->GetDimensions( size );
+   int numComps = kernel->GetNumberOfScalarComponents( );
+   bool inside = true;
+   for( int axis = 0; axis < 3; axis++ )
+   {
+      double t = ( point[axis] - origin[axis] ) / spacing[axis];
+      int v = static_cast<int>( floor( t ) );
+      int q = static_cast<int>( floor( ( t - v ) * divisions + 0.5 ) );
+      if( q == divisions )
+      {
+         v++;
+         q = 0;
+      }
+      f[axis] = static_cast<double>( q ) / divisions;
+      first[axis] = v - size[axis] / 2;
+      inside = inside && first[axis] >= ext[2*axis] && first[axis] + size[axis] <= ext[2*axis+1];
+   }
+   double min = 0, max = 1;
+   if( inside && normalized )
+   {
+      min = max = image->GetScalarComponentAsDouble( first[0], first[1], first[2], 0 );
+      for( int k = 0; k <= size[2]; k++ )
+         for( int j = 0; j <= size[1]; j++ )
+            for( int i = 0; i <= size[0]; i++ )
+            {
+               double value = image->GetScalarComponentAsDouble( first[0] + i, first[1] + j,
+                                                                 first[2] + k, 0 );
+               min = value < min ? value : min;
+               max = value > max ? value : max;
+            }
+      if( min == max )
+      {
+         min = 0;
+         max = 1;
+      }
+   }
+   for( int c = 0; c < numComps; c++ )
+   {
+      result[c] = 0;
+      for( int k = 0; inside && k < size[2]; k++ )
+         for( int j = 0; j < size[1]; j++ )
+            for( int i = 0; i < size[0]; i++ )
+            {
+               double value = 0;
+               for( int corner = 0; corner < 8; corner++ )
+               {
+                  int cx = corner & 1, cy = ( corner >> 1 ) & 1, cz = corner >> 2;
+                  double weight = ( cx ? f[0] : 1 - f[0] ) * ( cy ? f[1] : 1 - f[1] )
+                                  * ( cz ? f[2] : 1 - f[2] );
+                  if( weight != 0 )
+                  {
+                     value += weight * image->GetScalarComponentAsDouble( first[0] + i + cx,
+                                                                          first[1] + j + cy,
+                                                                          first[2] + k + cz, 0 );
+                  }
+               }
+               result[c] += ( value - min ) / ( max - min )
+                            * kernel->GetScalarComponentAsDouble( i, j, k, c );
+            }
+   }
+}
+
+int main( int argc, char* argv[] )
+{
+   vtkMath::RandomSeed( 1 );
+
+   vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New( );
+   image->SetExtent( 2, 41, -5, 24, 0, 19 );
+   image->SetOrigin( 1, 2, 3 );
+   image->SetSpacing( 0.5, 1, 2 );
+   image->AllocateScalars( VTK_DOUBLE, 1 );
+   vtkDataArray* scalars = image->GetPointData( )->GetScalars( );
+   for( vtkIdType i = 0; i < scalars->GetNumberOfTuples( ); i++ )
+   {
+      scalars->SetComponent( i, 0, vtkMath::Random( -100, 100 ) );
+   }
+
+   vtkSmartPointer<vtkImageData> kernel = vtkSmartPointer<vtkImageData>::New( );
+   kernel->SetExtent( 0, 4, 0, 2, 0, 2 );
+   kernel->AllocateScalars( VTK_DOUBLE, 2 );
+   vtkDataArray* weights = kernel->GetPointData( )->GetScalars( );
+   for( vtkIdType i = 0; i < weights->GetNumberOfTuples( ); i++ )
+   {
+      weights->SetComponent( i, 0, vtkMath::Random( -1, 1 ) );
+      weights->SetComponent( i, 1, vtkMath::Random( -1, 1 ) );
+   }
+
+   // Sites in the bounds of the image, some of them too close to the border
+   const int numSites = 2000;
+   vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New( );
+   vtkSmartPointer<vtkDoubleArray> siteIds = vtkSmartPointer<vtkDoubleArray>::New( );
+   siteIds->SetName( "SiteId" );
+   for( int i = 0; i < numSites; i++ )
+   {
+      double point[3] = { vtkMath::Random( 2, 21.5 ), vtkMath::Random( -3, 26 ),
+                          vtkMath::Random( 3, 41 ) };
+      points->InsertNextPoint( point );
+      siteIds->InsertNextTuple( point );
+   }
+   vtkSmartPointer<vtkPolyData> sites = vtkSmartPointer<vtkPolyData>::New( );
+   sites->SetPoints( points );
+   sites->GetPointData( )->AddArray( siteIds );
+
+   for( int normalized = 0; normalized < 2; normalized++ )
+   {
+      vtkSmartPointer<vtkImageLocalConvolution> single = vtkSmartPointer<vtkImageLocalConvolution>::New( );
+      single->SetInputData( 0, sites );
+      single->SetInputData( 1, image );
+      single->SetInputData( 2, kernel );
+      single->SetOutputDataName( "Convolution" );
+      single->SetNormalizedIntensities( normalized );
+      single->SetNumberOfThreads( 1 );
+      single->SortSitesOff( );
+      single->Update( );
+
+      vtkSmartPointer<vtkImageLocalConvolution> threaded = vtkSmartPointer<vtkImageLocalConvolution>::New( );
+      threaded->SetInputData( 0, sites );
+      threaded->SetInputData( 1, image );
+      threaded->SetInputData( 2, kernel );
+      threaded->SetOutputDataName( "Convolution" );
+      threaded->SetNormalizedIntensities( normalized );
+      threaded->SetNumberOfThreads( 4 );
+      threaded->Update( );
+
+      vtkSmartPointer<vtkImageLocalConvolution> reciprocal = vtkSmartPointer<vtkImageLocalConvolution>::New( );
+      reciprocal->SetInputData( 0, sites );
+      reciprocal->SetInputData( 1, image );
+      reciprocal->SetInputData( 2, kernel );
+      reciprocal->SetOutputDataName( "Convolution" );
+      reciprocal->SetNormalizedIntensities( normalized );
+      reciprocal->UseReciprocalSpacingOn( );
+      reciprocal->Update( );
+
+      vtkPointData* output = threaded->GetOutput( )->GetPointData( );
+      vtkDataArray* reference = single->GetOutput( )->GetPointData( )->GetArray( "Convolution" );
+      vtkDataArray* convolution = output->GetArray( "Convolution" );
+      vtkDataArray* fast = reciprocal->GetOutput( )->GetPointData( )->GetArray( "Convolution" );
+      if( !convolution || !output->GetArray( "SiteId" )
+          || threaded->GetOutput( )->GetNumberOfPoints( ) != numSites
+          || convolution->GetNumberOfTuples( ) != numSites )
+      {
+         std::cerr << "Unexpected output arrays" << std::endl;
+         return( 1 );
+      }
+      int numInside = 0;
+      for( int i = 0; i < numSites; i++ )
+      {
+         double result[2];
+         Convolve( image, kernel, points->GetPoint( i ), normalized, result );
+         numInside += result[0] != 0;
+         for( int c = 0; c < 2; c++ )
+         {
+            if( convolution->GetComponent( i, c ) != reference->GetComponent( i, c ) )
+            {
+               std::cerr << "Site " << i << " differs between 1 and 4 threads, sorted" << std::endl;
+               return( 1 );
+            }
+            if( fast->GetComponent( i, c ) != reference->GetComponent( i, c ) )
+            {
+               std::cerr << "Site " << i << " differs with the reciprocal spacing" << std::endl;
+               return( 1 );
+            }
+            if( fabs( convolution->GetComponent( i, c ) - result[c] ) > 1e-9 * ( 1 + fabs( result[c] ) ) )
+            {
+               std::cerr << "Site " << i << ": " << convolution->GetComponent( i, c )
+                         << " instead of " << result[c] << std::endl;
+               return( 1 );
+            }
+         }
+      }
+      if( numInside < numSites / 4 || numInside == numSites )
+      {
+         std::cerr << "Unexpected number of sites inside the image: " << numInside << std::endl;
+         return( 1 );
+      }
+   }
+
+   // Normalized intensities of an integer image are not truncated
+   vtkSmartPointer<vtkImageData> shortImage = vtkSmartPointer<vtkImageData>::New( );
+   shortImage->SetExtent( image->GetExtent( ) );
+   shortImage->SetOrigin( image->GetOrigin( ) );
+   shortImage->SetSpacing( image->GetSpacing( ) );
+   shortImage->AllocateScalars( VTK_SHORT, 1 );
+   vtkDataArray* shortScalars = shortImage->GetPointData( )->GetScalars( );
+   for( vtkIdType i = 0; i < shortScalars->GetNumberOfTuples( ); i++ )
+   {
+      shortScalars->SetComponent( i, 0, floor( scalars->GetComponent( i, 0 ) ) );
+   }
+   vtkSmartPointer<vtkImageLocalConvolution> shortConvolution = vtkSmartPointer<vtkImageLocalConvolution>::New( );
+   shortConvolution->SetInputData( 0, sites );
+   shortConvolution->SetInputData( 1, shortImage );
+   shortConvolution->SetInputData( 2, kernel );
+   shortConvolution->SetOutputDataName( "Convolution" );
+   shortConvolution->NormalizedIntensitiesOn( );
+   shortConvolution->Update( );
+   vtkDataArray* shortResults = shortConvolution->GetOutput( )->GetPointData( )->GetArray( "Convolution" );
+   for( int i = 0; i < numSites; i++ )
+   {
+      double result[2];
+      Convolve( shortImage, kernel, points->GetPoint( i ), 1, result );
+      for( int c = 0; c < 2; c++ )
+      {
+         if( fabs( shortResults->GetComponent( i, c ) - result[c] ) > 1e-9 * ( 1 + fabs( result[c] ) ) )
+         {
+            std::cerr << "Short site " << i << ": " << shortResults->GetComponent( i, c )
+                      << " instead of " << result[c] << std::endl;
+            return( 1 );
+         }
+      }
+   }
+
+   // Sites of the sub-voxel lattice in linear mode
+   const int divisions = 4;
+   vtkSmartPointer<vtkPoints> latticePoints = vtkSmartPointer<vtkPoints>::New( );
+   for( int i = 0; i < numSites; i++ )
+   {
+      double point[3] = { vtkMath::Random( 2, 21.5 ), vtkMath::Random( -3, 26 ),
+                          vtkMath::Random( 3, 41 ) };
+      for( int axis = 0; axis < 3; axis++ )
+      {
+         double t = ( point[axis] - image->GetOrigin( )[axis] ) / image->GetSpacing( )[axis];
+         point[axis] = image->GetOrigin( )[axis]
+                       + image->GetSpacing( )[axis] * floor( t * divisions ) / divisions;
+      }
+      latticePoints->InsertNextPoint( point );
+   }
+   vtkSmartPointer<vtkPolyData> latticeSites = vtkSmartPointer<vtkPolyData>::New( );
+   latticeSites->SetPoints( latticePoints );
+
+   for( int normalized = 0; normalized < 2; normalized++ )
+   {
+      vtkSmartPointer<vtkImageLocalConvolution> linear = vtkSmartPointer<vtkImageLocalConvolution>::New( );
+      linear->SetInputData( 0, latticeSites );
+      linear->SetInputData( 1, image );
+      linear->SetInputData( 2, kernel );
+      linear->SetOutputDataName( "Convolution" );
+      linear->SetNormalizedIntensities( normalized );
+      linear->SetInterpolationModeToLinear( );
+      linear->SetSubVoxelDivisions( divisions );
+
+      // The second pass checks that the shifted kernels follow the kernel
+      for( int pass = 0; pass < 2; pass++ )
+      {
+         if( pass == 1 )
+         {
+            for( vtkIdType i = 0; i < weights->GetNumberOfTuples( ); i++ )
+            {
+               weights->SetComponent( i, 1, vtkMath::Random( -1, 1 ) );
+            }
+            kernel->Modified( );
+         }
+         linear->Update( );
+         vtkDataArray* convolution = linear->GetOutput( )->GetPointData( )->GetArray( "Convolution" );
+         int numInside = 0;
+         for( int i = 0; i < numSites; i++ )
+         {
+            double result[2];
+            ConvolveLinear( image, kernel, latticePoints->GetPoint( i ), divisions, normalized, result );
+            numInside += result[0] != 0;
+            for( int c = 0; c < 2; c++ )
+            {
+               if( fabs( convolution->GetComponent( i, c ) - result[c] ) > 1e-9 * ( 1 + fabs( result[c] ) ) )
+               {
+                  std::cerr << "Linear site " << i << ": " << convolution->GetComponent( i, c )
+                            << " instead of " << result[c] << std::endl;
+                  return( 1 );
+               }
+            }
+         }
+         if( numInside < numSites / 4 || numInside == numSites )
+         {
+            std::cerr << "Unexpected number of linear sites inside the image: " << numInside << std::endl;
+            return( 1 );
+         }
+      }
+   }
+
+   // Sites without points give an empty convolution array
+   vtkSmartPointer<vtkPolyData> noSites = vtkSmartPointer<vtkPolyData>::New( );
+   noSites->SetPoints( vtkSmartPointer<vtkPoints>::New( ) );
+   vtkSmartPointer<vtkImageLocalConvolution> empty = vtkSmartPointer<vtkImageLocalConvolution>::New( );
+   empty->SetInputData( 0, noSites );
+   empty->SetInputData( 1, image );
+   empty->SetInputData( 2, kernel );
+   empty->SetOutputDataName( "Convolution" );
+   empty->Update( );
+   vtkDataArray* emptyResults = empty->GetOutput( )->GetPointData( )->GetArray( "Convolution" );
+   if( !emptyResults || emptyResults->GetNumberOfTuples( ) != 0 )
+   {
+      std::cerr << "Unexpected output without sites" << std::endl;
+      return( 1 );
+   }
+
+   return( 0 );
+}
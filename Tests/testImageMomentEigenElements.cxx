@@ -0,0 +1,243 @@
+// Copyright (c) 2010, Jérôme Velut
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER ``AS IS'' AND ANY EXPRESS 
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN 
+// NO EVENT SHALL THE COPYRIGHT OWNER BE LIABLE FOR ANY DIRECT, INDIRECT, 
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+// EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Compares vtkImageMomentEigenElements with the pipeline
+// vtkImageMomentKernelSource -> vtkImageConvolution -> vtkImageEigenElements,
+// and its covariance tensor with the one of the convolved moments.
+
+#include <vtkImageMomentEigenElements.h>
+#include <vtkImageMomentKernelSource.h>
+#include <vtkImageConvolution.h>
+#include <vtkImageEigenElements.h>
+
+#include <vtkSmartPointer.h>
+#include <vtkImageNoiseSource.h>
+#include <vtkImageDataStreamer.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkMath.h>
+
+#include <math.h>
+
+int main( int argc, char* argv[] )
+{
+   int status = 0;
+
+   vtkSmartPointer<vtkImageNoiseSource> image = vtkSmartPointer<vtkImageNoiseSource>::New( );
+   image->SetWholeExtent( 0, 30, 0, 27, 0, 24 );
+   image->SetMinimum( 0 );
+   image->SetMaximum( 100 );
+   image->Update( );
+
+   vtkSmartPointer<vtkImageMomentKernelSource> kernel = vtkSmartPointer<vtkImageMomentKernelSource>::New( );
+   kernel->SetKernelSize( 7 );
+   kernel->SetSubSampling( 70 );
+
+   vtkSmartPointer<vtkImageConvolution> moments = vtkSmartPointer<vtkImageConvolution>::New( );
+   moments->SetInputData( image->GetOutput( ) );
+   moments->SetKernelConnection( kernel->GetOutputPort( ) );
+
+   // Raw second order moments: M200 M110 M101 M020 M011 M002
+   vtkSmartPointer<vtkImageEigenElements> eigen = vtkSmartPointer<vtkImageEigenElements>::New( );
+   eigen->SetInputConnection( moments->GetOutputPort( ) );
+   eigen->MapInputComponentsToTensor( 7, 4, 5, 8, 6, 9 );
+   eigen->Update( );
+
+   vtkSmartPointer<vtkImageMomentEigenElements> fused = vtkSmartPointer<vtkImageMomentEigenElements>::New( );
+   fused->SetInputData( image->GetOutput( ) );
+   fused->SetKernelSize( 7 );
+   fused->SetSubSampling( 70 );
+   fused->CentralMomentsOff( );
+   fused->ComputeMedEigenValueOn( );
+   fused->ComputeMinEigenValueOn( );
+   fused->SetNumberOfThreads( 3 );
+   fused->Update( );
+
+   vtkPointData* reference = eigen->GetOutput( )->GetPointData( );
+   vtkPointData* output = fused->GetOutput( )->GetPointData( );
+   if( output->GetNumberOfArrays( ) != 4 || output->GetArray( "MedEigenVector" ) 
+       || output->GetScalars( ) != output->GetArray( "MaxEigenVector" ) )
+   {
+      std::cerr << "Unexpected output arrays" << std::endl;
+      return( 1 );
+   }
+
+   const char* values[3] = { "MaxEigenValue", "MedEigenValue", "MinEigenValue" };
+   double maxDiff = 0, maxValue = 0;
+   for( int e = 0; e < 3; e++ )
+   {
+      vtkDataArray* refValues = reference->GetArray( values[e] );
+      vtkDataArray* outValues = output->GetArray( values[e] );
+      for( vtkIdType i = 0; i < refValues->GetNumberOfTuples( ); i++ )
+      {
+         double ref = refValues->GetComponent( i, 0 );
+         double diff = fabs( ref - outValues->GetComponent( i, 0 ) );
+         maxDiff = diff > maxDiff ? diff : maxDiff;
+         maxValue = fabs( ref ) > maxValue ? fabs( ref ) : maxValue;
+      }
+   }
+   if( maxDiff > 1e-5 * maxValue )
+   {
+      std::cerr << "Eigen values differ from the pipeline: " << maxDiff / maxValue << std::endl;
+      status = 1;
+   }
+
+   // The vectors are compared where the largest eigen value is well separated
+   vtkDataArray* refVectors = reference->GetArray( "MaxEigenVector" );
+   vtkDataArray* outVectors = output->GetArray( "MaxEigenVector" );
+   vtkDataArray* maxValues = reference->GetArray( "MaxEigenValue" );
+   vtkDataArray* medValues = reference->GetArray( "MedEigenValue" );
+   for( vtkIdType i = 0; i < refVectors->GetNumberOfTuples( ); i++ )
+   {
+      if( maxValues->GetComponent( i, 0 ) - medValues->GetComponent( i, 0 ) < 1e-3 * maxValue )
+      {
+         continue;
+      }
+      double dot = 0;
+      for( int c = 0; c < 3; c++ )
+      {
+         dot += refVectors->GetComponent( i, c ) * outVectors->GetComponent( i, c );
+      }
+      if( fabs( dot ) < 1 - 1e-3 )
+      {
+         std::cerr << "Eigen vectors differ from the pipeline at point " << i << std::endl;
+         status = 1;
+         break;
+      }
+   }
+
+   // Covariance tensor (CentralMoments, default) against the one built from
+   // the moments 0 to 9 of the convolution. The voxels x <= 12 are zero, so
+   // that M000 is zero for x <= 8 and the tensor is zero there.
+   vtkSmartPointer<vtkImageData> holed = vtkSmartPointer<vtkImageData>::New( );
+   holed->DeepCopy( image->GetOutput( ) );
+   int dims[3];
+   holed->GetDimensions( dims );
+   for( int z = 0; z < dims[2]; z++ )
+      for( int y = 0; y < dims[1]; y++ )
+         for( int x = 0; x <= 12; x++ )
+            holed->SetScalarComponentFromDouble( x, y, z, 0, 0.0 );
+
+   moments->SetInputData( holed );
+   moments->Update( );
+
+   vtkSmartPointer<vtkImageMomentEigenElements> central = vtkSmartPointer<vtkImageMomentEigenElements>::New( );
+   central->SetInputData( holed );
+   central->SetKernelSize( 7 );
+   central->SetSubSampling( 70 );
+   central->ComputeMedEigenValueOn( );
+   central->ComputeMinEigenValueOn( );
+   central->SetNumberOfThreads( 3 );
+   central->Update( );
+
+   vtkDataArray* m = moments->GetOutput( )->GetPointData( )->GetScalars( );
+   output = central->GetOutput( )->GetPointData( );
+   maxDiff = 0;
+   maxValue = 0;
+   for( vtkIdType i = 0; i < m->GetNumberOfTuples( ); i++ )
+   {
+      double c[10];
+      m->GetTuple( i, c );
+      double row0[3] = { 0, 0, 0 }, row1[3] = { 0, 0, 0 }, row2[3] = { 0, 0, 0 };
+      double *tensor[3] = { row0, row1, row2 };
+      if( c[0] != 0 )
+      {
+         double mean[3] = { c[1] / c[0], c[2] / c[0], c[3] / c[0] };
+         row0[0] = c[7] / c[0] - mean[0] * mean[0];
+         row0[1] = row1[0] = c[4] / c[0] - mean[0] * mean[1];
+         row0[2] = row2[0] = c[5] / c[0] - mean[0] * mean[2];
+         row1[1] = c[8] / c[0] - mean[1] * mean[1];
+         row1[2] = row2[1] = c[6] / c[0] - mean[1] * mean[2];
+         row2[2] = c[9] / c[0] - mean[2] * mean[2];
+      }
+      double eigenValues[3], v0[3], v1[3], v2[3];
+      double *eigenVectors[3] = { v0, v1, v2 };
+      vtkMath::Jacobi( tensor, eigenValues, eigenVectors );
+      for( int e = 0; e < 3; e++ )
+      {
+         double diff = fabs( eigenValues[e] - output->GetArray( values[e] )->GetComponent( i, 0 ) );
+         maxDiff = diff > maxDiff ? diff : maxDiff;
+         maxValue = fabs( eigenValues[e] ) > maxValue ? fabs( eigenValues[e] ) : maxValue;
+      }
+   }
+   if( maxDiff > 1e-5 * maxValue )
+   {
+      std::cerr << "Covariance eigen values differ from the moments: " << maxDiff / maxValue << std::endl;
+      status = 1;
+   }
+
+   for( int z = 0; z < dims[2]; z++ )
+      for( int y = 0; y < dims[1]; y++ )
+         for( int x = 0; x <= 8; x++ )
+         {
+            int ijk[3] = { x, y, z };
+            vtkIdType i = central->GetOutput( )->ComputePointId( ijk );
+            for( int e = 0; e < 3; e++ )
+            {
+               if( output->GetArray( values[e] )->GetComponent( i, 0 ) != 0 )
+               {
+                  std::cerr << "Nonzero covariance where M000 is zero, at point " << i << std::endl;
+                  status = 1;
+                  x = 9; y = dims[1]; z = dims[2];
+                  break;
+               }
+            }
+         }
+
+   // An even KernelSize (7 voxels kernel), streamed by pieces: each piece
+   // requests the halo of the odd kernel
+   vtkSmartPointer<vtkImageMomentEigenElements> even = vtkSmartPointer<vtkImageMomentEigenElements>::New( );
+   even->SetInputData( image->GetOutput( ) );
+   even->SetKernelSize( 6 );
+   even->SetSubSampling( 70 );
+   even->Update( );
+
+   vtkSmartPointer<vtkImageMomentEigenElements> evenPiece = vtkSmartPointer<vtkImageMomentEigenElements>::New( );
+   evenPiece->SetInputData( image->GetOutput( ) );
+   evenPiece->SetKernelSize( 6 );
+   evenPiece->SetSubSampling( 70 );
+   vtkSmartPointer<vtkImageDataStreamer> streamer = vtkSmartPointer<vtkImageDataStreamer>::New( );
+   streamer->SetInputConnection( evenPiece->GetOutputPort( ) );
+   streamer->SetNumberOfStreamDivisions( 4 );
+   streamer->Update( );
+
+   vtkDataArray* wholeValues = even->GetOutput( )->GetPointData( )->GetArray( "MaxEigenValue" );
+   vtkDataArray* pieceValues = streamer->GetOutput( )->GetPointData( )->GetArray( "MaxEigenValue" );
+   if( !pieceValues || pieceValues->GetNumberOfTuples( ) != wholeValues->GetNumberOfTuples( ) )
+   {
+      std::cerr << "Streamed execution with an even KernelSize has no eigen values" << std::endl;
+      return( 1 );
+   }
+   for( vtkIdType i = 0; i < wholeValues->GetNumberOfTuples( ); i++ )
+   {
+      if( pieceValues->GetComponent( i, 0 ) != wholeValues->GetComponent( i, 0 ) )
+      {
+         std::cerr << "Streamed execution with an even KernelSize differs at point " 
+                   << i << std::endl;
+         status = 1;
+         break;
+      }
+   }
+
+   return( status );
+}
@@ -0,0 +1,407 @@
+// Copyright (c) 2010, Jérôme Velut
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT OWNER ``AS IS'' AND ANY EXPRESS 
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN 
+// NO EVENT SHALL THE COPYRIGHT OWNER BE LIABLE FOR ANY DIRECT, INDIRECT, 
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+// EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Checks vtkImageMomentKernelSource against a brute-force sub-sampled kernel
+// and closed-form voxel integrals, checks the mirror symmetries of the
+// moments, the invariance to the number of threads, and the kernel cache.
+
+#include <vtkImageMomentKernelSource.h>
+
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkDirectory.h>
+
+#include <math.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Exponents of the monomial of the component m: the 10 components of order 2
+// or less, then the orders 3 and 4 in decreasing lexicographic order.
+void MomentExponents( int m, int e[3] )
+{
+   static const int low[10][3] = { {0,0,0}, {1,0,0}, {0,1,0}, {0,0,1}, 
+                                   {1,1,0}, {1,0,1}, {0,1,1}, 
+                                   {2,0,0}, {0,2,0}, {0,0,2} };
+   if( m < 10 )
+   {
+      e[0] = low[m][0]; e[1] = low[m][1]; e[2] = low[m][2];
+      return;
+   }
+   int rank = m - 10;
+   int order = 3;
+   if( rank >= 10 )
+   {
+      rank -= 10;
+      order = 4;
+   }
+   for( e[0] = order; e[0] >= 0; e[0]-- )
+   {
+      for( e[1] = order - e[0]; e[1] >= 0; e[1]-- )
+      {
+         if( rank-- == 0 )
+         {
+            e[2] = order - e[0] - e[1];
+            return;
+         }
+      }
+   }
+}
+
+// Kernel of size kernelSize whose voxels are split in subVoxels^3 sub-voxels,
+// each one counted if its center is in the sphere, in the layout of the
+// source output.
+void SampledKernel( int kernelSize, int subVoxels, int numMoments, 
+                    std::vector<double>& kernel )
+{
+   double offset = kernelSize / 2.0;
+   double step = 1.0 / subVoxels;
+   double dx = 1.0 / offset;
+   kernel.assign( kernelSize * kernelSize * kernelSize * numMoments, 0.0 );
+   for( int k = 0; k < kernelSize; k++ )
+      for( int j = 0; j < kernelSize; j++ )
+         for( int i = 0; i < kernelSize; i++ )
+         {
+            double *moments = &kernel[( ( k * kernelSize + j ) * kernelSize + i ) * numMoments];
+            for( int sx = 0; sx < subVoxels; sx++ )
+               for( int sy = 0; sy < subVoxels; sy++ )
+                  for( int sz = 0; sz < subVoxels; sz++ )
+                  {
+                     double p[3] = { i + step / 2.0 - offset + sx * step,
+                                     j + step / 2.0 - offset + sy * step,
+                                     k + step / 2.0 - offset + sz * step };
+                     if( p[0] * p[0] + p[1] * p[1] + p[2] * p[2] >= offset * offset )
+                        continue;
+                     for( int m = 0; m < numMoments; m++ )
+                     {
+                        int e[3];
+                        MomentExponents( m, e );
+                        moments[m] += pow( p[0], e[0] ) * pow( p[1], e[1] ) * pow( p[2], e[2] );
+                     }
+                  }
+            for( int m = 0; m < numMoments; m++ )
+            {
+               int e[3];
+               MomentExponents( m, e );
+               moments[m] *= pow( step * dx, 3 ) * pow( dx, e[0] + e[1] + e[2] );
+            }
+         }
+}
+
+// Largest difference on the component m between the kernels, relative to
+// the largest absolute value of this component in reference.
+double MaxComponentDifference( vtkDataArray* reference, vtkDataArray* kernel, int m )
+{
+   double maxDiff = 0, maxValue = 0;
+   for( vtkIdType i = 0; i < reference->GetNumberOfTuples( ); i++ )
+   {
+      double ref = reference->GetComponent( i, m );
+      double diff = fabs( ref - kernel->GetComponent( i, m ) );
+      maxDiff = diff > maxDiff ? diff : maxDiff;
+      maxValue = fabs( ref ) > maxValue ? fabs( ref ) : maxValue;
+   }
+   return( maxValue > 0 ? maxDiff / maxValue : maxDiff );
+}
+
+// 1 if both kernels have the same values, bit for bit
+int SameKernel( vtkDataArray* reference, vtkDataArray* kernel )
+{
+   if( reference->GetNumberOfTuples( ) != kernel->GetNumberOfTuples( ) 
+       || reference->GetNumberOfComponents( ) != kernel->GetNumberOfComponents( ) )
+      return( 0 );
+   for( vtkIdType i = 0; i < reference->GetNumberOfTuples( ); i++ )
+      for( int m = 0; m < reference->GetNumberOfComponents( ); m++ )
+         if( reference->GetComponent( i, m ) != kernel->GetComponent( i, m ) )
+            return( 0 );
+   return( 1 );
+}
+
+// Path of the only cache entry of directory, or an empty string
+std::string CacheEntry( const char* directory )
+{
+   std::string entry;
+   vtkSmartPointer<vtkDirectory> dir = vtkSmartPointer<vtkDirectory>::New( );
+   if( !dir->Open( directory ) )
+      return( entry );
+   int numEntries = 0;
+   for( vtkIdType f = 0; f < dir->GetNumberOfFiles( ); f++ )
+   {
+      std::string name = dir->GetFile( f );
+      if( name.size( ) > 4 && name.substr( name.size( ) - 4 ) == ".bin" )
+      {
+         entry = std::string( directory ) + "/" + name;
+         numEntries++;
+      }
+   }
+   return( numEntries == 1 ? entry : std::string( ) );
+}
+
+std::string ReadFile( const std::string& fileName )
+{
+   std::ifstream file( fileName.c_str( ), std::ios::in | std::ios::binary );
+   return( std::string( std::istreambuf_iterator<char>( file ), 
+                        std::istreambuf_iterator<char>( ) ) );
+}
+
+void WriteFile( const std::string& fileName, const std::string& content )
+{
+   std::ofstream file( fileName.c_str( ), std::ios::out | std::ios::binary | std::ios::trunc );
+   file.write( content.data( ), content.size( ) );
+}
+
+int main( int argc, char* argv[] )
+{
+   int status = 0;
+
+   // Number of components of each order
+   const int numMoments[5] = { 1, 4, 10, 20, 35 };
+   vtkSmartPointer<vtkImageMomentKernelSource> source = vtkSmartPointer<vtkImageMomentKernelSource>::New( );
+   source->SetKernelSize( 7 );
+   source->SetSubSampling( 70 );
+   for( int order = 0; order <= 4; order++ )
+   {
+      source->SetMaximumOrder( order );
+      source->Update( );
+      if( source->GetNumberOfMoments( ) != numMoments[order]
+          || source->GetOutput( )->GetNumberOfScalarComponents( ) != numMoments[order] )
+      {
+         std::cerr << "Wrong number of components for the order " << order << std::endl;
+         status = 1;
+      }
+   }
+
+   // Sampled kernel (default) against the brute-force one: 10 sub-voxels per
+   // axis
+   std::vector<double> sampled;
+   SampledKernel( 7, 10, 35, sampled );
+   vtkDataArray* kernel = source->GetOutput( )->GetPointData( )->GetScalars( );
+   for( vtkIdType i = 0; i < kernel->GetNumberOfTuples( ); i++ )
+   {
+      for( int m = 0; m < 35; m++ )
+      {
+         double diff = fabs( sampled[i * 35 + m] - kernel->GetComponent( i, m ) );
+         if( diff > 1e-12 * ( 1 + fabs( sampled[i * 35 + m] ) ) )
+         {
+            std::cerr << "Sampled kernel differs from the brute-force one at point " 
+                      << i << ", component " << m << std::endl;
+            status = 1;
+            i = kernel->GetNumberOfTuples( );
+            break;
+         }
+      }
+   }
+
+   // Adaptive integration: the orders 0 and 1, and the mixed moments of order
+   // 2, are integrated exactly by the midpoint rule, so only the squares
+   // differ from the sampled kernel, by at most h^2 / 12 * M000 on a voxel
+   // (h: sub-voxel size in normalized coordinates).
+   vtkSmartPointer<vtkImageMomentKernelSource> adaptive = vtkSmartPointer<vtkImageMomentKernelSource>::New( );
+   adaptive->SetKernelSize( 7 );
+   adaptive->SetSubSampling( 70 );
+   adaptive->SetMaximumOrder( 4 );
+   adaptive->AdaptiveSubSamplingOn( );
+   adaptive->Update( );
+   vtkDataArray* adaptiveKernel = adaptive->GetOutput( )->GetPointData( )->GetScalars( );
+   for( int m = 0; m < 7; m++ )
+   {
+      double diff = MaxComponentDifference( kernel, adaptiveKernel, m );
+      if( diff > 1e-12 )
+      {
+         std::cerr << "Adaptive integration changes the component " << m 
+                   << ": " << diff << std::endl;
+         status = 1;
+      }
+   }
+   double h = 0.1 / 3.5;
+   for( vtkIdType i = 0; i < kernel->GetNumberOfTuples( ); i++ )
+   {
+      double bound = kernel->GetComponent( i, 0 ) * h * h / 12.0 * ( 1 + 1e-9 ) + 1e-15;
+      for( int m = 7; m < 10; m++ )
+      {
+         if( fabs( kernel->GetComponent( i, m ) - adaptiveKernel->GetComponent( i, m ) ) > bound )
+         {
+            std::cerr << "Adaptive integration differs from the sampled kernel by more "
+                      << "than the midpoint error at point " << i << std::endl;
+            status = 1;
+            i = kernel->GetNumberOfTuples( );
+            break;
+         }
+      }
+   }
+
+   // Closed-form integrals of the voxel (4,4,3), inside the sphere: x and y
+   // in [1/7, 3/7], z in [-1/7, 1/7]
+   double Ixy[5], Iz[5];
+   for( int p = 0; p <= 4; p++ )
+   {
+      Ixy[p] = ( pow( 3.0 / 7, p + 1 ) - pow( 1.0 / 7, p + 1 ) ) / ( p + 1 );
+      Iz[p] = ( pow( 1.0 / 7, p + 1 ) - pow( -1.0 / 7, p + 1 ) ) / ( p + 1 );
+   }
+   vtkIdType voxel = ( 3 * 7 + 4 ) * 7 + 4;
+   for( int m = 10; m < 35; m++ )
+   {
+      int e[3];
+      MomentExponents( m, e );
+      double exact = Ixy[e[0]] * Ixy[e[1]] * Iz[e[2]];
+      if( fabs( adaptiveKernel->GetComponent( voxel, m ) - exact ) > 1e-12 * Ixy[0] * Ixy[0] * Iz[0] )
+      {
+         std::cerr << "Adaptive order " << e[0] + e[1] + e[2] << " moment (" << e[0] << "," 
+                   << e[1] << "," << e[2] << ") differs from its exact value" << std::endl;
+         status = 1;
+      }
+   }
+
+   // Mirror symmetries: the reflection through the kernel center along an
+   // axis multiplies the moments odd along this axis by -1. On the middle
+   // plane they are zero.
+   vtkDataArray* kernels[2] = { kernel, adaptiveKernel };
+   for( int k = 0; k < 2; k++ )
+   {
+      for( int axis = 0; axis < 3; axis++ )
+      {
+         int idx[3], mirrorIdx[3];
+         for( idx[2] = 0; idx[2] < 7; idx[2]++ )
+            for( idx[1] = 0; idx[1] < 7; idx[1]++ )
+               for( idx[0] = 0; idx[0] < 7; idx[0]++ )
+               {
+                  for( int a = 0; a < 3; a++ )
+                     mirrorIdx[a] = a == axis ? 6 - idx[a] : idx[a];
+                  vtkIdType i = ( idx[2] * 7 + idx[1] ) * 7 + idx[0];
+                  vtkIdType mirror = ( mirrorIdx[2] * 7 + mirrorIdx[1] ) * 7 + mirrorIdx[0];
+                  for( int m = 0; m < 35; m++ )
+                  {
+                     int e[3];
+                     MomentExponents( m, e );
+                     double sign = e[axis] % 2 ? -1 : 1;
+                     double value = kernels[k]->GetComponent( i, m );
+                     if( kernels[k]->GetComponent( mirror, m ) != sign * value
+                         || ( idx[axis] == 3 && sign < 0 && value != 0 ) )
+                     {
+                        std::cerr << "Moment " << m << " is not " << ( sign < 0 ? "anti" : "" ) 
+                                  << "symmetric along the axis " << axis << std::endl;
+                        status = 1;
+                        idx[2] = 7; idx[1] = 7;
+                        break;
+                     }
+                  }
+               }
+      }
+   }
+
+   // Same kernel for any number of threads
+   vtkSmartPointer<vtkImageMomentKernelSource> single = vtkSmartPointer<vtkImageMomentKernelSource>::New( );
+   single->SetKernelSize( 9 );
+   single->SetMaximumOrder( 4 );
+   single->AdaptiveSubSamplingOn( );
+   single->SetNumberOfThreads( 1 );
+   single->Update( );
+   vtkSmartPointer<vtkImageMomentKernelSource> threaded = vtkSmartPointer<vtkImageMomentKernelSource>::New( );
+   threaded->SetKernelSize( 9 );
+   threaded->SetMaximumOrder( 4 );
+   threaded->AdaptiveSubSamplingOn( );
+   threaded->SetNumberOfThreads( 5 );
+   threaded->Update( );
+   if( !SameKernel( single->GetOutput( )->GetPointData( )->GetScalars( ), 
+                    threaded->GetOutput( )->GetPointData( )->GetScalars( ) ) )
+   {
+      std::cerr << "The kernel depends on the number of threads" << std::endl;
+      status = 1;
+   }
+
+   // Cache: a miss stores the entry, a hit reads it back bit for bit, and a
+   // truncated or mismatching entry is computed and stored again.
+   const char* cacheDirectory = "testImageMomentKernelSourceCache";
+   vtkDirectory::DeleteDirectory( cacheDirectory );
+   vtkSmartPointer<vtkImageMomentKernelSource> reference = vtkSmartPointer<vtkImageMomentKernelSource>::New( );
+   reference->SetKernelSize( 9 );
+   reference->Update( );
+   vtkDataArray* referenceKernel = reference->GetOutput( )->GetPointData( )->GetScalars( );
+
+   vtkSmartPointer<vtkImageMomentKernelSource> miss = vtkSmartPointer<vtkImageMomentKernelSource>::New( );
+   miss->SetKernelSize( 9 );
+   miss->SetCacheDirectory( cacheDirectory );
+   miss->Update( );
+   std::string entry = CacheEntry( cacheDirectory );
+   std::string content = ReadFile( entry );
+   vtkIdType kernelBytes = referenceKernel->GetNumberOfTuples( ) * 10 * sizeof( double );
+   if( entry.empty( ) || static_cast<vtkIdType>( content.size( ) ) <= kernelBytes
+       || !SameKernel( referenceKernel, miss->GetOutput( )->GetPointData( )->GetScalars( ) ) )
+   {
+      std::cerr << "The kernel is not stored in the cache" << std::endl;
+      vtkDirectory::DeleteDirectory( cacheDirectory );
+      return( 1 );
+   }
+
+   // The last value of the entry is changed, so that a hit is visible
+   std::string changed = content;
+   double marker = 12345.0;
+   changed.replace( changed.size( ) - sizeof( double ), sizeof( double ), 
+                    reinterpret_cast<const char*>( &marker ), sizeof( double ) );
+   WriteFile( entry, changed );
+   vtkSmartPointer<vtkImageMomentKernelSource> hit = vtkSmartPointer<vtkImageMomentKernelSource>::New( );
+   hit->SetKernelSize( 9 );
+   hit->SetCacheDirectory( cacheDirectory );
+   hit->Update( );
+   vtkDataArray* hitKernel = hit->GetOutput( )->GetPointData( )->GetScalars( );
+   if( hitKernel->GetComponent( hitKernel->GetNumberOfTuples( ) - 1, 9 ) != marker )
+   {
+      std::cerr << "The kernel is not read from the cache" << std::endl;
+      status = 1;
+   }
+   WriteFile( entry, content );
+   hit->Modified( );
+   hit->Update( );
+   if( !SameKernel( referenceKernel, hit->GetOutput( )->GetPointData( )->GetScalars( ) ) )
+   {
+      std::cerr << "The kernel read from the cache differs from the computed one" << std::endl;
+      status = 1;
+   }
+
+   // Truncated entry, then entry of another format version (first header
+   // field, after the 8 bytes magic)
+   std::string truncated = content.substr( 0, content.size( ) / 2 );
+   std::string mismatched = content;
+   mismatched[8] = static_cast<char>( mismatched[8] + 1 );
+   const std::string invalid[2] = { truncated, mismatched };
+   const char* invalidNames[2] = { "truncated", "mismatching" };
+   for( int c = 0; c < 2; c++ )
+   {
+      WriteFile( entry, invalid[c] );
+      vtkSmartPointer<vtkImageMomentKernelSource> recompute = vtkSmartPointer<vtkImageMomentKernelSource>::New( );
+      recompute->SetKernelSize( 9 );
+      recompute->SetCacheDirectory( cacheDirectory );
+      recompute->Update( );
+      if( !SameKernel( referenceKernel, recompute->GetOutput( )->GetPointData( )->GetScalars( ) )
+          || ReadFile( entry ) != content )
+      {
+         std::cerr << "A " << invalidNames[c] << " cache entry is not computed and stored again" 
+                   << std::endl;
+         status = 1;
+      }
+   }
+   vtkDirectory::DeleteDirectory( cacheDirectory );
+
+   return( status );
+}